@@ -0,0 +1,618 @@
+/* terrain_bench.cpp
+   Benchmarks the hot paths of the terrain pipeline with no window or GL
+   context: the noise map builders, the image and normal map renderers,
+   the bitmap and Terragen writers, the terrain_mesh stages, the grid
+   index topologies, the heightfield codec and the .obj loader. Each benchmark runs at every size from 256 up to its own largest
+   size, or -max if that is smaller, and is warmed up before it is timed.
+   The times are summarised on the console and written as JSON so that
+   releases can be compared:
+
+     {"threads": 8, "grain": 1, "warmup": 1, "repetitions": 5, "results": [
+       {"name": "NoiseMapBuilderPlane::Build", "size": 1024,
+        "items": 1048576, "unit": "samples",
+        "seconds": [...], "min": ..., "mean": ..., "stddev": ...,
+        "p50": ..., "p90": ..., "p99": ..., "max": ..., "rate": ...}, ...]}
+
+   rate is items per second at the median time. The grid index results
+   also have "acmr" and "atvr", their use of a simulated vertex cache, and
+   the codec's encode results "ratio", the raw size over the compressed.
+   Every codec decode is checked against what was encoded, and the
+   benchmark fails if any does not match.
+*/
+
+#include "terrain_mesh.h"
+#include "heightfield_codec.h"
+#include "object_ldr.h"
+#include "job_system.h"
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* Sizes run from the smallest, doubling up to the largest */
+const int BENCH_MIN_SIZE = 256;
+const int BENCH_MAX_SIZE = 8192;
+
+/* Largest sizes of the benchmarks that need more memory per point. An
+   8192 normal map is 768MB and an 8192 terrain several GB, more than a
+   32-bit process can hold. */
+const int BENCH_MAX_NORMAL_SIZE = 4096;
+const int BENCH_MAX_WRITER_SIZE = 4096;
+const int BENCH_MAX_MESH_SIZE = 2048;
+const int BENCH_MAX_CODEC_SIZE = 4096;
+
+/* Tile size of the codec benchmarks, and the error bound of the lossy ones,
+   small next to the noise's range of about -1 to 1 */
+const unsigned int BENCH_CODEC_TILE_SIZE = 64;
+const float BENCH_CODEC_ERROR_BOUND = 0.001f;
+
+/* object_ldr keeps 16-bit indices, so the test grid has at most this many
+   points a side */
+const int BENCH_OBJ_POINTS = 255;
+
+struct bench_options
+{
+	bench_options() : warmup(1), repetitions(5), max_size(BENCH_MAX_SIZE) {}
+
+	int warmup;
+	int repetitions;
+	int max_size;
+	std::string filter;
+	std::string prefix;
+	std::string obj_file;
+};
+
+struct bench_result
+{
+	std::string name;
+	int size;
+	unsigned long long items;
+	const char* unit;
+	std::vector<double> seconds;
+
+	/* Other figures of the result, written to the JSON by name */
+	std::vector<std::pair<std::string, double> > metrics;
+};
+
+static void printUsage(const char* program)
+{
+	printf("Usage: %s [options]\n"
+		"  -warmup <n>       untimed runs before timing (1)\n"
+		"  -reps <n>         timed runs of each benchmark (5)\n"
+		"  -max <size>       largest size to run, from 256 to 8192 (8192)\n"
+		"  -filter <text>    only run benchmarks whose name contains text\n"
+		"  -threads <n>      worker threads (all cores)\n"
+		"  -grain <scale>    multiply the work split off at a time (1)\n"
+		"  -obj <file>       .obj file for object_ldr::load_obj (a generated grid)\n"
+		"  -out <prefix>     prefix of the written files, such as a directory (none)\n",
+		program);
+}
+
+/* Value at fraction p of the sorted times, by nearest rank */
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	size_t rank = (size_t)ceil(p * sorted.size());
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static bool selected(const bench_options& options, const char* name)
+{
+	return options.filter.empty() || strstr(name, options.filter.c_str()) != NULL;
+}
+
+/* Time fn, after the warmup runs, and add the times to the results */
+static void measure(const bench_options& options, const char* name, int size,
+	unsigned long long items, const char* unit, const std::function<void()>& fn,
+	std::vector<bench_result>& results)
+{
+	for (int i = 0; i < options.warmup; i++) fn();
+
+	bench_result result;
+	result.name = name;
+	result.size = size;
+	result.items = items;
+	result.unit = unit;
+	for (int i = 0; i < options.repetitions; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		fn();
+		result.seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	results.push_back(result);
+
+	std::vector<double> sorted(result.seconds);
+	std::sort(sorted.begin(), sorted.end());
+	double median = percentile(sorted, 0.5);
+	printf("%-36s %5d %10.3f ms %10.3f ms  %.4g %s/s\n", name, size, median * 1e3,
+		sorted.back() * 1e3, median > 0.0 ? double(items) / median : 0.0, unit);
+	fflush(stdout);
+}
+
+/* Source module for the noise benchmarks, with the octaves of a typical
+   terrain layer */
+static void setupModule(noise::module::Perlin& module)
+{
+	module.SetSeed(1);
+	module.SetOctaveCount(6);
+	module.SetFrequency(1.0);
+	module.SetPersistence(0.5);
+}
+
+static void benchNoise(const bench_options& options, int size, std::vector<bench_result>& results)
+{
+	noise::module::Perlin module;
+	setupModule(module);
+	noise::utils::NoiseMap noiseMap;
+	unsigned long long samples = (unsigned long long)size * size;
+
+	if (selected(options, "NoiseMapBuilderPlane::Build"))
+	{
+		noise::utils::NoiseMapBuilderPlane builder;
+		builder.SetSourceModule(module);
+		builder.SetDestNoiseMap(noiseMap);
+		builder.SetDestSize(size, size);
+		builder.SetBounds(2.0, 6.0, 1.0, 5.0);
+		measure(options, "NoiseMapBuilderPlane::Build", size, samples, "samples",
+			[&]() { builder.Build(); }, results);
+	}
+
+	if (selected(options, "NoiseMapBuilderSphere::Build"))
+	{
+		noise::utils::NoiseMapBuilderSphere builder;
+		builder.SetSourceModule(module);
+		builder.SetDestNoiseMap(noiseMap);
+		builder.SetDestSize(size, size);
+		builder.SetBounds(-90.0, 90.0, -180.0, 180.0);
+		measure(options, "NoiseMapBuilderSphere::Build", size, samples, "samples",
+			[&]() { builder.Build(); }, results);
+	}
+
+	if (selected(options, "NoiseMapBuilderCylinder::Build"))
+	{
+		noise::utils::NoiseMapBuilderCylinder builder;
+		builder.SetSourceModule(module);
+		builder.SetDestNoiseMap(noiseMap);
+		builder.SetDestSize(size, size);
+		builder.SetBounds(-180.0, 180.0, -1.0, 1.0);
+		measure(options, "NoiseMapBuilderCylinder::Build", size, samples, "samples",
+			[&]() { builder.Build(); }, results);
+	}
+}
+
+/* The renderers and writers work on the same plane noise map */
+static void benchImages(const bench_options& options, int size, std::vector<bench_result>& results)
+{
+	bool render = selected(options, "RendererImage::Render");
+	bool normals = size <= BENCH_MAX_NORMAL_SIZE && selected(options, "RendererNormalMap::Render");
+	bool writers = size <= BENCH_MAX_WRITER_SIZE
+		&& (selected(options, "WriterBMP::WriteDestFile") || selected(options, "WriterTER::WriteDestFile"));
+	if (!render && !normals && !writers) return;
+
+	noise::module::Perlin module;
+	setupModule(module);
+	noise::utils::NoiseMap noiseMap;
+	noise::utils::NoiseMapBuilderPlane builder;
+	builder.SetSourceModule(module);
+	builder.SetDestNoiseMap(noiseMap);
+	builder.SetDestSize(size, size);
+	builder.SetBounds(2.0, 6.0, 1.0, 5.0);
+	builder.Build();
+	unsigned long long pixels = (unsigned long long)size * size;
+
+	noise::utils::Image image;
+	noise::utils::RendererImage renderer;
+	renderer.SetSourceNoiseMap(noiseMap);
+	renderer.SetDestImage(image);
+	renderer.EnableLight(true);
+	if (render)
+	{
+		measure(options, "RendererImage::Render", size, pixels, "pixels",
+			[&]() { renderer.Render(); }, results);
+	}
+	else if (writers)
+	{
+		renderer.Render();
+	}
+
+	if (normals)
+	{
+		std::vector<float> normalBuffer(pixels * 3);
+		noise::utils::RendererNormalMap normalRenderer;
+		normalRenderer.SetSourceNoiseMap(noiseMap);
+		normalRenderer.SetDestNormalBuffer(&normalBuffer[0]);
+		measure(options, "RendererNormalMap::Render", size, pixels, "pixels",
+			[&]() { normalRenderer.Render(); }, results);
+	}
+
+	if (!writers) return;
+	if (selected(options, "WriterBMP::WriteDestFile"))
+	{
+		noise::utils::WriterBMP writer;
+		writer.SetSourceImage(image);
+		writer.SetDestFilename(options.prefix + "bench.bmp");
+		measure(options, "WriterBMP::WriteDestFile", size, writer.CalcDestSize(), "bytes",
+			[&]() { writer.WriteDestFile(); }, results);
+	}
+	if (selected(options, "WriterTER::WriteDestFile"))
+	{
+		noise::utils::WriterTER writer;
+		writer.SetSourceNoiseMap(noiseMap);
+		writer.SetDestFilename(options.prefix + "bench.ter");
+		measure(options, "WriterTER::WriteDestFile", size, writer.CalcDestSize(), "bytes",
+			[&]() { writer.WriteDestFile(); }, results);
+	}
+}
+
+/* createTerrain times its own stages, so each run adds one time to every
+   stage. The terrain is rebuilt from scratch each run, as it is when the
+   parameters change, with its buffers from an arena reset between runs.
+   The terrain samples the standard recipe's heights map with a point per
+   vertex, so every size evaluates the noise at all of its points, however
+   big the recipe makes the map. */
+static void benchMesh(const bench_options& options, int size, std::vector<bench_result>& results)
+{
+	if (size > BENCH_MAX_MESH_SIZE) return;
+	unsigned long long points = (unsigned long long)size * size;
+	float land_size = 50.f;
+
+	if (selected(options, "terrain_mesh::createTerrain"))
+	{
+		const char* names[] = { "terrain_mesh::createTerrain", "terrain_mesh::noise",
+			"terrain_mesh::tiles", "terrain_mesh::elements", "terrain_mesh::lighting",
+			"terrain_mesh::analysis", "terrain_mesh::biomes" };
+		const int stages = sizeof(names) / sizeof(names[0]);
+		std::vector<bench_result> stage_results(stages);
+		for (int s = 0; s < stages; s++)
+		{
+			stage_results[s].name = names[s];
+			stage_results[s].size = size;
+			stage_results[s].items = points;
+			stage_results[s].unit = "points";
+		}
+
+		arena memory;
+		for (int i = 0; i < options.warmup + options.repetitions; i++)
+		{
+			memory.reset();
+			arena_scope scope(memory);
+			terrain_mesh terrain(1, 1.f, 2.f);
+			terrain.createTerrain(size, size, land_size, land_size);
+			if (i < options.warmup) continue;
+
+			const terrain_mesh_timings& t = terrain.timings;
+			double times[] = { t.total, t.noise, t.tiles, t.elements, t.lighting,
+				t.analysis, t.biomes };
+			for (int s = 0; s < stages; s++) stage_results[s].seconds.push_back(times[s]);
+		}
+
+		for (int s = 0; s < stages; s++)
+		{
+			std::vector<double> sorted(stage_results[s].seconds);
+			std::sort(sorted.begin(), sorted.end());
+			double median = percentile(sorted, 0.5);
+			printf("%-36s %5d %10.3f ms %10.3f ms  %.4g points/s\n", names[s], size,
+				median * 1e3, sorted.back() * 1e3, median > 0.0 ? double(points) / median : 0.0);
+			results.push_back(stage_results[s]);
+		}
+		fflush(stdout);
+	}
+
+	/* The normals stage of createTerrain on one tile the size of the
+	   whole terrain, so that it runs on a single thread */
+	if (selected(options, "terrain_mesh::calculateTileNormals"))
+	{
+		terrain_mesh terrain(1, 1.f, 2.f);
+		terrain.createTerrain(size, size, land_size, land_size);
+		noise::utils::NoiseMap heightMap;
+		terrain.fillHeightMap(heightMap);
+		terrain_tile tile = { 0, 0, (unsigned int)size, (unsigned int)size };
+		measure(options, "terrain_mesh::calculateTileNormals", size, points, "normals",
+			[&]() { terrain.calculateTileNormals(tile, heightMap); }, results);
+	}
+}
+
+/* Whether a decoded map matches the original: bit for bit when lossless,
+   otherwise within the error bound plus the float spacing at each value */
+static bool matchesDecode(const noise::utils::NoiseMap& original, const std::vector<float>& decoded,
+	unsigned int columns, unsigned int rows, float error_bound)
+{
+	if (columns != (unsigned int)original.GetWidth() || rows != (unsigned int)original.GetHeight()) return false;
+	for (unsigned int y = 0; y < rows; y++)
+	{
+		const float* expected = original.GetConstSlabPtr(y);
+		const float* actual = &decoded[(size_t)y * columns];
+		if (error_bound == 0.f)
+		{
+			if (memcmp(expected, actual, columns * sizeof(float)) != 0) return false;
+			continue;
+		}
+		for (unsigned int x = 0; x < columns; x++)
+		{
+			double magnitude = std::max(fabs(expected[x]), fabs(actual[x]));
+			double spacing = nextafterf((float)magnitude, HUGE_VALF) - magnitude;
+			if (!(fabs((double)actual[x] - expected[x]) <= error_bound + spacing)) return false;
+		}
+	}
+	return true;
+}
+
+/* Compress a plane noise map losslessly and to an error bound, then
+   decompress it and check the result. Returns false if a decode does not
+   give back what was encoded. */
+static bool benchCodec(const bench_options& options, int size, std::vector<bench_result>& results)
+{
+	if (size > BENCH_MAX_CODEC_SIZE) return true;
+	const char* names[2][2] = {
+		{ "heightfield_codec::encode", "heightfield_codec::decode" },
+		{ "heightfield_codec::encode lossy", "heightfield_codec::decode lossy" } };
+	float bounds[2] = { 0.f, BENCH_CODEC_ERROR_BOUND };
+	if (!selected(options, names[0][0]) && !selected(options, names[0][1])
+		&& !selected(options, names[1][0]) && !selected(options, names[1][1]))
+	{
+		return true;
+	}
+
+	noise::module::Perlin module;
+	setupModule(module);
+	noise::utils::NoiseMap noiseMap;
+	noise::utils::NoiseMapBuilderPlane builder;
+	builder.SetSourceModule(module);
+	builder.SetDestNoiseMap(noiseMap);
+	builder.SetDestSize(size, size);
+	builder.SetBounds(2.0, 6.0, 1.0, 5.0);
+	builder.Build();
+	unsigned long long samples = (unsigned long long)size * size;
+	double raw_bytes = double(samples * sizeof(float));
+
+	bool ok = true;
+	for (int b = 0; b < 2; b++)
+	{
+		std::vector<unsigned char> archive;
+		if (!heightfield_codec::encodeNoiseMap(noiseMap, BENCH_CODEC_TILE_SIZE, bounds[b], archive))
+		{
+			fprintf(stderr, "%s could not encode the %d map\n", names[b][0], size);
+			ok = false;
+			continue;
+		}
+
+		if (selected(options, names[b][0]))
+		{
+			std::vector<unsigned char> out;
+			measure(options, names[b][0], size, samples, "samples", [&]()
+			{
+				heightfield_codec::encodeNoiseMap(noiseMap, BENCH_CODEC_TILE_SIZE, bounds[b], out);
+			}, results);
+			results.back().metrics.push_back(std::make_pair(std::string("ratio"), raw_bytes / archive.size()));
+			printf("%-36s %5d   ratio %.2f\n", "", size, raw_bytes / archive.size());
+			fflush(stdout);
+		}
+
+		std::vector<float> decoded;
+		unsigned int columns = 0, rows = 0;
+		bool valid = false;
+		std::function<void()> decode = [&]()
+		{
+			valid = heightfield_codec::decodeTiles(&archive[0], archive.size(), decoded, columns, rows);
+		};
+		if (selected(options, names[b][1])) measure(options, names[b][1], size, samples, "samples", decode, results);
+		else decode();
+		if (!valid || !matchesDecode(noiseMap, decoded, columns, rows, bounds[b]))
+		{
+			fprintf(stderr, "%s gave back a different %d map\n", names[b][1], size);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+/* Build the indices of each topology without the cache, and draw them
+   through the simulated vertex cache to compare how well they use it */
+static void benchIndices(const bench_options& options, int size, std::vector<bench_result>& results)
+{
+	if (size > BENCH_MAX_MESH_SIZE) return;
+
+	for (int t = 0; t < GRID_TOPOLOGIES; t++)
+	{
+		std::string name = std::string("grid_index_cache::build ")
+			+ grid_index_cache::topologyName((grid_topology)t);
+		if (!selected(options, name.c_str())) continue;
+
+		grid_indices grid;
+		grid.key.xsize = size;
+		grid.key.zsize = size;
+		grid.key.topology = (grid_topology)t;
+		grid.key.lod = 0;
+		grid.buffer = 0;
+		measure(options, name.c_str(), size, 2ULL * (size - 1) * (size - 1), "triangles",
+			[&]() { grid_index_cache::build(grid); }, results);
+
+		grid_cache_stats stats = grid_index_cache::simulateCache(grid);
+		results.back().metrics.push_back(std::make_pair(std::string("acmr"), stats.acmr));
+		results.back().metrics.push_back(std::make_pair(std::string("atvr"), stats.atvr));
+		printf("%-36s %5d   ACMR %.3f   ATVR %.3f\n", "", size, stats.acmr, stats.atvr);
+		fflush(stdout);
+	}
+}
+
+/* Write a flat grid of points x points vertices as an .obj file */
+static bool writeGridObj(const std::string& filename, int points)
+{
+	FILE* out = fopen(filename.c_str(), "w");
+	if (!out) return false;
+	for (int z = 0; z < points; z++)
+	{
+		for (int x = 0; x < points; x++)
+		{
+			fprintf(out, "v %f %f %f\n", float(x), float((x * 7 + z * 13) % 5) * 0.1f, float(z));
+		}
+	}
+	for (int z = 0; z < points - 1; z++)
+	{
+		for (int x = 0; x < points - 1; x++)
+		{
+			int v = z * points + x + 1;
+			fprintf(out, "f %d %d %d\n", v, v + points, v + 1);
+			fprintf(out, "f %d %d %d\n", v + 1, v + points, v + points + 1);
+		}
+	}
+	bool ok = !ferror(out);
+	return fclose(out) == 0 && ok;
+}
+
+static void benchObj(const bench_options& options, std::vector<bench_result>& results)
+{
+	if (!selected(options, "object_ldr::load_obj")) return;
+
+	std::string filename = options.obj_file;
+	if (filename.empty())
+	{
+		filename = options.prefix + "bench.obj";
+		if (!writeGridObj(filename, BENCH_OBJ_POINTS))
+		{
+			fprintf(stderr, "Could not write %s\n", filename.c_str());
+			return;
+		}
+	}
+
+	/* Loading is measured in bytes of the file */
+	FILE* in = fopen(filename.c_str(), "rb");
+	if (!in)
+	{
+		fprintf(stderr, "Could not open %s\n", filename.c_str());
+		return;
+	}
+	fseek(in, 0, SEEK_END);
+	long bytes = ftell(in);
+	fclose(in);
+
+	/* The size is the points a side of the generated grid, or 0 for a file
+	   given on the command line */
+	int size = options.obj_file.empty() ? BENCH_OBJ_POINTS : 0;
+	measure(options, "object_ldr::load_obj", size, (unsigned long long)bytes, "bytes",
+		[&]()
+		{
+			object_ldr object;
+			object.load_obj(filename.c_str());
+		}, results);
+}
+
+static void writeJsonString(FILE* out, const std::string& s)
+{
+	fputc('"', out);
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		if (s[i] == '"' || s[i] == '\\') fputc('\\', out);
+		if ((unsigned char)s[i] >= 0x20) fputc(s[i], out);
+	}
+	fputc('"', out);
+}
+
+static bool writeJson(const std::string& filename, const bench_options& options,
+	const std::vector<bench_result>& results)
+{
+	FILE* out = fopen(filename.c_str(), "w");
+	if (!out) return false;
+
+	fprintf(out, "{\"threads\": %u, \"grain\": %g, \"warmup\": %d, \"repetitions\": %d, \"results\": [",
+		job_system::instance().getThreadCount(), job_system::instance().getGrainScale(),
+		options.warmup, options.repetitions);
+	for (size_t r = 0; r < results.size(); r++)
+	{
+		const bench_result& result = results[r];
+		std::vector<double> sorted(result.seconds);
+		std::sort(sorted.begin(), sorted.end());
+		double mean = 0.0;
+		for (size_t i = 0; i < sorted.size(); i++) mean += sorted[i];
+		mean /= double(sorted.size());
+		double variance = 0.0;
+		for (size_t i = 0; i < sorted.size(); i++) variance += (sorted[i] - mean) * (sorted[i] - mean);
+		variance /= double(sorted.size());
+		double median = percentile(sorted, 0.5);
+
+		fprintf(out, "%s\n  {\"name\": ", r ? "," : "");
+		writeJsonString(out, result.name);
+		fprintf(out, ", \"size\": %d, \"items\": %llu, \"unit\": \"%s\",\n   \"seconds\": [",
+			result.size, result.items, result.unit);
+		for (size_t i = 0; i < result.seconds.size(); i++)
+		{
+			fprintf(out, "%s%.9g", i ? ", " : "", result.seconds[i]);
+		}
+		fprintf(out, "],\n   \"min\": %.9g, \"mean\": %.9g, \"stddev\": %.9g, \"p50\": %.9g,"
+			" \"p90\": %.9g, \"p99\": %.9g, \"max\": %.9g, \"rate\": %.9g",
+			sorted.front(), mean, sqrt(variance), median, percentile(sorted, 0.9),
+			percentile(sorted, 0.99), sorted.back(), median > 0.0 ? double(result.items) / median : 0.0);
+		for (size_t i = 0; i < result.metrics.size(); i++)
+		{
+			fprintf(out, ", ");
+			writeJsonString(out, result.metrics[i].first);
+			fprintf(out, ": %.9g", result.metrics[i].second);
+		}
+		fputc('}', out);
+	}
+	fprintf(out, "\n]}\n");
+
+	bool ok = !ferror(out);
+	return fclose(out) == 0 && ok;
+}
+
+int main(int argc, char* argv[])
+{
+	bench_options options;
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+
+		if (!strcmp(argv[i], "-warmup")) options.warmup = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-reps")) options.repetitions = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-max")) options.max_size = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-filter")) options.filter = argv[i + 1];
+		else if (!strcmp(argv[i], "-threads")) job_system::instance().setThreadCount((unsigned)atoi(argv[i + 1]));
+		else if (!strcmp(argv[i], "-grain")) job_system::instance().setGrainScale((float)atof(argv[i + 1]));
+		else if (!strcmp(argv[i], "-obj")) options.obj_file = argv[i + 1];
+		else if (!strcmp(argv[i], "-out")) options.prefix = argv[i + 1];
+		else
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+		i++;
+	}
+	if (options.warmup < 0 || options.repetitions < 1 || options.max_size < BENCH_MIN_SIZE)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	printf("%-36s %5s %13s %13s  %s\n", "Benchmark", "Size", "Median", "Max", "Rate");
+	std::vector<bench_result> results;
+	bool decoded = true;
+	for (int size = BENCH_MIN_SIZE; size <= options.max_size && size <= BENCH_MAX_SIZE; size *= 2)
+	{
+		benchNoise(options, size, results);
+		benchImages(options, size, results);
+		benchMesh(options, size, results);
+		benchIndices(options, size, results);
+		decoded = benchCodec(options, size, results) && decoded;
+	}
+	benchObj(options, results);
+
+	std::string json = options.prefix + "bench.json";
+	if (!writeJson(json, options, results))
+	{
+		fprintf(stderr, "Could not write %s\n", json.c_str());
+		return 1;
+	}
+	printf("Results written to %s\n", json.c_str());
+	return decoded ? 0 : 1;
+}
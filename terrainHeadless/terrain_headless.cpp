@@ -0,0 +1,255 @@
+/* terrain_headless.cpp
+   Generates terrain with no window or GL context, for machines with no GPU
+   or display. The parameters come from the command line, each stage is
+   timed and the results are written to files:
+
+     <prefix>terrain.hfd           heights, normals, lighting, flow and materials,
+                                   loadable by terrainNoise
+     <prefix>heightmap.pgm         heights as a 16-bit graymap
+     <prefix>flowaccumulation.raw  flow accumulation as 32-bit floats
+     <prefix>rivers.pgm            river mask
+     <prefix>trace.json            stage timings for chrome://tracing
+
+   With -debugmaps the noise maps that go into the terrain are also written
+   as <prefix><name>heightmap.bmp and .pgm previews. With -archive the
+   heights are also compressed with heightfield_codec into
+   <prefix>terrain.hfz, for storing many terrains.
+*/
+
+#include "terrain_mesh.h"
+#include "job_system.h"
+#include "profiler.h"
+#include "artifact_exporter.h"
+#include "terrain_recipe.h"
+#include "heightfield_codec.h"
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/* Points a side of the terrain grid unless -size says otherwise, the same
+   grid as terrainNoise. The terrain samples the bounds of the recipe's
+   heights map at this resolution, whatever size the recipe gives the map. */
+const unsigned int TERRAIN_POINTS = 256;
+
+/* Points a side of the tiles of terrain.hfz, each compressed on its own */
+const unsigned int ARCHIVE_TILE_SIZE = 64;
+
+static void printUsage(const char* program)
+{
+	printf("Usage: %s [options]\n"
+		"  -recipe <file>    terrain recipe (the standard terrain)\n"
+		"  -octaves <n>      noise octaves (1)\n"
+		"  -freq <f>         noise frequency (1)\n"
+		"  -scale <s>        noise scale (2)\n"
+		"  -size <n>         points a side of the terrain grid (256)\n"
+		"  -land <size>      width and depth of the terrain in world units (50)\n"
+		"  -hydraulic <n>    hydraulic erosion droplets (0)\n"
+		"  -thermal <n>      thermal erosion iterations (0)\n"
+		"  -sun <x> <y> <z>  direction towards the sun (0.6 0.45 0.3)\n"
+		"  -threads <n>      worker threads (all cores)\n"
+		"  -grain <scale>    multiply the work split off at a time (1)\n"
+		"  -debugmaps <0|1>  write previews of the noise maps (0)\n"
+		"  -topology <name>  triangle order: strips, restart, tiled, hilbert or forsyth (restart)\n"
+		"  -archive <error>  also write terrain.hfz, heights within error, 0 for lossless (none)\n"
+		"  -out <prefix>     prefix of the output files, such as a directory (none)\n",
+		program);
+}
+
+int main(int argc, char* argv[])
+{
+	int octaves = 1;
+	float perlin_frequency = 1.f;
+	float perlin_scale = 2.f;
+	float land_size = 50.f;
+	int points = TERRAIN_POINTS;
+	unsigned int droplets = 0;
+	int thermal_iterations = 0;
+	glm::vec3 sun(0.6f, 0.45f, 0.3f);
+	std::string prefix;
+	grid_topology topology = GRID_STRIP_RESTART;
+	/* Negative for no archive */
+	float archive_error = -1.f;
+	terrain_recipe recipe = terrain_recipe::standard();
+
+	for (int i = 1; i < argc; i++)
+	{
+		/* Number of values each option takes */
+		int values = !strcmp(argv[i], "-sun") ? 3 : 1;
+		if (i + values >= argc)
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+
+		if (!strcmp(argv[i], "-recipe"))
+		{
+			std::string error;
+			if (!recipe.load(argv[i + 1], error))
+			{
+				fprintf(stderr, "%s: %s\n", argv[i + 1], error.c_str());
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "-octaves")) octaves = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-freq")) perlin_frequency = (float)atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "-scale")) perlin_scale = (float)atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "-size")) points = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-land")) land_size = (float)atof(argv[i + 1]);
+		else if (!strcmp(argv[i], "-hydraulic")) droplets = (unsigned int)atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-thermal")) thermal_iterations = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-threads")) job_system::instance().setThreadCount((unsigned)atoi(argv[i + 1]));
+		else if (!strcmp(argv[i], "-grain")) job_system::instance().setGrainScale((float)atof(argv[i + 1]));
+		else if (!strcmp(argv[i], "-out")) prefix = argv[i + 1];
+		else if (!strcmp(argv[i], "-debugmaps")) artifact_exporter::instance().setEnabled(atoi(argv[i + 1]) != 0);
+		else if (!strcmp(argv[i], "-topology"))
+		{
+			if (!grid_index_cache::topologyFromName(argv[i + 1], topology))
+			{
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "-archive"))
+		{
+			archive_error = (float)atof(argv[i + 1]);
+			if (!(archive_error >= 0.f))
+			{
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "-sun"))
+		{
+			sun = glm::vec3((float)atof(argv[i + 1]), (float)atof(argv[i + 2]), (float)atof(argv[i + 3]));
+		}
+		else
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+		i += values;
+	}
+
+	/* The terrain needs at least two points a side to have any triangles */
+	if (points < 2)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	artifact_exporter::instance().setPrefix(prefix);
+
+	/* The terrain and every buffer used to build it come from one arena */
+	arena memory;
+	arena_scope scope(memory);
+	terrain_mesh terrain(octaves, perlin_frequency, perlin_scale);
+	terrain.recipe = &recipe;
+	terrain.hydraulic.droplets = droplets;
+	terrain.thermal.iterations = thermal_iterations;
+	terrain.sun_direction = sun;
+	terrain.topology = topology;
+	terrain.createTerrain(points, points, land_size, land_size);
+
+	const terrain_mesh_timings& t = terrain.timings;
+	printf("Generated %u x %u points on %u threads\n", terrain.xsize, terrain.zsize,
+		job_system::instance().getThreadCount());
+	printf("  noise     %8.3f s\n", t.noise);
+	printf("  erosion   %8.3f s\n", t.erosion);
+	printf("  tiles     %8.3f s\n", t.tiles);
+	printf("  elements  %8.3f s\n", t.elements);
+	printf("  lighting  %8.3f s\n", t.lighting);
+	printf("  analysis  %8.3f s\n", t.analysis);
+	printf("  biomes    %8.3f s\n", t.biomes);
+	printf("  total     %8.3f s\n", t.total);
+
+	if (droplets > 0)
+	{
+		const hydraulic_erosion_stats& hydraulic = terrain.hydraulic_stats;
+		printf("  hydraulic erosion: %llu droplets, %llu steps in %.3f s (%.0f droplets/s)\n",
+			hydraulic.droplets, hydraulic.steps, hydraulic.seconds, hydraulic.dropletsPerSecond());
+	}
+	if (thermal_iterations > 0)
+	{
+		const thermal_erosion_stats& thermal = terrain.thermal_stats;
+		printf("  thermal erosion: %d iterations in %.3f s, last change %g\n",
+			thermal.iterations, thermal.seconds, thermal.last_change);
+	}
+
+	grid_cache_stats cache = grid_index_cache::simulateCache(*terrain.elements);
+	printf("  %s triangles: ACMR %.3f, ATVR %.3f with a %u vertex cache\n",
+		grid_index_cache::topologyName(topology), cache.acmr, cache.atvr, GRID_CACHE_SIZE);
+
+	job_system_stats stats = job_system::instance().getStats();
+	printf("  %llu work items, %llu stolen, %.3f s idle\n", stats.items, stats.steals,
+		stats.idle_seconds);
+
+	/* The output files only read the terrain, so write them side by side */
+	job_system& jobs = job_system::instance();
+	bool saved = false;
+	std::vector<job_handle> writes;
+	writes.push_back(jobs.submit([&]()
+	{
+		saved = terrain.saveTerrain((prefix + "terrain.hfd").c_str());
+	}));
+	writes.push_back(jobs.submit([&]()
+	{
+		noise::utils::NoiseMap heightMap;
+		terrain.fillHeightMap(heightMap);
+		noise::utils::WriterPGM heightWriter;
+		heightWriter.SetSourceNoiseMap(heightMap);
+		heightWriter.EnableNormalize(true);
+		heightWriter.SetDestFilename(prefix + "heightmap.pgm");
+		heightWriter.WriteDestFile();
+	}));
+	writes.push_back(jobs.submit([&]() { terrain.writeFlowMaps(prefix.c_str()); }));
+	bool archived = archive_error < 0.f;
+	size_t archive_bytes = 0;
+	if (!archived)
+	{
+		writes.push_back(jobs.submit([&]()
+		{
+			noise::utils::NoiseMap heightMap;
+			terrain.fillHeightMap(heightMap);
+			std::vector<unsigned char> archive;
+			if (!heightfield_codec::encodeNoiseMap(heightMap, ARCHIVE_TILE_SIZE, archive_error, archive)) return;
+			FILE* out = fopen((prefix + "terrain.hfz").c_str(), "wb");
+			if (!out) return;
+			archived = fwrite(&archive[0], 1, archive.size(), out) == archive.size();
+			archived = fclose(out) == 0 && archived;
+			archive_bytes = archive.size();
+		}));
+	}
+	for (size_t i = 0; i < writes.size(); i++) jobs.wait(writes[i]);
+	artifact_exporter::instance().flush();
+	printf("  %.1f MB arena peak, %.1f MB reserved\n", memory.getPeak() / (1024.0 * 1024.0),
+		memory.getReserved() / (1024.0 * 1024.0));
+
+	if (!saved)
+	{
+		fprintf(stderr, "Could not write %sterrain.hfd\n", prefix.c_str());
+		return 1;
+	}
+	if (!archived)
+	{
+		fprintf(stderr, "Could not write %sterrain.hfz\n", prefix.c_str());
+		return 1;
+	}
+	if (archive_error >= 0.f)
+	{
+		double height_bytes = (double)terrain.xsize * terrain.zsize * sizeof(float);
+		printf("  %.2f MB of heights archived in %.2f MB (%.2f:1)\n", height_bytes / (1024.0 * 1024.0),
+			archive_bytes / (1024.0 * 1024.0), archive_bytes ? height_bytes / archive_bytes : 0.0);
+	}
+
+	printf("\n");
+	profiler::printSummary();
+	if (!profiler::writeChromeTrace((prefix + "trace.json").c_str()))
+	{
+		fprintf(stderr, "Could not write %strace.json\n", prefix.c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,158 @@
+/* arena.cpp
+   A region allocator for the buffers of one terrain regeneration.
+*/
+
+#include "arena.h"
+#include <algorithm>
+#include <new>
+
+/* Every buffer starts on a multiple of this, enough for any type */
+const size_t ARENA_ALIGNMENT = 16;
+
+static size_t alignSize(size_t size)
+{
+	if (size == 0) size = 1;
+	return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+arena::arena(size_t block_size)
+{
+	this->block_size = alignSize(block_size);
+	current = 0;
+	offset = 0;
+	used = 0;
+	peak = 0;
+	live = 0;
+	last = NULL;
+	last_offset = 0;
+}
+
+arena::~arena()
+{
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		::operator delete(blocks[i].data);
+	}
+}
+
+void arena::addBlock(size_t size)
+{
+	block b;
+	b.size = size;
+	try
+	{
+		b.data = (char*)::operator new(size + ARENA_ALIGNMENT);
+	}
+	catch (...)
+	{
+		throw noise::ExceptionOutOfMemory();
+	}
+	blocks.push_back(b);
+}
+
+/* The first aligned byte of a block. Blocks are allocated one alignment
+   larger than their size so that this leaves size bytes after it. */
+static char* blockStart(char* data)
+{
+	size_t address = (size_t)data;
+	return data + (alignSize(address) - address);
+}
+
+void* arena::Allocate(size_t size)
+{
+	size = alignSize(size);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	/* Move on to the next block that has room, adding one if none has */
+	while (current < blocks.size() && offset + size > blocks[current].size)
+	{
+		current++;
+		offset = 0;
+	}
+	if (current == blocks.size())
+	{
+		addBlock(std::max(block_size, size));
+	}
+
+	char* buffer = blockStart(blocks[current].data) + offset;
+	last = buffer;
+	last_offset = offset;
+	offset += size;
+
+	used += size;
+	if (used > peak) peak = used;
+	live++;
+	return buffer;
+}
+
+void arena::Free(void* buffer)
+{
+	if (buffer == NULL) return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	live--;
+
+	/* The most recent buffer is always in the current block */
+	if (buffer == last)
+	{
+		used -= offset - last_offset;
+		offset = last_offset;
+		last = NULL;
+	}
+}
+
+bool arena::reset()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (live > 0) return false;
+
+	/* Needing more than one block means the buffers did not fit in the
+	   first, so replace the blocks with one that holds them all */
+	if (current > 0)
+	{
+		size_t total = 0;
+		for (size_t i = 0; i < blocks.size(); i++)
+		{
+			total += blocks[i].size;
+			::operator delete(blocks[i].data);
+		}
+		blocks.clear();
+		addBlock(total);
+	}
+
+	current = 0;
+	offset = 0;
+	used = 0;
+	last = NULL;
+	return true;
+}
+
+size_t arena::getUsed() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return used;
+}
+
+size_t arena::getPeak() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return peak;
+}
+
+size_t arena::getReserved() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t total = 0;
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		total += blocks[i].size;
+	}
+	return total;
+}
+
+size_t arena::getLiveCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return live;
+}
@@ -0,0 +1,125 @@
+/* arena.h
+   A region allocator for the buffers of one terrain regeneration: the
+   vertex arrays, the noise maps and images of the builders, renderers and
+   stages, and the buffers the writers fill.
+
+   Allocating moves a pointer through large blocks, and single buffers are
+   not given back to the heap. Freeing a buffer only counts it as no longer
+   in use, except that the most recent buffer is taken back at once, so a
+   short-lived buffer used between two others costs nothing. When every
+   buffer is free, reset makes the whole arena free again in constant time
+   and keeps its blocks for the next regeneration. If the last regeneration
+   needed more than one block, reset replaces them with a single block big
+   enough for all of it, so repeated regenerations of the same size come
+   from the same memory and never reach the heap.
+
+   arena_scope makes an arena the allocator of every noise map, image and
+   writer buffer allocated while it is in scope, on any thread.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+#include "noiseutils.h"
+
+/* Size of the first block, and of each block added when one fills up */
+const size_t ARENA_BLOCK_SIZE = 16 * 1024 * 1024;
+
+class arena : public noise::utils::BufferAllocator
+{
+public:
+	explicit arena(size_t block_size = ARENA_BLOCK_SIZE);
+	~arena();
+
+	/* Allocate size bytes aligned for any type. Safe to call from several
+	   threads at once. */
+	void* Allocate(size_t size);
+	void Free(void* buffer);
+
+	/* Make all of the arena free again. Returns false, leaving the arena
+	   as it was, if any buffer is still in use. */
+	bool reset();
+
+	/* Bytes in use now, the most in use at once since the arena was made,
+	   and the bytes of all the blocks */
+	size_t getUsed() const;
+	size_t getPeak() const;
+	size_t getReserved() const;
+
+	/* Buffers allocated and not yet freed */
+	size_t getLiveCount() const;
+
+private:
+	arena(const arena&);
+	arena& operator=(const arena&);
+
+	struct block
+	{
+		char* data;
+		size_t size;
+	};
+
+	void addBlock(size_t size);
+
+	mutable std::mutex mutex;
+	std::vector<block> blocks;
+	size_t block_size;
+	size_t current;
+	size_t offset;
+	size_t used;
+	size_t peak;
+	size_t live;
+	char* last;
+	size_t last_offset;
+};
+
+/* Take every buffer from an arena while in scope */
+class arena_scope
+{
+public:
+	explicit arena_scope(arena& memory)
+		: previous(noise::utils::GetBufferAllocator())
+	{
+		noise::utils::SetBufferAllocator(&memory);
+	}
+
+	~arena_scope()
+	{
+		noise::utils::SetBufferAllocator(previous);
+	}
+
+private:
+	arena_scope(const arena_scope&);
+	arena_scope& operator=(const arena_scope&);
+
+	noise::utils::BufferAllocator* previous;
+};
+
+/* A temporary array of count T from the current buffer allocator, given
+   back when it goes out of scope. T must not need constructing, as with
+   float. */
+template <class T>
+class scratch_array
+{
+public:
+	explicit scratch_array(size_t count)
+		: data((T*)noise::utils::AllocateBuffer(count * sizeof(T), allocator)) {}
+
+	~scratch_array()
+	{
+		noise::utils::FreeBuffer(data, allocator);
+	}
+
+	T* get() { return data; }
+	T& operator[](size_t i) { return data[i]; }
+	const T& operator[](size_t i) const { return data[i]; }
+
+private:
+	scratch_array(const scratch_array&);
+	scratch_array& operator=(const scratch_array&);
+
+	noise::utils::BufferAllocator* allocator;
+	T* data;
+};
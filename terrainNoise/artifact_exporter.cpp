@@ -0,0 +1,120 @@
+/* artifact_exporter.cpp
+   Writes debug artifacts as background tasks on the shared job_system.
+*/
+
+#include "artifact_exporter.h"
+#include "profiler.h"
+#include <stdio.h>
+#include <memory>
+
+artifact_exporter::artifact_exporter()
+{
+	enabled = false;
+}
+
+artifact_exporter::~artifact_exporter()
+{
+	flush();
+}
+
+artifact_exporter& artifact_exporter::instance()
+{
+	/* Jobs use the worker pool, so make sure it is created first and
+	   therefore destroyed after the exporter has finished its jobs */
+	job_system::instance();
+	static artifact_exporter exporter;
+	return exporter;
+}
+
+void artifact_exporter::setEnabled(bool enable)
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	enabled = enable;
+}
+
+bool artifact_exporter::isEnabled() const
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	return enabled;
+}
+
+void artifact_exporter::setPrefix(const std::string& file_prefix)
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	prefix = file_prefix;
+}
+
+std::string artifact_exporter::getPrefix() const
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	return prefix;
+}
+
+void artifact_exporter::exportHeightMap(const noise::utils::NoiseMap& heightMap, const std::string& name)
+{
+	if (!isEnabled()) return;
+
+	/* std::function needs a copyable job, so share the one copy of the map */
+	std::shared_ptr<noise::utils::NoiseMap> copy(new noise::utils::NoiseMap(heightMap));
+	post([this, copy, name]() { writeHeightMap(*copy, name); });
+}
+
+void artifact_exporter::post(const std::function<void()>& job)
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	if (!enabled) return;
+
+	/* A job that fails only loses its own artifact */
+	std::vector<job_handle> after;
+	if (last_job) after.push_back(last_job);
+	last_job = job_system::instance().submit([job]()
+	{
+		try
+		{
+			job();
+		}
+		catch (...)
+		{
+			fprintf(stderr, "Could not export a debug artifact\n");
+		}
+	}, after);
+}
+
+void artifact_exporter::flush()
+{
+	job_handle last;
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		last = last_job;
+	}
+	job_system::instance().wait(last);
+}
+
+void artifact_exporter::writeHeightMap(const noise::utils::NoiseMap& heightMap, const std::string& name)
+{
+	PROFILE_SCOPE("artifact_exporter::writeHeightMap");
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		path = prefix + name;
+	}
+
+	noise::utils::RendererImage renderer;
+	noise::utils::Image image;
+	renderer.SetSourceNoiseMap(heightMap);
+	renderer.SetDestImage(image);
+	renderer.Render();
+
+	noise::utils::WriterBMP writer;
+	writer.SetSourceImage(image);
+	writer.SetDestFilename(path + ".bmp");
+	writer.WriteDestFile();
+
+	// The bitmap only keeps 8 bits of the heights, so also write them at
+	// full precision as a 16-bit graymap
+	noise::utils::WriterPGM heightWriter;
+	heightWriter.SetSourceNoiseMap(heightMap);
+	heightWriter.EnableNormalize(true);
+	heightWriter.SetDestFilename(path + ".pgm");
+	heightWriter.WriteDestFile();
+}
@@ -0,0 +1,60 @@
+/* artifact_exporter.h
+   Writes debug artifacts, such as previews of the noise maps that go into
+   the terrain, as background tasks on the shared job_system so that they
+   never hold up terrain generation. Each job follows the one before it, so
+   the jobs run one at a time and in order.
+   Exporting is off until setEnabled(true) is called, and while it is off
+   nothing is copied, queued or written.
+*/
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include "job_system.h"
+#include "noiseutils.h"
+
+class artifact_exporter
+{
+public:
+	artifact_exporter();
+
+	/* Finishes every queued job before returning */
+	~artifact_exporter();
+
+	/* The exporter shared by the whole application */
+	static artifact_exporter& instance();
+
+	void setEnabled(bool enable);
+	bool isEnabled() const;
+
+	/* Put in front of every file name, so it can name a directory */
+	void setPrefix(const std::string& file_prefix);
+	std::string getPrefix() const;
+
+	/* Queue a copy of the map to be written as <prefix><name>.bmp, an 8-bit
+	   preview, and <prefix><name>.pgm with the heights at 16 bits. Does
+	   nothing if exporting is off. */
+	void exportHeightMap(const noise::utils::NoiseMap& heightMap, const std::string& name);
+
+	/* Queue job to run in the background, for artifacts that are worth
+	   building only when they are exported. Does nothing if exporting is
+	   off. Call flush before changing the job_system's thread count. */
+	void post(const std::function<void()>& job);
+
+	/* Wait until every queued job has run */
+	void flush();
+
+	/* Write the map straight away on the calling thread */
+	void writeHeightMap(const noise::utils::NoiseMap& heightMap, const std::string& name);
+
+private:
+	artifact_exporter(const artifact_exporter&);
+	artifact_exporter& operator=(const artifact_exporter&);
+
+	mutable std::mutex queue_mutex;
+	job_handle last_job;
+	bool enabled;
+	std::string prefix;
+};
@@ -0,0 +1,127 @@
+/* biome_splat.cpp
+   Classifies every point of a terrain into a blend of materials.
+*/
+
+#include "biome_splat.h"
+#include "job_system.h"
+#include <math.h>
+#include <chrono>
+#include <noise/noise.h>
+
+/* Rows handled by one job on the worker pool */
+const int BIOME_BAND_ROWS = 16;
+
+biome_params::biome_params()
+{
+	sea_level = 0.f;
+	earth_line = 0.5f;
+	snow_line = 0.85f;
+	height_blend = 0.08f;
+	rock_slope = 0.35f;
+	slope_blend = 0.15f;
+	river_flow = 200.f;
+	moisture_frequency = 0.02f;
+	moisture_seed = 7;
+}
+
+double biome_stats::pointsPerSecond() const
+{
+	return seconds > 0.0 ? double(points) / seconds : 0.0;
+}
+
+/* 0 below edge - blend, 1 above edge + blend and smooth in between */
+static inline float smoothStep(float edge, float blend, float value)
+{
+	float t = (value - (edge - blend)) / (2.f * blend);
+	t = t < 0.f ? 0.f : (t > 1.f ? 1.f : t);
+	return t * t * (3.f - 2.f * t);
+}
+
+void biome_splat::run(const float* heights, const float* normal_up, size_t normal_stride,
+	const noise::utils::NoiseMap* accumulation, int columns, int rows,
+	const biome_params& params, unsigned char* splat, biome_stats* stats)
+{
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	biome_stats totals = {};
+	if (columns <= 0 || rows <= 0)
+	{
+		if (stats) *stats = totals;
+		return;
+	}
+	int count = columns * rows;
+	totals.points = (unsigned long long)count;
+
+	/* Heights are classified relative to the highest point above the sea */
+	float top = params.sea_level;
+	for (int i = 0; i < count; i++)
+	{
+		if (heights[i] > top) top = heights[i];
+	}
+	float inv_top = top > params.sea_level ? 1.f / (top - params.sea_level) : 0.f;
+
+	/* Flow is compared on a log scale, up to the river threshold */
+	float inv_river = params.river_flow > 1.f ? 1.f / logf(params.river_flow) : 0.f;
+
+	noise::module::Perlin moisture;
+	moisture.SetSeed(params.moisture_seed);
+	moisture.SetOctaveCount(3);
+
+	job_system::instance().parallel_for(0, rows, BIOME_BAND_ROWS, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			const float* flow_row = accumulation ? accumulation->GetConstSlabPtr(y) : NULL;
+			for (int x = 0; x < columns; x++)
+			{
+				size_t i = (size_t)y * columns + x;
+				float h = heights[i];
+				float t = (h - params.sea_level) * inv_top;
+				float slope = 1.f - normal_up[i * normal_stride];
+
+				float wet = 0.5f + 0.5f * float(moisture.GetValue(x * params.moisture_frequency, 0.0,
+					y * params.moisture_frequency));
+				float river = 0.f;
+				if (flow_row)
+				{
+					river = logf(flow_row[x]) * inv_river;
+					river = river > 1.f ? 1.f : river;
+					wet += 0.5f * river;
+				}
+				wet = wet < 0.f ? 0.f : (wet > 1.f ? 1.f : wet);
+
+				/* Water takes the sea and the rivers, snow the peaks that are
+				   not too steep to hold it, earth the steep and the high dry
+				   ground, and grass whatever is left */
+				float weight[BIOME_MATERIALS];
+				float remaining = 1.f;
+				weight[BIOME_WATER] = h <= params.sea_level ? 1.f : (river >= 1.f ? 0.75f : 0.f);
+				remaining -= weight[BIOME_WATER];
+
+				float steep = smoothStep(params.rock_slope, params.slope_blend, slope);
+				weight[BIOME_SNOW] = remaining * smoothStep(params.snow_line, params.height_blend, t) * (1.f - steep);
+				remaining -= weight[BIOME_SNOW];
+
+				float high = smoothStep(params.earth_line, params.height_blend, t) * (1.f - 0.5f * wet);
+				weight[BIOME_EARTH] = remaining * (steep > high ? steep : high);
+				weight[BIOME_GRASS] = remaining - weight[BIOME_EARTH];
+
+				/* Round the running total to bytes, so that the weights
+				   always add up to exactly 255 */
+				unsigned char* out = splat + i * BIOME_MATERIALS;
+				float sum = 0.f;
+				int rounded = 0;
+				for (int m = 0; m < BIOME_MATERIALS; m++)
+				{
+					sum += weight[m];
+					int next = m == BIOME_MATERIALS - 1 ? 255 : (int)(sum * 255.f + 0.5f);
+					next = next > 255 ? 255 : next;
+					out[m] = (unsigned char)(next - rounded);
+					rounded = next;
+				}
+			}
+		}
+	});
+
+	totals.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	if (stats) *stats = totals;
+}
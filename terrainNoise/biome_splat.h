@@ -0,0 +1,60 @@
+/* biome_splat.h
+   Classifies every point of a terrain into a blend of materials, packed
+   into four bytes per point for the vertex shader.
+
+   The weights come from the height of a point above the sea relative to
+   the highest point, its slope from the normals, a moisture noise field
+   and, if given, the flow accumulation, which makes valleys and river
+   beds wetter. They are worked out once per terrain in parallel rows, so
+   the shader only has to blend the material colours by them, and rules
+   can be added here without costing frame time.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include "noiseutils.h"
+
+/* Materials, in the order of the bytes of each splat entry */
+enum biome_material
+{
+	BIOME_WATER = 0,
+	BIOME_GRASS,
+	BIOME_EARTH,
+	BIOME_SNOW,
+	BIOME_MATERIALS
+};
+
+struct biome_params
+{
+	biome_params();
+
+	float sea_level;		/* Points at or below this are water */
+	float earth_line;		/* Fraction of the highest point where grass gives way to earth */
+	float snow_line;		/* Fraction of the highest point where snow starts */
+	float height_blend;		/* Fraction of the highest point over which those lines blend */
+	float rock_slope;		/* Slope, as 1 - the up component of the normal, where rock shows */
+	float slope_blend;		/* Range of slopes over which rock blends in */
+	float river_flow;		/* Flow accumulation above which a point is a river */
+	float moisture_frequency;	/* Frequency of the moisture noise, per point */
+	int moisture_seed;
+};
+
+struct biome_stats
+{
+	unsigned long long points;
+	double seconds;
+	double pointsPerSecond() const;
+};
+
+class biome_splat
+{
+public:
+	/* Classify a grid of rows * columns heights stored row by row. normal_up
+	   holds the up component of each normal, normal_stride floats apart.
+	   accumulation may be NULL. Writes BIOME_MATERIALS weights per point to
+	   splat, each from 0 to 255 and adding up to 255. */
+	static void run(const float* heights, const float* normal_up, size_t normal_stride,
+		const noise::utils::NoiseMap* accumulation, int columns, int rows,
+		const biome_params& params, unsigned char* splat, biome_stats* stats = NULL);
+};
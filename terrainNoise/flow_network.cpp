@@ -0,0 +1,249 @@
+/* flow_network.cpp
+   Drainage of a height map: depression filling, D8 flow directions, flow
+   accumulation and river masks.
+*/
+
+#include "flow_network.h"
+#include "job_system.h"
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+
+/* Rows handled by one job on the worker pool */
+const int FLOW_BAND_ROWS = 32;
+
+/* Points of a flow accumulation front handled by one job */
+const int FLOW_FRONT_GRAIN = 4096;
+
+const int flow_network::direction_x[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int flow_network::direction_y[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+/* Direction from a neighbour back to the point, for each direction */
+static const signed char OPPOSITE[8] = { 4, 5, 6, 7, 0, 1, 2, 3 };
+
+flow_network::flow_network()
+{
+}
+
+void flow_network::build(const noise::utils::NoiseMap& heights, bool use_sea, float sealevel)
+{
+	int width = heights.GetWidth();
+	int height = heights.GetHeight();
+	if (width <= 0 || height <= 0) return;
+
+	filled.SetSize(width, height);
+	direction.SetSize(width, height);
+	accumulation.SetSize(width, height);
+
+	std::vector<signed char> flood_parent((size_t)width * height);
+	fillDepressions(heights, use_sea, sealevel, flood_parent);
+
+	std::vector<int> receivers((size_t)width * height);
+	findDirections(flood_parent, receivers);
+	accumulate(receivers);
+}
+
+noise::utils::NoiseMap& flow_network::restoreAccumulation(int width, int height)
+{
+	filled.SetSize(0, 0);
+	direction.SetSize(0, 0);
+	accumulation.SetSize(width, height);
+	return accumulation;
+}
+
+/* Priority flood from the outlets. Each point is filled up to the level of
+   the lowest path to an outlet, and remembers which neighbour the flood
+   reached it from. */
+void flow_network::fillDepressions(const noise::utils::NoiseMap& heights, bool use_sea, float sealevel,
+	std::vector<signed char>& flood_parent)
+{
+	int width = heights.GetWidth();
+	int height = heights.GetHeight();
+
+	float hmin = *heights.GetConstSlabPtr(0, 0);
+	float hmax = hmin;
+	for (int y = 0; y < height; y++)
+	{
+		const float* row = heights.GetConstSlabPtr(y);
+		for (int x = 0; x < width; x++)
+		{
+			if (row[x] < hmin) hmin = row[x];
+			if (row[x] > hmax) hmax = row[x];
+		}
+	}
+	float bucket_scale = hmax > hmin ? (FLOW_QUEUE_BUCKETS - 1) / (hmax - hmin) : 0.f;
+
+	/* Filled heights never go below the point's own height or the level
+	   of the point that reached it, so the current bucket only moves up */
+	std::vector<std::vector<int> > buckets(FLOW_QUEUE_BUCKETS);
+	std::vector<unsigned char> queued((size_t)width * height, 0);
+	for (int y = 0; y < height; y++)
+	{
+		const float* row = heights.GetConstSlabPtr(y);
+		float* out = filled.GetSlabPtr(y);
+		for (int x = 0; x < width; x++)
+		{
+			out[x] = row[x];
+			bool edge = x == 0 || y == 0 || x == width - 1 || y == height - 1;
+			if (edge || (use_sea && row[x] <= sealevel))
+			{
+				size_t i = (size_t)y * width + x;
+				queued[i] = 1;
+				flood_parent[i] = FLOW_DIRECTION_OUTLET;
+				buckets[(int)((row[x] - hmin) * bucket_scale)].push_back((int)i);
+			}
+		}
+	}
+
+	for (int bucket = 0; bucket < FLOW_QUEUE_BUCKETS; bucket++)
+	{
+		std::vector<int>& queue = buckets[bucket];
+		while (!queue.empty())
+		{
+			int i = queue.back();
+			queue.pop_back();
+			int x = i % width;
+			int y = i / width;
+			float level = *filled.GetConstSlabPtr(x, y);
+
+			for (int d = 0; d < 8; d++)
+			{
+				int nx = x + direction_x[d];
+				int ny = y + direction_y[d];
+				if (nx < 0 || nx >= width || ny < 0 || ny >= height) continue;
+				size_t n = (size_t)ny * width + nx;
+				if (queued[n]) continue;
+				queued[n] = 1;
+				flood_parent[n] = OPPOSITE[d];
+
+				float* fn = filled.GetSlabPtr(nx, ny);
+				if (*fn < level) *fn = level;
+				int nb = (int)((*fn - hmin) * bucket_scale);
+				buckets[nb < bucket ? bucket : nb].push_back((int)n);
+			}
+		}
+		std::vector<int>().swap(queue);
+	}
+}
+
+/* D8: drain to the steepest lower neighbour of the filled surface, or
+   back along the flood on a flat */
+void flow_network::findDirections(const std::vector<signed char>& flood_parent, std::vector<int>& receivers)
+{
+	int width = filled.GetWidth();
+	int height = filled.GetHeight();
+	const float diagonal = 1.f / sqrtf(2.f);
+
+	job_system::instance().parallel_for(0, height, FLOW_BAND_ROWS, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			float* dir_row = direction.GetSlabPtr(y);
+			for (int x = 0; x < width; x++)
+			{
+				size_t i = (size_t)y * width + x;
+				int best = flood_parent[i];
+				if (best != FLOW_DIRECTION_OUTLET)
+				{
+					float h = *filled.GetConstSlabPtr(x, y);
+					float steepest = 0.f;
+					for (int d = 0; d < 8; d++)
+					{
+						int nx = x + direction_x[d];
+						int ny = y + direction_y[d];
+						if (nx < 0 || nx >= width || ny < 0 || ny >= height) continue;
+						float drop = h - *filled.GetConstSlabPtr(nx, ny);
+						if (d & 1) drop *= diagonal;
+						if (drop > steepest)
+						{
+							steepest = drop;
+							best = d;
+						}
+					}
+				}
+
+				dir_row[x] = float(best);
+				receivers[i] = best == FLOW_DIRECTION_OUTLET ? -1
+					: (int)((y + direction_y[best]) * width + x + direction_x[best]);
+			}
+		}
+	});
+}
+
+/* Count the points draining through each point, a front at a time. A point
+   joins the front once everything draining into it has been counted. */
+void flow_network::accumulate(const std::vector<int>& receivers)
+{
+	int width = filled.GetWidth();
+	int height = filled.GetHeight();
+	int count = width * height;
+
+	std::vector<std::atomic<unsigned int> > donors(count);
+	std::vector<std::atomic<unsigned int> > totals(count);
+	for (int i = 0; i < count; i++)
+	{
+		donors[i].store(0, std::memory_order_relaxed);
+		totals[i].store(1, std::memory_order_relaxed);
+	}
+	for (int i = 0; i < count; i++)
+	{
+		if (receivers[i] >= 0) donors[receivers[i]].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::vector<int> front;
+	for (int i = 0; i < count; i++)
+	{
+		if (donors[i].load(std::memory_order_relaxed) == 0) front.push_back(i);
+	}
+
+	/* Each point of a front drains into at most one point, so the next front
+	   is never larger. Chunks append the points they make ready through a
+	   shared cursor; the totals are sums, so their order does not matter. */
+	std::vector<int> next(front.size());
+	while (!front.empty())
+	{
+		std::atomic<int> next_size(0);
+		job_system::instance().parallel_for(0, (int)front.size(), FLOW_FRONT_GRAIN, [&](int begin, int end)
+		{
+			std::vector<int> ready;
+			for (int f = begin; f < end; f++)
+			{
+				int r = receivers[front[f]];
+				if (r < 0) continue;
+				totals[r].fetch_add(totals[front[f]].load(std::memory_order_relaxed), std::memory_order_relaxed);
+				if (donors[r].fetch_sub(1, std::memory_order_acq_rel) == 1) ready.push_back(r);
+			}
+			if (ready.empty()) return;
+
+			int first = next_size.fetch_add((int)ready.size(), std::memory_order_relaxed);
+			std::copy(ready.begin(), ready.end(), next.begin() + first);
+		});
+
+		front.assign(next.begin(), next.begin() + next_size.load());
+	}
+
+	for (int y = 0; y < height; y++)
+	{
+		float* row = accumulation.GetSlabPtr(y);
+		for (int x = 0; x < width; x++)
+		{
+			row[x] = float(totals[(size_t)y * width + x].load(std::memory_order_relaxed));
+		}
+	}
+}
+
+void flow_network::getRiverMask(float threshold, noise::utils::NoiseMap& mask) const
+{
+	int width = accumulation.GetWidth();
+	int height = accumulation.GetHeight();
+	mask.SetSize(width, height);
+	for (int y = 0; y < height; y++)
+	{
+		const float* src = accumulation.GetConstSlabPtr(y);
+		float* dest = mask.GetSlabPtr(y);
+		for (int x = 0; x < width; x++)
+		{
+			dest[x] = src[x] >= threshold ? 1.f : 0.f;
+		}
+	}
+}
@@ -0,0 +1,70 @@
+/* flow_network.h
+   Drainage of a height map: depression filling, D8 flow directions, flow
+   accumulation and river masks.
+
+   Depressions are filled with a priority flood from the outlets, which
+   are the edges of the map and, optionally, everything at or below sea
+   level. The flood takes points in order of height from a bucketed queue:
+   the height range is split into FLOW_QUEUE_BUCKETS buckets, so points
+   are pushed and popped in constant time, and filled heights are at most
+   one bucket width above the exact fill.
+
+   Each point then drains to its steepest lower neighbour on the filled
+   surface. Points on a flat drain to the neighbour the flood reached them
+   from, which always leads to an outlet.
+
+   Flow accumulation counts the points that drain through each point,
+   including itself. It is worked out in parallel a front at a time,
+   starting from the points with nothing draining into them, so the
+   counts do not depend on the number of threads.
+
+   All of the outputs are NoiseMaps the same size as the heights, so they
+   can be written out or uploaded like any other map.
+*/
+
+#pragma once
+
+#include "noiseutils.h"
+#include <vector>
+
+#define FLOW_QUEUE_BUCKETS 65536
+
+/* Flow direction values. Directions 0 to 7 go anticlockwise from +x. */
+#define FLOW_DIRECTION_OUTLET -1
+
+class flow_network
+{
+public:
+	flow_network();
+
+	/* Fill, direct and accumulate the flow over a height map. Points at or
+	   below sealevel are outlets if use_sea is set. */
+	void build(const noise::utils::NoiseMap& heights, bool use_sea = false, float sealevel = 0.f);
+
+	/* Clear the network and return an accumulation of width by height for
+	   the caller to fill, such as from saved terrain, in place of building
+	   it. The filled heights and directions are left empty. */
+	noise::utils::NoiseMap& restoreAccumulation(int width, int height);
+
+	/* Set mask to 1 where at least threshold points drain through a point
+	   and 0 elsewhere */
+	void getRiverMask(float threshold, noise::utils::NoiseMap& mask) const;
+
+	const noise::utils::NoiseMap& getFilled() const { return filled; }
+	const noise::utils::NoiseMap& getDirection() const { return direction; }
+	const noise::utils::NoiseMap& getAccumulation() const { return accumulation; }
+
+	/* Offsets of the eight flow directions */
+	static const int direction_x[8];
+	static const int direction_y[8];
+
+private:
+	void fillDepressions(const noise::utils::NoiseMap& heights, bool use_sea, float sealevel,
+		std::vector<signed char>& flood_parent);
+	void findDirections(const std::vector<signed char>& flood_parent, std::vector<int>& receivers);
+	void accumulate(const std::vector<int>& receivers);
+
+	noise::utils::NoiseMap filled;
+	noise::utils::NoiseMap direction;
+	noise::utils::NoiseMap accumulation;
+};
@@ -0,0 +1,466 @@
+/* grid_indices.cpp
+   Index lists of regular grids, built once per size and shared.
+*/
+
+#include "grid_indices.h"
+#include "profiler.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+/* Every cached index list, and the lookups that found one or built one */
+static std::mutex cache_mutex;
+static std::map<grid_indices_key, std::shared_ptr<grid_indices> > cache;
+static unsigned long long cache_hits = 0;
+static unsigned long long cache_misses = 0;
+
+bool grid_indices_key::operator<(const grid_indices_key& other) const
+{
+	if (xsize != other.xsize) return xsize < other.xsize;
+	if (zsize != other.zsize) return zsize < other.zsize;
+	if (topology != other.topology) return topology < other.topology;
+	return lod < other.lod;
+}
+
+/* The rows or columns used at a level of detail: every step th one and
+   always the last */
+static std::vector<unsigned int> gridLines(unsigned int size, unsigned int step)
+{
+	std::vector<unsigned int> lines;
+	for (unsigned int i = 0; i < size; i += step) lines.push_back(i);
+	if (size > 0 && lines.back() != size - 1) lines.push_back(size - 1);
+	return lines;
+}
+
+std::shared_ptr<grid_indices> grid_index_cache::get(unsigned int xsize, unsigned int zsize,
+	grid_topology topology, unsigned int lod)
+{
+	grid_indices_key key;
+	key.xsize = xsize;
+	key.zsize = zsize;
+	key.topology = topology;
+	key.lod = lod;
+
+	/* Held while building, so that two terrains of a new size do not both
+	   build it */
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	std::shared_ptr<grid_indices>& entry = cache[key];
+	if (entry)
+	{
+		cache_hits++;
+		return entry;
+	}
+
+	cache_misses++;
+	std::shared_ptr<grid_indices> grid = std::make_shared<grid_indices>();
+	grid->key = key;
+	grid->triangle_count = 0;
+	grid->buffer = 0;
+	build(*grid);
+	entry = grid;
+	return entry;
+}
+
+unsigned long long grid_index_cache::getHits()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	return cache_hits;
+}
+
+unsigned long long grid_index_cache::getMisses()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	return cache_misses;
+}
+
+/* The rows and columns of a grid at its level of detail */
+struct grid_lines
+{
+	std::vector<unsigned int> rows;
+	std::vector<unsigned int> columns;
+	unsigned int zsize;
+
+	unsigned int quadRows() const { return rows.size() > 1 ? (unsigned int)rows.size() - 1 : 0; }
+	unsigned int quadColumns() const { return columns.size() > 1 ? (unsigned int)columns.size() - 1 : 0; }
+};
+
+/* Each strip joins two neighbouring rows of x, zig-zagging along z */
+static void buildStrips(const grid_lines& lines, bool restart, grid_indices& grid)
+{
+	grid.strip_count = lines.quadRows();
+	grid.strip_length = 2 * (unsigned int)lines.columns.size();
+
+	size_t restarts = (restart && grid.strip_count > 0) ? grid.strip_count - 1 : 0;
+	grid.indices.reserve((size_t)grid.strip_count * grid.strip_length + restarts);
+	for (unsigned int r = 0; r < grid.strip_count; r++)
+	{
+		if (restart && r > 0) grid.indices.push_back(GRID_RESTART_INDEX);
+
+		unsigned int top = lines.rows[r] * lines.zsize;
+		unsigned int bottom = lines.rows[r + 1] * lines.zsize;
+		for (size_t c = 0; c < lines.columns.size(); c++)
+		{
+			grid.indices.push_back(top + lines.columns[c]);
+			grid.indices.push_back(bottom + lines.columns[c]);
+		}
+	}
+}
+
+/* The two triangles of a quad, wound the same way as the strips */
+static void addQuad(const grid_lines& lines, unsigned int row, unsigned int column,
+	std::vector<unsigned int>& indices)
+{
+	unsigned int top = lines.rows[row] * lines.zsize;
+	unsigned int bottom = lines.rows[row + 1] * lines.zsize;
+	unsigned int left = lines.columns[column];
+	unsigned int right = lines.columns[column + 1];
+
+	indices.push_back(top + left);
+	indices.push_back(bottom + left);
+	indices.push_back(top + right);
+	indices.push_back(top + right);
+	indices.push_back(bottom + left);
+	indices.push_back(bottom + right);
+}
+
+static void buildRowList(const grid_lines& lines, std::vector<unsigned int>& indices)
+{
+	for (unsigned int r = 0; r < lines.quadRows(); r++)
+	{
+		for (unsigned int c = 0; c < lines.quadColumns(); c++) addQuad(lines, r, c, indices);
+	}
+}
+
+static void buildTiledList(const grid_lines& lines, std::vector<unsigned int>& indices)
+{
+	unsigned int quad_rows = lines.quadRows();
+	unsigned int quad_columns = lines.quadColumns();
+	for (unsigned int r0 = 0; r0 < quad_rows; r0 += GRID_TILE_SIZE)
+	{
+		unsigned int r1 = std::min(r0 + GRID_TILE_SIZE, quad_rows);
+		for (unsigned int c0 = 0; c0 < quad_columns; c0 += GRID_TILE_SIZE)
+		{
+			unsigned int c1 = std::min(c0 + GRID_TILE_SIZE, quad_columns);
+			for (unsigned int r = r0; r < r1; r++)
+			{
+				for (unsigned int c = c0; c < c1; c++) addQuad(lines, r, c, indices);
+			}
+		}
+	}
+}
+
+static int sign(int v)
+{
+	return (v > 0) - (v < 0);
+}
+
+/* v / 2 rounded down, also for negative v */
+static int halfDown(int v)
+{
+	return v >= 0 ? v / 2 : -((1 - v) / 2);
+}
+
+/* Visit every quad of the rectangle from (row, column) along (ar, ac),
+   whose length is its width, and (br, bc), its height, in the order of a
+   Hilbert curve generalised to any width and height (Jakub Cerveny's
+   gilbert). Neighbouring quads in the order share an edge, except for at
+   most one diagonal step when the sides are odd. */
+static void hilbertQuads(const grid_lines& lines, int row, int column, int ar, int ac,
+	int br, int bc, std::vector<unsigned int>& indices)
+{
+	int width = abs(ar + ac);
+	int height = abs(br + bc);
+	int dar = sign(ar), dac = sign(ac);
+	int dbr = sign(br), dbc = sign(bc);
+
+	if (height == 1 || width == 1)
+	{
+		int length = (height == 1) ? width : height;
+		int dr = (height == 1) ? dar : dbr;
+		int dc = (height == 1) ? dac : dbc;
+		for (int i = 0; i < length; i++, row += dr, column += dc)
+		{
+			addQuad(lines, row, column, indices);
+		}
+		return;
+	}
+
+	int ar2 = halfDown(ar), ac2 = halfDown(ac);
+	int br2 = halfDown(br), bc2 = halfDown(bc);
+	int width2 = abs(ar2 + ac2);
+	int height2 = abs(br2 + bc2);
+
+	if (2 * width > 3 * height)
+	{
+		/* Long and thin, so split the width in two */
+		if ((width2 % 2) && width > 2)
+		{
+			ar2 += dar;
+			ac2 += dac;
+		}
+		hilbertQuads(lines, row, column, ar2, ac2, br, bc, indices);
+		hilbertQuads(lines, row + ar2, column + ac2, ar - ar2, ac - ac2, br, bc, indices);
+	}
+	else
+	{
+		/* Split into up, across and down */
+		if ((height2 % 2) && height > 2)
+		{
+			br2 += dbr;
+			bc2 += dbc;
+		}
+		hilbertQuads(lines, row, column, br2, bc2, ar2, ac2, indices);
+		hilbertQuads(lines, row + br2, column + bc2, ar, ac, br - br2, bc - bc2, indices);
+		hilbertQuads(lines, row + (ar - dar) + (br2 - dbr), column + (ac - dac) + (bc2 - dbc),
+			-br2, -bc2, -(ar - ar2), -(ac - ac2), indices);
+	}
+}
+
+static void buildHilbertList(const grid_lines& lines, std::vector<unsigned int>& indices)
+{
+	int quad_rows = (int)lines.quadRows();
+	int quad_columns = (int)lines.quadColumns();
+	if (quad_rows == 0 || quad_columns == 0) return;
+
+	/* Run the curve along the longer side */
+	if (quad_columns >= quad_rows) hilbertQuads(lines, 0, 0, 0, quad_columns, quad_rows, 0, indices);
+	else hilbertQuads(lines, 0, 0, quad_rows, 0, 0, quad_columns, indices);
+}
+
+/* Scores of Tom Forsyth's "Linear-Speed Vertex Cache Optimisation". A
+   vertex scores for being near the front of a least recently used cache,
+   less so in the last three places, which the triangle just drawn holds,
+   and for having few triangles left, so that none are stranded. */
+const float FORSYTH_CACHE_DECAY = 1.5f;
+const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+const float FORSYTH_VALENCE_SCALE = 2.0f;
+const float FORSYTH_VALENCE_POWER = 0.5f;
+
+/* Valences up to this are scored from a table */
+const unsigned int FORSYTH_MAX_VALENCE = 32;
+
+struct forsyth_tables
+{
+	float cache[GRID_CACHE_SIZE];
+	float valence[FORSYTH_MAX_VALENCE + 1];
+
+	forsyth_tables()
+	{
+		for (unsigned int i = 0; i < GRID_CACHE_SIZE; i++)
+		{
+			if (i < 3) cache[i] = FORSYTH_LAST_TRIANGLE_SCORE;
+			else cache[i] = powf(1.0f - float(i - 3) / float(GRID_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY);
+		}
+		valence[0] = 0.0f;
+		for (unsigned int v = 1; v <= FORSYTH_MAX_VALENCE; v++)
+		{
+			valence[v] = FORSYTH_VALENCE_SCALE * powf((float)v, -FORSYTH_VALENCE_POWER);
+		}
+	}
+
+	float score(int cache_position, unsigned int remaining) const
+	{
+		if (remaining == 0) return -1.0f;
+
+		float s = (cache_position >= 0) ? cache[cache_position] : 0.0f;
+		if (remaining <= FORSYTH_MAX_VALENCE) return s + valence[remaining];
+		return s + FORSYTH_VALENCE_SCALE * powf((float)remaining, -FORSYTH_VALENCE_POWER);
+	}
+};
+
+/* Reorder the triangles of a list, keeping each triangle's winding. Each
+   step draws the best scoring triangle of the vertices in the cache, so
+   it only looks at a few triangles per step. */
+static void forsythOrder(std::vector<unsigned int>& indices, unsigned int vertex_count)
+{
+	size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0) return;
+
+	/* The triangles of each vertex not yet drawn are the first remaining[v]
+	   of its run of the adjacency list */
+	std::vector<unsigned int> remaining(vertex_count, 0);
+	for (size_t i = 0; i < indices.size(); i++) remaining[indices[i]]++;
+	std::vector<size_t> first(vertex_count + 1, 0);
+	for (unsigned int v = 0; v < vertex_count; v++) first[v + 1] = first[v] + remaining[v];
+	std::vector<unsigned int> adjacency(indices.size());
+	{
+		std::vector<size_t> fill(first.begin(), first.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	forsyth_tables tables;
+	std::vector<int> cache_position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count);
+	for (unsigned int v = 0; v < vertex_count; v++) vertex_score[v] = tables.score(-1, remaining[v]);
+
+	std::vector<char> drawn(triangle_count, 0);
+
+	std::vector<unsigned int> ordered;
+	ordered.reserve(indices.size());
+	std::vector<unsigned int> cache, next_cache;
+	cache.reserve(GRID_CACHE_SIZE + 3);
+	next_cache.reserve(GRID_CACHE_SIZE + 3);
+
+	size_t best = 0;
+	size_t next_undrawn = 0;
+	for (size_t n = 0; n < triangle_count; n++)
+	{
+		drawn[best] = 1;
+		const unsigned int* triangle = &indices[3*best];
+		ordered.insert(ordered.end(), triangle, triangle + 3);
+
+		/* Take the triangle out of its vertices' lists and put them at the
+		   front of the cache */
+		next_cache.assign(triangle, triangle + 3);
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = triangle[k];
+			unsigned int* list = &adjacency[first[v]];
+			for (unsigned int j = 0; j < remaining[v]; j++)
+			{
+				if (list[j] == best)
+				{
+					list[j] = list[remaining[v] - 1];
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			unsigned int v = cache[i];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) next_cache.push_back(v);
+		}
+
+		/* Rescore the vertices that moved, including those pushed out,
+		   then the triangles they are part of, finding the best */
+		for (size_t i = 0; i < next_cache.size(); i++)
+		{
+			unsigned int v = next_cache[i];
+			cache_position[v] = (i < GRID_CACHE_SIZE) ? (int)i : -1;
+			vertex_score[v] = tables.score(cache_position[v], remaining[v]);
+		}
+
+		float best_score = -1.0f;
+		bool found = false;
+		for (size_t i = 0; i < next_cache.size(); i++)
+		{
+			unsigned int v = next_cache[i];
+			const unsigned int* list = &adjacency[first[v]];
+			for (unsigned int j = 0; j < remaining[v]; j++)
+			{
+				unsigned int t = list[j];
+				float score = vertex_score[indices[3*t]] + vertex_score[indices[3*t + 1]]
+					+ vertex_score[indices[3*t + 2]];
+				if (score > best_score)
+				{
+					best_score = score;
+					best = t;
+					found = true;
+				}
+			}
+		}
+
+		if (next_cache.size() > GRID_CACHE_SIZE) next_cache.resize(GRID_CACHE_SIZE);
+		cache.swap(next_cache);
+
+		/* Nothing in the cache has a triangle left, so start again from
+		   the first triangle not yet drawn */
+		if (!found)
+		{
+			while (next_undrawn < triangle_count && drawn[next_undrawn]) next_undrawn++;
+			best = next_undrawn;
+		}
+	}
+	indices.swap(ordered);
+}
+
+void grid_index_cache::build(grid_indices& grid)
+{
+	PROFILE_SCOPE_NAMED(scope, "grid_index_cache::build");
+	const grid_indices_key& key = grid.key;
+	unsigned int step = 1u << key.lod;
+	grid_lines lines;
+	lines.rows = gridLines(key.xsize, step);
+	lines.columns = gridLines(key.zsize, step);
+	lines.zsize = key.zsize;
+
+	grid.indices.clear();
+	grid.strip_count = 0;
+	grid.strip_length = 0;
+	grid.triangle_count = 2ULL * lines.quadRows() * lines.quadColumns();
+	scope.setCount(grid.triangle_count, "triangles");
+
+	if (key.topology == GRID_STRIPS || key.topology == GRID_STRIP_RESTART)
+	{
+		buildStrips(lines, key.topology == GRID_STRIP_RESTART, grid);
+		return;
+	}
+
+	grid.indices.reserve(3 * grid.triangle_count);
+	switch (key.topology)
+	{
+	case GRID_TILED_LIST:
+		buildTiledList(lines, grid.indices);
+		break;
+	case GRID_HILBERT_LIST:
+		buildHilbertList(lines, grid.indices);
+		break;
+	default:
+		buildRowList(lines, grid.indices);
+		forsythOrder(grid.indices, key.xsize * key.zsize);
+		break;
+	}
+}
+
+/* A vertex is in the cache if fewer than cache_size vertices have been
+   transformed since it was */
+grid_cache_stats grid_index_cache::simulateCache(const grid_indices& grid, unsigned int cache_size)
+{
+	grid_cache_stats stats;
+	stats.triangles = grid.triangle_count;
+	stats.vertices = 0;
+	stats.transforms = 0;
+
+	/* When each vertex was last transformed, counting from 1, or 0 if never */
+	std::vector<unsigned long long> transformed((size_t)grid.key.xsize * grid.key.zsize, 0);
+	for (size_t i = 0; i < grid.indices.size(); i++)
+	{
+		unsigned int v = grid.indices[i];
+		if (v == GRID_RESTART_INDEX) continue;
+
+		unsigned long long& when = transformed[v];
+		if (when == 0) stats.vertices++;
+		if (when == 0 || stats.transforms - when >= cache_size) when = ++stats.transforms;
+	}
+
+	stats.acmr = stats.triangles ? double(stats.transforms) / double(stats.triangles) : 0.0;
+	stats.atvr = stats.vertices ? double(stats.transforms) / double(stats.vertices) : 0.0;
+	return stats;
+}
+
+static const char* topology_names[GRID_TOPOLOGIES] =
+{
+	"strips", "restart", "tiled", "hilbert", "forsyth"
+};
+
+const char* grid_index_cache::topologyName(grid_topology topology)
+{
+	return (topology >= 0 && topology < GRID_TOPOLOGIES) ? topology_names[topology] : "unknown";
+}
+
+bool grid_index_cache::topologyFromName(const char* name, grid_topology& topology)
+{
+	for (int t = 0; t < GRID_TOPOLOGIES; t++)
+	{
+		if (!strcmp(name, topology_names[t]))
+		{
+			topology = (grid_topology)t;
+			return true;
+		}
+	}
+	return false;
+}
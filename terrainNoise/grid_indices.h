@@ -0,0 +1,121 @@
+/* grid_indices.h
+   The indices that draw a regular grid of vertices depend only on the
+   size of the grid and how it is drawn, so they are built once per size
+   and shared by every terrain of that size, on the CPU and in one GL
+   buffer, instead of being rebuilt and uploaded by each regeneration.
+
+   Vertices are numbered x * zsize + z, as in terrain_mesh. A level of
+   detail above zero uses every 2^lod th row and column, plus the last row
+   and column so that the whole terrain is still covered.
+
+   A strip along z reuses the vertices of its previous row only after a
+   whole row, so once a row is longer than the GPU's post-transform vertex
+   cache nearly every vertex is transformed twice. The triangle lists visit
+   the quads in orders that come back to a vertex while it is still in the
+   cache. simulateCache measures how well an order does, without a GPU, as
+   the average cache miss ratio (ACMR, vertices transformed per triangle,
+   at best about 0.5 on a large grid) and the average transform to vertex
+   ratio (ATVR, vertices transformed per vertex, at best 1).
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+enum grid_topology
+{
+	/* One triangle strip per row, drawn as separate strips of equal length */
+	GRID_STRIPS,
+	/* The same strips in one index list with GRID_RESTART_INDEX between
+	   them, drawn at once with primitive restart */
+	GRID_STRIP_RESTART,
+	/* Triangles two per quad, a tile of GRID_TILE_SIZE x GRID_TILE_SIZE
+	   quads at a time, each tile row by row */
+	GRID_TILED_LIST,
+	/* Triangles two per quad, with the quads in the order of a Hilbert
+	   curve, which suits any cache size */
+	GRID_HILBERT_LIST,
+	/* The triangles of the quads row by row, reordered by Tom Forsyth's
+	   linear-speed vertex cache optimisation */
+	GRID_FORSYTH_LIST,
+	GRID_TOPOLOGIES
+};
+
+const unsigned int GRID_RESTART_INDEX = 0xFFFFFFFF;
+
+/* Entries in the cache that simulateCache, the Forsyth order and the
+   tiles assume, a typical size for a desktop GPU */
+const unsigned int GRID_CACHE_SIZE = 32;
+
+/* Quads a side of the tiles of GRID_TILED_LIST. Drawing a tile row uses
+   its own GRID_TILE_SIZE + 1 vertices and those of the row before, so the
+   largest tile whose two rows fit in the cache is best. */
+const unsigned int GRID_TILE_SIZE = GRID_CACHE_SIZE / 2 - 1;
+
+struct grid_indices_key
+{
+	unsigned int xsize;
+	unsigned int zsize;
+	grid_topology topology;
+	unsigned int lod;
+
+	bool operator<(const grid_indices_key& other) const;
+};
+
+/* One cached index list. The indices must not be changed once built. */
+struct grid_indices
+{
+	grid_indices_key key;
+	std::vector<unsigned int> indices;
+
+	/* Number of strips and indices in each strip, not counting restarts.
+	   Both are 0 for the triangle lists. */
+	unsigned int strip_count;
+	unsigned int strip_length;
+
+	/* Number of triangles drawn */
+	unsigned long long triangle_count;
+
+	/* GL buffer holding the indices, made by the first terrain to draw
+	   them, or 0 until then. It is kept for as long as the entry. */
+	unsigned int buffer;
+};
+
+/* Result of drawing an index list through a simulated vertex cache */
+struct grid_cache_stats
+{
+	unsigned long long triangles;
+	unsigned long long vertices;
+	unsigned long long transforms;
+	double acmr;
+	double atvr;
+};
+
+class grid_index_cache
+{
+public:
+	/* The indices of a grid, built on first use. Safe to call from several
+	   threads at once. Entries are kept until the program ends, since the
+	   next terrain of the same size will want them again. */
+	static std::shared_ptr<grid_indices> get(unsigned int xsize, unsigned int zsize,
+		grid_topology topology, unsigned int lod = 0);
+
+	/* Number of calls to get that found their indices already built */
+	static unsigned long long getHits();
+	static unsigned long long getMisses();
+
+	/* Build the indices of grid.key into grid without caching them */
+	static void build(grid_indices& grid);
+
+	/* Draw the indices through a first-in first-out cache of cache_size
+	   vertices, as most GPUs' post-transform caches behave, and count the
+	   vertices that had to be transformed */
+	static grid_cache_stats simulateCache(const grid_indices& grid,
+		unsigned int cache_size = GRID_CACHE_SIZE);
+
+	/* Short name of a topology, such as "hilbert", and back.
+	   topologyFromName returns false if the name is not a topology. */
+	static const char* topologyName(grid_topology topology);
+	static bool topologyFromName(const char* name, grid_topology& topology);
+};
@@ -0,0 +1,171 @@
+/* height_post.cpp
+   Post-processing of terrain heights held in a contiguous array.
+*/
+
+#include "height_post.h"
+#include "job_system.h"
+#include "profiler.h"
+#include <math.h>
+
+/* Heights handled by one job on the worker pool */
+const int HEIGHT_POST_GRAIN = 16384;
+
+/* Independent min/max accumulators in the reduction loop */
+const int HEIGHT_POST_LANES = 8;
+
+height_curve::height_curve()
+{
+	scale = 0.f;
+}
+
+height_curve::height_curve(const std::function<float(float)>& shape, int table_size)
+{
+	if (table_size < 2) table_size = 2;
+	table.resize(table_size);
+	scale = float(table_size - 1);
+	for (int i = 0; i < table_size; i++)
+	{
+		table[i] = shape(float(i) / scale);
+	}
+}
+
+height_curve height_curve::terrace(int steps, float sharpness)
+{
+	if (steps < 1) steps = 1;
+	float exponent = 1.f + 8.f * sharpness;
+	return height_curve([steps, exponent](float t)
+	{
+		/* Each step rises from flat ground to the next level */
+		float pos = t * float(steps);
+		float step = floorf(pos);
+		if (step >= float(steps)) return 1.f;
+		return (step + powf(pos - step, exponent)) / float(steps);
+	});
+}
+
+height_curve height_curve::power(float exponent)
+{
+	return height_curve([exponent](float t)
+	{
+		return powf(t, exponent);
+	});
+}
+
+height_curve height_curve::clamp(float lower, float upper)
+{
+	return height_curve([lower, upper](float t)
+	{
+		return t < lower ? lower : (t > upper ? upper : t);
+	});
+}
+
+void height_post::findRange(const float* heights, size_t count, float& min, float& max)
+{
+	min = max = count > 0 ? heights[0] : 0.f;
+	if (count == 0) return;
+
+	int chunks = int((count + HEIGHT_POST_GRAIN - 1) / HEIGHT_POST_GRAIN);
+	std::vector<float> chunk_min(chunks), chunk_max(chunks);
+	job_system::instance().parallel_for(0, chunks, 1, [&](int begin, int end)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			size_t first = size_t(c) * HEIGHT_POST_GRAIN;
+			size_t last = first + HEIGHT_POST_GRAIN < count ? first + HEIGHT_POST_GRAIN : count;
+
+			/* Separate lanes have no dependency between them, so the
+			   loop compiles to packed min and max instructions */
+			float lo[HEIGHT_POST_LANES], hi[HEIGHT_POST_LANES];
+			for (int k = 0; k < HEIGHT_POST_LANES; k++) lo[k] = hi[k] = heights[first];
+			size_t i = first;
+			for (; i + HEIGHT_POST_LANES <= last; i += HEIGHT_POST_LANES)
+			{
+				for (int k = 0; k < HEIGHT_POST_LANES; k++)
+				{
+					float h = heights[i + k];
+					lo[k] = h < lo[k] ? h : lo[k];
+					hi[k] = h > hi[k] ? h : hi[k];
+				}
+			}
+			for (; i < last; i++)
+			{
+				if (heights[i] < lo[0]) lo[0] = heights[i];
+				if (heights[i] > hi[0]) hi[0] = heights[i];
+			}
+
+			for (int k = 1; k < HEIGHT_POST_LANES; k++)
+			{
+				if (lo[k] < lo[0]) lo[0] = lo[k];
+				if (hi[k] > hi[0]) hi[0] = hi[k];
+			}
+			chunk_min[c] = lo[0];
+			chunk_max[c] = hi[0];
+		}
+	});
+
+	for (int c = 0; c < chunks; c++)
+	{
+		if (chunk_min[c] < min) min = chunk_min[c];
+		if (chunk_max[c] > max) max = chunk_max[c];
+	}
+}
+
+height_stretch height_post::makeStretch(float current_min, float current_max,
+	float min, float max, float sealevel)
+{
+	/* Calculate stretch factor */
+	height_stretch stretch;
+	stretch.factor = current_max > current_min ? (max - min) / (current_max - current_min) : 0.f;
+	stretch.diff = current_min - min;
+
+	/* The curve works on the position of each height within the stretched
+	   range */
+	stretch.lower = (current_min - stretch.diff) * stretch.factor;
+	stretch.range = (current_max - stretch.diff) * stretch.factor - stretch.lower;
+	stretch.current_min = current_min;
+	stretch.inv_range = current_max > current_min ? 1.f / (current_max - current_min) : 0.f;
+	stretch.sealevel = sealevel;
+	return stretch;
+}
+
+void height_post::applyStretch(float* heights, size_t count, const height_stretch& stretch,
+	const height_curve& curve)
+{
+	float sealevel = stretch.sealevel;
+	if (curve.isIdentity())
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			float h = (heights[i] - stretch.diff) * stretch.factor;
+			heights[i] = h < sealevel ? sealevel : h;
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			float h = stretch.lower + curve.apply((heights[i] - stretch.current_min) * stretch.inv_range) * stretch.range;
+			heights[i] = h < sealevel ? sealevel : h;
+		}
+	}
+}
+
+void height_post::stretchToRange(float* heights, size_t count, float min, float max,
+	float sealevel, const height_curve& curve)
+{
+	PROFILE_SCOPE_NAMED(scope, "height_post::stretchToRange");
+	scope.setCount(count, "points");
+	if (count == 0) return;
+
+	float cmin, cmax;
+	findRange(heights, count, cmin, cmax);
+	height_stretch stretch = makeStretch(cmin, cmax, min, max, sealevel);
+
+	int chunks = int((count + HEIGHT_POST_GRAIN - 1) / HEIGHT_POST_GRAIN);
+	job_system::instance().parallel_for(0, chunks, 1, [&](int begin, int end)
+	{
+		size_t first = size_t(begin) * HEIGHT_POST_GRAIN;
+		size_t last = size_t(end) * HEIGHT_POST_GRAIN < count ? size_t(end) * HEIGHT_POST_GRAIN : count;
+		applyStretch(heights + first, last - first, stretch, curve);
+	});
+}
@@ -0,0 +1,100 @@
+/* height_post.h
+   Post-processing of terrain heights held in a contiguous array.
+
+   The heights are stretched to a range, reshaped by an optional curve and
+   clamped to a sea level in one fused pass, after one reduction pass that
+   finds their range. Both passes are split across the shared job_system
+   and their inner loops keep several independent lanes so that the
+   compiler can vectorize them.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <functional>
+#include <vector>
+
+/* Number of samples in a height_curve table */
+#define HEIGHT_CURVE_TABLE_SIZE 1024
+
+/* A reshaping curve for heights, given as a function from the position of
+   a height within its range (0 for the lowest, 1 for the highest) to its
+   new position. The function is sampled once into a table, which is then
+   interpolated for every height. */
+class height_curve
+{
+public:
+	/* The identity curve, which leaves heights unchanged */
+	height_curve();
+
+	/* Sample any function of [0, 1] */
+	explicit height_curve(const std::function<float(float)>& shape,
+		int table_size = HEIGHT_CURVE_TABLE_SIZE);
+
+	/* Flat terraces with steps evenly spaced over the range. sharpness
+	   from 0 (no terraces) to 1 makes the terraces flatter and the
+	   rises between them steeper. */
+	static height_curve terrace(int steps, float sharpness);
+
+	/* Raise positions to a power; above 1 flattens the lowlands and
+	   sharpens the peaks */
+	static height_curve power(float exponent);
+
+	/* Limit positions to [lower, upper] */
+	static height_curve clamp(float lower, float upper);
+
+	bool isIdentity() const { return table.empty(); }
+	const std::vector<float>& getTable() const { return table; }
+
+	/* Look up the new position of t, which is clamped to [0, 1] */
+	float apply(float t) const
+	{
+		if (table.empty()) return t;
+		float pos = t * scale;
+		if (!(pos > 0.f)) return table[0];
+		if (pos >= scale) return table.back();
+		int i = (int)pos;
+		float f = pos - (float)i;
+		return table[i] + (table[i + 1] - table[i]) * f;
+	}
+
+private:
+	std::vector<float> table;
+	float scale;
+};
+
+/* The stretch from the range of a whole set of heights to a new range,
+   so that parts of the set can be stretched separately */
+struct height_stretch
+{
+	float factor;
+	float diff;
+	float lower;
+	float range;
+	float current_min;
+	float inv_range;
+	float sealevel;
+};
+
+class height_post
+{
+public:
+	/* Find the lowest and highest of count heights */
+	static void findRange(const float* heights, size_t count, float& min, float& max);
+
+	/* Work out the stretch of heights from current_min to current_max to
+	   the range min to max */
+	static height_stretch makeStretch(float current_min, float current_max,
+		float min, float max, float sealevel);
+
+	/* Stretch and reshape count heights, on the calling thread */
+	static void applyStretch(float* heights, size_t count, const height_stretch& stretch,
+		const height_curve& curve);
+
+	/* Stretch heights to the range min to max, reshape them with curve
+	   and raise anything below sealevel to sealevel. The stretch is the
+	   same as terrain_object has always used, so an identity curve gives
+	   the same heights as before. A flat terrain stays flat. */
+	static void stretchToRange(float* heights, size_t count, float min, float max,
+		float sealevel, const height_curve& curve);
+};
@@ -0,0 +1,547 @@
+/* heightfield_codec.cpp
+   A self-contained compressor for height values, used to archive baked
+   terrain and noise maps.
+*/
+
+#include "heightfield_codec.h"
+#include "job_system.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+/* Quotients at or above this are sent as an escape code and the raw
+   residual, bounding the length of any one code */
+#define RICE_ESCAPE 24
+
+/* Context statistics are halved after this many values so that the code
+   parameter follows changes in the terrain */
+#define CONTEXT_RESET 64
+
+/* Size of the archive header before the tile table, and of each entry */
+#define ARCHIVE_HEADER_SIZE 20
+#define ARCHIVE_ENTRY_SIZE 16
+
+codec_bit_writer::codec_bit_writer()
+{
+	acc = 0;
+	fill = 0;
+}
+
+/* Append the low count bits of bits, count <= 32 */
+void codec_bit_writer::put(unsigned int bits, int count)
+{
+	acc |= (unsigned long long)bits << fill;
+	fill += count;
+	while (fill >= 8)
+	{
+		bytes.push_back((unsigned char)acc);
+		acc >>= 8;
+		fill -= 8;
+	}
+}
+
+/* Pad the last partial byte with zeros */
+void codec_bit_writer::flush()
+{
+	if (fill > 0)
+	{
+		bytes.push_back((unsigned char)acc);
+		acc = 0;
+		fill = 0;
+	}
+}
+
+codec_bit_reader::codec_bit_reader(const unsigned char* data, size_t size)
+{
+	this->data = data;
+	this->size = size;
+	pos = 0;
+	acc = 0;
+	fill = 0;
+	overran = false;
+}
+
+void codec_bit_reader::refill()
+{
+	while (fill <= 56 && pos < size)
+	{
+		acc |= (unsigned long long)data[pos++] << fill;
+		fill += 8;
+	}
+}
+
+/* Read count bits, count <= 32. Reading past the end returns zeros and
+   sets the overrun flag. */
+unsigned int codec_bit_reader::get(int count)
+{
+	if (fill < count)
+	{
+		refill();
+		if (fill < count)
+		{
+			overran = true;
+			fill = count;
+		}
+	}
+	unsigned int bits = (unsigned int)(acc & ((1ULL << count) - 1));
+	acc >>= count;
+	fill -= count;
+	return bits;
+}
+
+/* Map float bits to an unsigned integer with the same ordering, so that
+   nearby heights have nearby integers */
+static inline unsigned int orderFloat(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+static inline float unorderFloat(unsigned int ordered)
+{
+	unsigned int bits = (ordered & 0x80000000u) ? ordered & 0x7fffffffu : ~ordered;
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static void resetContexts(codec_context* contexts)
+{
+	for (int i = 0; i < HEIGHTFIELD_CODEC_CONTEXTS; i++)
+	{
+		contexts[i].total = 16;
+		contexts[i].count = 1;
+	}
+}
+
+/* Median edge detector prediction of the value at x from its left (a),
+   upper (b) and upper left (c) neighbours, and the coding context chosen
+   by the local gradient. Missing neighbours are copied from the ones that
+   exist, so the first row predicts from the left and the first column from
+   above. */
+static inline long long predict(const std::vector<long long>& prev_row,
+	const std::vector<long long>& cur_row, unsigned int x, bool first_row, int& context)
+{
+	long long a, b, c;
+	if (first_row)
+	{
+		a = b = c = x > 0 ? cur_row[x - 1] : 0;
+	}
+	else
+	{
+		b = prev_row[x];
+		a = x > 0 ? cur_row[x - 1] : b;
+		c = x > 0 ? prev_row[x - 1] : b;
+	}
+
+	unsigned long long activity = (unsigned long long)(a > c ? a - c : c - a)
+		+ (unsigned long long)(b > c ? b - c : c - b);
+	context = 0;
+	while (activity != 0 && context < HEIGHTFIELD_CODEC_CONTEXTS - 1)
+	{
+		activity >>= 1;
+		context++;
+	}
+
+	long long lo = a < b ? a : b;
+	long long hi = a < b ? b : a;
+	if (c >= hi) return lo;
+	if (c <= lo) return hi;
+	return a + b - c;
+}
+
+/* Rice parameter for a context: the smallest k with count * 2^k >= total */
+static inline int riceParameter(const codec_context& ctx)
+{
+	int k = 0;
+	while (k < 31 && ((unsigned long long)ctx.count << k) < ctx.total) k++;
+	return k;
+}
+
+static inline void updateContext(codec_context& ctx, unsigned int residual)
+{
+	ctx.total += residual;
+	if (++ctx.count >= CONTEXT_RESET)
+	{
+		ctx.total >>= 1;
+		ctx.count >>= 1;
+	}
+}
+
+/* Residuals wrap to 32 bits and are folded so that small magnitudes of
+   either sign become small codes */
+static inline unsigned int zigzag(long long value, long long prediction)
+{
+	int residual = (int)(unsigned int)(value - prediction);
+	return ((unsigned int)residual << 1) ^ (unsigned int)(residual >> 31);
+}
+
+static inline unsigned int unzigzag(unsigned int code)
+{
+	return (code >> 1) ^ (0u - (code & 1));
+}
+
+heightfield_encoder::heightfield_encoder(unsigned int columns, float error_bound)
+{
+	this->columns = columns;
+	this->error_bound = error_bound > 0.f ? error_bound : 0.f;
+	prev_row.resize(columns);
+	cur_row.resize(columns);
+	rows_done = 0;
+	resetContexts(contexts);
+
+	unsigned int bound_bits;
+	memcpy(&bound_bits, &this->error_bound, sizeof(bound_bits));
+	for (int i = 0; i < 4; i++) writer.put((unsigned char)HEIGHTFIELD_CODEC_STREAM_MAGIC[i], 8);
+	writer.put(columns, 32);
+	writer.put(bound_bits, 32);
+}
+
+bool heightfield_encoder::encodeRow(const float* row)
+{
+	if (error_bound > 0.f)
+	{
+		/* Each step covers twice the bound, so rounding to the nearest step
+		   moves a value by at most the bound */
+		if (error_bound > FLT_MAX) return false;
+		double inv_step = 1.0 / (2.0 * error_bound);
+		for (unsigned int x = 0; x < columns; x++)
+		{
+			double q = floor(row[x] * inv_step + 0.5);
+			if (!(fabs(q) < 2147483647.0)) return false;
+			cur_row[x] = (long long)q;
+		}
+	}
+	else
+	{
+		for (unsigned int x = 0; x < columns; x++) cur_row[x] = orderFloat(row[x]);
+	}
+
+	for (unsigned int x = 0; x < columns; x++)
+	{
+		int context;
+		long long prediction = predict(prev_row, cur_row, x, rows_done == 0, context);
+		unsigned int code = zigzag(cur_row[x], prediction);
+
+		codec_context& ctx = contexts[context];
+		int k = riceParameter(ctx);
+		unsigned int quotient = code >> k;
+		if (quotient < RICE_ESCAPE)
+		{
+			writer.put((1u << quotient) - 1, quotient + 1);
+			if (k > 0) writer.put(code & (unsigned int)((1ULL << k) - 1), k);
+		}
+		else
+		{
+			writer.put((1u << RICE_ESCAPE) - 1, RICE_ESCAPE);
+			writer.put(code, 32);
+		}
+		updateContext(ctx, code);
+	}
+
+	prev_row.swap(cur_row);
+	rows_done++;
+	return true;
+}
+
+void heightfield_encoder::drainOutput(std::vector<unsigned char>& dest, bool final)
+{
+	if (final) writer.flush();
+	dest.insert(dest.end(), writer.bytes.begin(), writer.bytes.end());
+	writer.bytes.clear();
+}
+
+heightfield_decoder::heightfield_decoder() : reader(NULL, 0)
+{
+	columns = 0;
+	error_bound = 0.f;
+	rows_done = 0;
+}
+
+bool heightfield_decoder::begin(const unsigned char* data, size_t size)
+{
+	reader = codec_bit_reader(data, size);
+	columns = 0;
+	rows_done = 0;
+	resetContexts(contexts);
+
+	char magic[4];
+	for (int i = 0; i < 4; i++) magic[i] = (char)reader.get(8);
+	unsigned int stream_columns = reader.get(32);
+	unsigned int bound_bits = reader.get(32);
+	float bound;
+	memcpy(&bound, &bound_bits, sizeof(bound));
+
+	/* Every value takes at least one bit, which bounds the row size a
+	   damaged header can ask for */
+	if (reader.overrun()
+		|| memcmp(magic, HEIGHTFIELD_CODEC_STREAM_MAGIC, 4) != 0
+		|| stream_columns == 0 || stream_columns / 8 > size
+		|| !(bound >= 0.f && bound <= FLT_MAX))
+	{
+		return false;
+	}
+
+	columns = stream_columns;
+	error_bound = bound;
+	prev_row.assign(columns, 0);
+	cur_row.assign(columns, 0);
+	return true;
+}
+
+bool heightfield_decoder::decodeRow(float* row)
+{
+	if (columns == 0) return false;
+
+	for (unsigned int x = 0; x < columns; x++)
+	{
+		int context;
+		long long prediction = predict(prev_row, cur_row, x, rows_done == 0, context);
+
+		codec_context& ctx = contexts[context];
+		int k = riceParameter(ctx);
+		unsigned int quotient = 0;
+		while (quotient < RICE_ESCAPE && reader.get(1)) quotient++;
+		unsigned int code;
+		if (quotient < RICE_ESCAPE)
+		{
+			code = quotient << k;
+			if (k > 0) code |= reader.get(k);
+		}
+		else
+		{
+			code = reader.get(32);
+		}
+		if (reader.overrun()) return false;
+		updateContext(ctx, code);
+
+		unsigned int value = (unsigned int)prediction + unzigzag(code);
+		cur_row[x] = error_bound > 0.f ? (long long)(int)value : (long long)value;
+	}
+
+	if (error_bound > 0.f)
+	{
+		double step = 2.0 * error_bound;
+		for (unsigned int x = 0; x < columns; x++) row[x] = (float)(cur_row[x] * step);
+	}
+	else
+	{
+		for (unsigned int x = 0; x < columns; x++) row[x] = unorderFloat((unsigned int)cur_row[x]);
+	}
+
+	prev_row.swap(cur_row);
+	rows_done++;
+	return true;
+}
+
+bool heightfield_codec::encodeTile(const float* values, unsigned int columns, unsigned int rows,
+	size_t stride, float error_bound, std::vector<unsigned char>& out)
+{
+	out.clear();
+	if (columns == 0 || rows == 0) return false;
+
+	heightfield_encoder encoder(columns, error_bound);
+	for (unsigned int r = 0; r < rows; r++)
+	{
+		if (!encoder.encodeRow(values + (size_t)r * stride)) return false;
+	}
+	encoder.drainOutput(out, true);
+	return true;
+}
+
+bool heightfield_codec::decodeTile(const unsigned char* data, size_t size, float* values,
+	unsigned int columns, unsigned int rows, size_t stride)
+{
+	heightfield_decoder decoder;
+	if (!decoder.begin(data, size) || decoder.getColumns() != columns) return false;
+
+	for (unsigned int r = 0; r < rows; r++)
+	{
+		if (!decoder.decodeRow(values + (size_t)r * stride)) return false;
+	}
+	return true;
+}
+
+/* Archive layout, all little endian:
+
+     "HFZ1", columns, rows, tile_size, error bound   4 bytes each
+     offset, size                                     8 bytes each per tile,
+                                                      tiles in row order
+     tile streams
+*/
+
+static void put32(unsigned char* dest, unsigned int value)
+{
+	for (int i = 0; i < 4; i++) dest[i] = (unsigned char)(value >> (i * 8));
+}
+
+static void put64(unsigned char* dest, unsigned long long value)
+{
+	for (int i = 0; i < 8; i++) dest[i] = (unsigned char)(value >> (i * 8));
+}
+
+static unsigned int get32(const unsigned char* src)
+{
+	unsigned int value = 0;
+	for (int i = 0; i < 4; i++) value |= (unsigned int)src[i] << (i * 8);
+	return value;
+}
+
+static unsigned long long get64(const unsigned char* src)
+{
+	unsigned long long value = 0;
+	for (int i = 0; i < 8; i++) value |= (unsigned long long)src[i] << (i * 8);
+	return value;
+}
+
+bool heightfield_codec::encodeTiles(const float* values, unsigned int columns, unsigned int rows,
+	size_t stride, unsigned int tile_size, float error_bound,
+	std::vector<unsigned char>& out)
+{
+	out.clear();
+	if (columns == 0 || rows == 0 || tile_size == 0) return false;
+
+	unsigned int tiles_x = (columns + tile_size - 1) / tile_size;
+	unsigned int tiles_y = (rows + tile_size - 1) / tile_size;
+	int tile_count = (int)(tiles_x * tiles_y);
+
+	std::vector<std::vector<unsigned char> > streams(tile_count);
+	std::vector<char> encoded(tile_count, 0);
+	job_system::instance().parallel_for(0, tile_count, 1, [&](int begin, int end)
+	{
+		for (int t = begin; t < end; t++)
+		{
+			unsigned int col0 = (t % tiles_x) * tile_size;
+			unsigned int row0 = (t / tiles_x) * tile_size;
+			unsigned int tile_columns = (columns - col0 < tile_size) ? columns - col0 : tile_size;
+			unsigned int tile_rows = (rows - row0 < tile_size) ? rows - row0 : tile_size;
+			encoded[t] = encodeTile(values + (size_t)row0 * stride + col0,
+				tile_columns, tile_rows, stride, error_bound, streams[t]);
+		}
+	});
+
+	size_t total = ARCHIVE_HEADER_SIZE + (size_t)tile_count * ARCHIVE_ENTRY_SIZE;
+	for (int t = 0; t < tile_count; t++)
+	{
+		if (!encoded[t]) return false;
+		total += streams[t].size();
+	}
+
+	out.resize(total);
+	float bound = error_bound > 0.f ? error_bound : 0.f;
+	unsigned int bound_bits;
+	memcpy(&bound_bits, &bound, sizeof(bound_bits));
+	memcpy(&out[0], HEIGHTFIELD_CODEC_ARCHIVE_MAGIC, 4);
+	put32(&out[4], columns);
+	put32(&out[8], rows);
+	put32(&out[12], tile_size);
+	put32(&out[16], bound_bits);
+
+	size_t offset = ARCHIVE_HEADER_SIZE + (size_t)tile_count * ARCHIVE_ENTRY_SIZE;
+	for (int t = 0; t < tile_count; t++)
+	{
+		unsigned char* entry = &out[ARCHIVE_HEADER_SIZE + (size_t)t * ARCHIVE_ENTRY_SIZE];
+		put64(entry, offset);
+		put64(entry + 8, streams[t].size());
+		memcpy(&out[offset], &streams[t][0], streams[t].size());
+		offset += streams[t].size();
+	}
+	return true;
+}
+
+/* Check an archive header and tile table against the archive size */
+static bool readArchiveLayout(const unsigned char* data, size_t size,
+	unsigned int& columns, unsigned int& rows, unsigned int& tile_size)
+{
+	if (data == NULL || size < ARCHIVE_HEADER_SIZE
+		|| memcmp(data, HEIGHTFIELD_CODEC_ARCHIVE_MAGIC, 4) != 0)
+	{
+		return false;
+	}
+
+	columns = get32(data + 4);
+	rows = get32(data + 8);
+	tile_size = get32(data + 12);
+	if (columns == 0 || rows == 0 || tile_size == 0) return false;
+
+	/* Every value takes at least one bit */
+	if ((unsigned long long)columns * rows / 8 > size) return false;
+
+	unsigned long long tiles_x = (columns + (unsigned long long)tile_size - 1) / tile_size;
+	unsigned long long tiles_y = (rows + (unsigned long long)tile_size - 1) / tile_size;
+	unsigned long long tile_count = tiles_x * tiles_y;
+	if (tile_count > (size - ARCHIVE_HEADER_SIZE) / ARCHIVE_ENTRY_SIZE) return false;
+
+	for (unsigned long long t = 0; t < tile_count; t++)
+	{
+		const unsigned char* entry = data + ARCHIVE_HEADER_SIZE + t * ARCHIVE_ENTRY_SIZE;
+		unsigned long long offset = get64(entry);
+		unsigned long long length = get64(entry + 8);
+		if (offset > size || length > size - offset) return false;
+	}
+	return true;
+}
+
+/* Decode every tile of a checked archive in parallel */
+static bool decodeArchiveTiles(const unsigned char* data, unsigned int columns, unsigned int rows,
+	unsigned int tile_size, float* values, size_t stride)
+{
+	unsigned int tiles_x = (columns + tile_size - 1) / tile_size;
+	unsigned int tiles_y = (rows + tile_size - 1) / tile_size;
+	int tile_count = (int)(tiles_x * tiles_y);
+
+	std::vector<char> decoded(tile_count, 0);
+	job_system::instance().parallel_for(0, tile_count, 1, [&](int begin, int end)
+	{
+		for (int t = begin; t < end; t++)
+		{
+			const unsigned char* entry = data + ARCHIVE_HEADER_SIZE + (size_t)t * ARCHIVE_ENTRY_SIZE;
+			unsigned int col0 = (t % tiles_x) * tile_size;
+			unsigned int row0 = (t / tiles_x) * tile_size;
+			unsigned int tile_columns = (columns - col0 < tile_size) ? columns - col0 : tile_size;
+			unsigned int tile_rows = (rows - row0 < tile_size) ? rows - row0 : tile_size;
+			decoded[t] = heightfield_codec::decodeTile(data + get64(entry), (size_t)get64(entry + 8),
+				values + (size_t)row0 * stride + col0, tile_columns, tile_rows, stride);
+		}
+	});
+
+	for (int t = 0; t < tile_count; t++)
+	{
+		if (!decoded[t]) return false;
+	}
+	return true;
+}
+
+bool heightfield_codec::decodeTiles(const unsigned char* data, size_t size,
+	std::vector<float>& values, unsigned int& columns, unsigned int& rows)
+{
+	unsigned int tile_size;
+	if (!readArchiveLayout(data, size, columns, rows, tile_size)) return false;
+
+	values.resize((size_t)columns * rows);
+	return decodeArchiveTiles(data, columns, rows, tile_size, &values[0], columns);
+}
+
+bool heightfield_codec::encodeNoiseMap(const noise::utils::NoiseMap& map, unsigned int tile_size,
+	float error_bound, std::vector<unsigned char>& out)
+{
+	if (map.GetWidth() <= 0 || map.GetHeight() <= 0)
+	{
+		out.clear();
+		return false;
+	}
+	return encodeTiles(map.GetConstSlabPtr(), map.GetWidth(), map.GetHeight(),
+		map.GetStride(), tile_size, error_bound, out);
+}
+
+bool heightfield_codec::decodeNoiseMap(const unsigned char* data, size_t size,
+	noise::utils::NoiseMap& map)
+{
+	unsigned int columns, rows, tile_size;
+	if (!readArchiveLayout(data, size, columns, rows, tile_size)) return false;
+	if (columns > 0x7fffffff || rows > 0x7fffffff) return false;
+
+	map.SetSize(columns, rows);
+	return decodeArchiveTiles(data, columns, rows, tile_size, map.GetSlabPtr(), map.GetStride());
+}
@@ -0,0 +1,151 @@
+/* heightfield_codec.h
+   A self-contained compressor for height values, used to archive baked
+   terrain and noise maps.
+
+   Each value is predicted from its left, upper and upper-left neighbours
+   with the median edge detector predictor from LOCO-I. The prediction error
+   is coded with adaptive Golomb-Rice codes, choosing the code parameter from
+   the recent errors seen in similar local surroundings.
+
+   Lossless mode works on the float bits, remapped so that the integer order
+   matches the float order; every value, including NaN, decodes to the same
+   bits. Given an error bound e, values are first quantized to steps of 2e so
+   each decoded value is within e of the original, plus at most half the
+   float spacing at that value from rounding the result, which compresses
+   much further.
+
+   heightfield_encoder and heightfield_decoder work a row at a time, so a
+   map can be compressed as it is built and decoded as it is read using
+   memory for two rows. heightfield_codec splits a grid into tiles that are
+   compressed and decompressed independently on the shared job_system.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "noiseutils.h"
+
+#define HEIGHTFIELD_CODEC_STREAM_MAGIC "HFC1"
+#define HEIGHTFIELD_CODEC_ARCHIVE_MAGIC "HFZ1"
+
+/* Number of adaptive coding contexts, chosen by local gradient magnitude */
+#define HEIGHTFIELD_CODEC_CONTEXTS 33
+
+/* Writes and reads bits least significant first */
+class codec_bit_writer
+{
+public:
+	codec_bit_writer();
+	void put(unsigned int bits, int count);
+	void flush();
+	std::vector<unsigned char> bytes;
+
+private:
+	unsigned long long acc;
+	int fill;
+};
+
+class codec_bit_reader
+{
+public:
+	codec_bit_reader(const unsigned char* data, size_t size);
+	unsigned int get(int count);
+	bool overrun() const { return overran; }
+
+private:
+	void refill();
+	const unsigned char* data;
+	size_t size;
+	size_t pos;
+	unsigned long long acc;
+	int fill;
+	bool overran;
+};
+
+/* Adaptive Rice parameter state shared by the encoder and decoder */
+struct codec_context
+{
+	unsigned long long total;
+	unsigned int count;
+};
+
+class heightfield_encoder
+{
+public:
+	/* An error bound of zero encodes losslessly */
+	explicit heightfield_encoder(unsigned int columns, float error_bound = 0.f);
+
+	/* Encode the next row of columns values. Returns false if a value is
+	   too large to quantize to the error bound. */
+	bool encodeRow(const float* row);
+
+	/* Move the bytes encoded so far onto the end of dest. Call after the
+	   last row with final set to also flush the last partial byte. */
+	void drainOutput(std::vector<unsigned char>& dest, bool final = false);
+
+private:
+	unsigned int columns;
+	float error_bound;
+	std::vector<long long> prev_row;
+	std::vector<long long> cur_row;
+	unsigned int rows_done;
+	codec_bit_writer writer;
+	codec_context contexts[HEIGHTFIELD_CODEC_CONTEXTS];
+};
+
+class heightfield_decoder
+{
+public:
+	heightfield_decoder();
+
+	/* Start decoding a stream written by heightfield_encoder. Returns false
+	   if the data does not start with a valid stream header. */
+	bool begin(const unsigned char* data, size_t size);
+
+	/* Decode the next row into columns values. Returns false if the data
+	   ends before the row does. */
+	bool decodeRow(float* row);
+
+	unsigned int getColumns() const { return columns; }
+	float getErrorBound() const { return error_bound; }
+
+private:
+	unsigned int columns;
+	float error_bound;
+	std::vector<long long> prev_row;
+	std::vector<long long> cur_row;
+	unsigned int rows_done;
+	codec_bit_reader reader;
+	codec_context contexts[HEIGHTFIELD_CODEC_CONTEXTS];
+};
+
+class heightfield_codec
+{
+public:
+	/* Compress a rows * columns grid whose rows are stride floats apart,
+	   as independent tiles of tile_size points square. Tiles are compressed
+	   in parallel and the result replaces the contents of out. Returns false
+	   if a value cannot be quantized to the error bound. */
+	static bool encodeTiles(const float* values, unsigned int columns, unsigned int rows,
+		size_t stride, unsigned int tile_size, float error_bound,
+		std::vector<unsigned char>& out);
+
+	/* Decompress an archive written by encodeTiles. values is resized to
+	   hold rows * columns floats with no padding. Returns false if the
+	   archive is damaged. */
+	static bool decodeTiles(const unsigned char* data, size_t size,
+		std::vector<float>& values, unsigned int& columns, unsigned int& rows);
+
+	/* The same for a NoiseMap */
+	static bool encodeNoiseMap(const noise::utils::NoiseMap& map, unsigned int tile_size,
+		float error_bound, std::vector<unsigned char>& out);
+	static bool decodeNoiseMap(const unsigned char* data, size_t size,
+		noise::utils::NoiseMap& map);
+
+	/* Compress or decompress a single tile or small grid as one stream */
+	static bool encodeTile(const float* values, unsigned int columns, unsigned int rows,
+		size_t stride, float error_bound, std::vector<unsigned char>& out);
+	static bool decodeTile(const unsigned char* data, size_t size, float* values,
+		unsigned int columns, unsigned int rows, size_t stride);
+};
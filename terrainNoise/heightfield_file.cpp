@@ -0,0 +1,285 @@
+/* heightfield_file.cpp
+   A binary container for saved terrain heights, normals and the layers
+   worked out from them.
+*/
+
+#include "heightfield_file.h"
+#include <string.h>
+
+unsigned long long heightfield_hash(const void* data, size_t size, unsigned long long hash)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+heightfield_file::heightfield_file()
+{
+	header = NULL;
+	tiles = NULL;
+}
+
+/* The optional layers in the order they follow the heights in a tile
+   block, and the bytes of each point of them */
+struct heightfield_layer_format
+{
+	unsigned int flag;
+	size_t point_bytes;
+};
+
+static const heightfield_layer_format LAYER_FORMATS[] =
+{
+	{ HEIGHTFIELD_HAS_NORMALS, 3 * sizeof(float) },
+	{ HEIGHTFIELD_HAS_LIGHTING, 2 * sizeof(float) },
+	{ HEIGHTFIELD_HAS_FLOW, sizeof(float) },
+	{ HEIGHTFIELD_HAS_SPLAT, 4 },
+};
+
+const int LAYER_COUNT = sizeof(LAYER_FORMATS) / sizeof(LAYER_FORMATS[0]);
+
+/* Every flag a valid file may have */
+const unsigned int HEIGHTFIELD_KNOWN_FLAGS = HEIGHTFIELD_HAS_NORMALS | HEIGHTFIELD_HAS_LIGHTING
+	| HEIGHTFIELD_HAS_FLOW | HEIGHTFIELD_HAS_SPLAT;
+
+/* Bytes from the start of a tile block to the layer flag, or to the end
+   of the block if flag is 0 */
+static size_t layerOffset(unsigned int tile_size, unsigned int flags, unsigned int flag)
+{
+	size_t points = (size_t)tile_size * tile_size;
+	size_t bytes = points * sizeof(float);
+	for (int l = 0; l < LAYER_COUNT && LAYER_FORMATS[l].flag != flag; l++)
+	{
+		if (flags & LAYER_FORMATS[l].flag) bytes += points * LAYER_FORMATS[l].point_bytes;
+	}
+	return bytes;
+}
+
+size_t heightfield_file::tileBytes(unsigned int tile_size, unsigned int flags)
+{
+	return layerOffset(tile_size, flags, 0);
+}
+
+/* Round an offset up to the start of the next tile block */
+static unsigned long long alignTile(unsigned long long offset)
+{
+	return (offset + HEIGHTFIELD_TILE_ALIGNMENT - 1) & ~(unsigned long long)(HEIGHTFIELD_TILE_ALIGNMENT - 1);
+}
+
+/* Copy the part of a grid that a tile covers into the tile, a point of
+   point_bytes at a time, padding it with the last row and column */
+static void copyTile(unsigned char* dest, const unsigned char* src, size_t point_bytes,
+	unsigned int columns, unsigned int col0, unsigned int row0,
+	const heightfield_tile& tile, unsigned int tile_size)
+{
+	for (unsigned int r = 0; r < tile_size; r++)
+	{
+		unsigned int row = row0 + (r < tile.rows ? r : tile.rows - 1);
+		const unsigned char* from = src + ((size_t)row * columns + col0) * point_bytes;
+		unsigned char* to = dest + (size_t)r * tile_size * point_bytes;
+		memcpy(to, from, tile.columns * point_bytes);
+		for (unsigned int c = tile.columns; c < tile_size; c++)
+		{
+			memcpy(to + c * point_bytes, from + (tile.columns - 1) * point_bytes, point_bytes);
+		}
+	}
+}
+
+bool heightfield_file::write(const char* filename, const heightfield_desc& desc,
+	unsigned int columns, unsigned int rows, unsigned int tile_size,
+	const float* heights, const heightfield_layers& layers)
+{
+	if (columns == 0 || rows == 0 || tile_size == 0 || heights == NULL) return false;
+
+	/* The layers in the order of LAYER_FORMATS */
+	const void* layer_data[] = { layers.normals, layers.lighting, layers.accumulation, layers.splat };
+	unsigned int flags = 0;
+	for (int l = 0; l < LAYER_COUNT; l++)
+	{
+		if (layer_data[l]) flags |= LAYER_FORMATS[l].flag;
+	}
+
+	unsigned int tiles_x = (columns + tile_size - 1) / tile_size;
+	unsigned int tiles_y = (rows + tile_size - 1) / tile_size;
+	unsigned int tile_count = tiles_x * tiles_y;
+	size_t tile_bytes = tileBytes(tile_size, flags);
+
+	unsigned long long index_offset = sizeof(heightfield_header);
+	unsigned long long data_offset = alignTile(index_offset + tile_count * sizeof(heightfield_tile));
+	unsigned long long file_size = data_offset + (unsigned long long)alignTile(tile_bytes) * tile_count;
+	if (file_size > (size_t)-1) return false;
+
+	mapped_file out;
+	unsigned char* data = out.create(filename, (size_t)file_size);
+	if (data == NULL) return false;
+
+	heightfield_header* hdr = (heightfield_header*)data;
+	heightfield_tile* index = (heightfield_tile*)(data + index_offset);
+	memset(hdr, 0, sizeof(heightfield_header));
+	memcpy(hdr->magic, HEIGHTFIELD_MAGIC, sizeof(hdr->magic));
+	hdr->version = HEIGHTFIELD_VERSION;
+	hdr->header_size = sizeof(heightfield_header);
+	hdr->columns = columns;
+	hdr->rows = rows;
+	hdr->tile_size = tile_size;
+	hdr->tiles_x = tiles_x;
+	hdr->tiles_y = tiles_y;
+	hdr->flags = flags;
+	hdr->lower_x = desc.lower_x;
+	hdr->upper_x = desc.upper_x;
+	hdr->lower_z = desc.lower_z;
+	hdr->upper_z = desc.upper_z;
+	hdr->seed = desc.seed;
+	hdr->graph_hash = desc.graph_hash;
+	hdr->index_offset = index_offset;
+	hdr->min_height = hdr->max_height = heights[0];
+
+	unsigned long long offset = data_offset;
+	for (unsigned int ty = 0; ty < tiles_y; ty++)
+	{
+		for (unsigned int tx = 0; tx < tiles_x; tx++)
+		{
+			heightfield_tile& tile = index[ty * tiles_x + tx];
+			unsigned int col0 = tx * tile_size;
+			unsigned int row0 = ty * tile_size;
+			tile.offset = offset;
+			tile.columns = (columns - col0 < tile_size) ? columns - col0 : tile_size;
+			tile.rows = (rows - row0 < tile_size) ? rows - row0 : tile_size;
+			tile.min_height = tile.max_height = heights[(size_t)row0 * columns + col0];
+
+			copyTile(data + offset, (const unsigned char*)heights, sizeof(float),
+				columns, col0, row0, tile, tile_size);
+			for (unsigned int r = 0; r < tile.rows; r++)
+			{
+				const float* src = heights + (size_t)(row0 + r) * columns + col0;
+				for (unsigned int c = 0; c < tile.columns; c++)
+				{
+					if (src[c] < tile.min_height) tile.min_height = src[c];
+					if (src[c] > tile.max_height) tile.max_height = src[c];
+				}
+			}
+
+			for (int l = 0; l < LAYER_COUNT; l++)
+			{
+				if (!layer_data[l]) continue;
+				copyTile(data + offset + layerOffset(tile_size, flags, LAYER_FORMATS[l].flag),
+					(const unsigned char*)layer_data[l], LAYER_FORMATS[l].point_bytes,
+					columns, col0, row0, tile, tile_size);
+			}
+
+			if (tile.min_height < hdr->min_height) hdr->min_height = tile.min_height;
+			if (tile.max_height > hdr->max_height) hdr->max_height = tile.max_height;
+			offset += alignTile(tile_bytes);
+		}
+	}
+
+	return out.close();
+}
+
+bool heightfield_file::open(const char* filename)
+{
+	close();
+
+	const unsigned char* data = file.open(filename);
+	if (data == NULL) return false;
+	size_t size = file.getSize();
+
+	/* Check the header before trusting any of its offsets */
+	const heightfield_header* hdr = (const heightfield_header*)data;
+	if (size < sizeof(heightfield_header)
+		|| memcmp(hdr->magic, HEIGHTFIELD_MAGIC, sizeof(hdr->magic)) != 0
+		|| hdr->version != HEIGHTFIELD_VERSION
+		|| hdr->header_size != sizeof(heightfield_header)
+		|| hdr->columns == 0 || hdr->rows == 0
+		|| (hdr->flags & ~HEIGHTFIELD_KNOWN_FLAGS) != 0
+		|| hdr->tile_size == 0 || hdr->tile_size > HEIGHTFIELD_MAX_TILE_SIZE
+		|| hdr->tiles_x != (hdr->columns + hdr->tile_size - 1) / hdr->tile_size
+		|| hdr->tiles_y != (hdr->rows + hdr->tile_size - 1) / hdr->tile_size)
+	{
+		close();
+		return false;
+	}
+
+	unsigned long long tile_count = (unsigned long long)hdr->tiles_x * hdr->tiles_y;
+	if (hdr->index_offset % sizeof(unsigned long long) != 0
+		|| hdr->index_offset > size
+		|| tile_count > (size - hdr->index_offset) / sizeof(heightfield_tile))
+	{
+		close();
+		return false;
+	}
+
+	/* Each tile must lie within the file and cover exactly its part of the
+	   grid, which is never more than tile_size a side */
+	const heightfield_tile* index = (const heightfield_tile*)(data + hdr->index_offset);
+	size_t tile_bytes = tileBytes(hdr->tile_size, hdr->flags);
+	for (unsigned int ty = 0; ty < hdr->tiles_y; ty++)
+	{
+		for (unsigned int tx = 0; tx < hdr->tiles_x; tx++)
+		{
+			const heightfield_tile& tile = index[ty * hdr->tiles_x + tx];
+			unsigned int col0 = tx * hdr->tile_size;
+			unsigned int row0 = ty * hdr->tile_size;
+			unsigned int columns = (hdr->columns - col0 < hdr->tile_size) ? hdr->columns - col0 : hdr->tile_size;
+			unsigned int rows = (hdr->rows - row0 < hdr->tile_size) ? hdr->rows - row0 : hdr->tile_size;
+			if (tile.offset % sizeof(float) != 0
+				|| tile.offset > size
+				|| tile_bytes > size - tile.offset
+				|| tile.columns != columns || tile.rows != rows)
+			{
+				close();
+				return false;
+			}
+		}
+	}
+
+	header = hdr;
+	tiles = index;
+	return true;
+}
+
+void heightfield_file::close()
+{
+	file.close();
+	header = NULL;
+	tiles = NULL;
+}
+
+const heightfield_tile& heightfield_file::getTile(unsigned int tx, unsigned int ty) const
+{
+	return tiles[ty * header->tiles_x + tx];
+}
+
+const float* heightfield_file::getTileHeights(unsigned int tx, unsigned int ty) const
+{
+	return (const float*)(file.getData() + getTile(tx, ty).offset);
+}
+
+const void* heightfield_file::getTileLayer(unsigned int tx, unsigned int ty, unsigned int flag) const
+{
+	if (!hasLayers(flag)) return NULL;
+	return file.getData() + getTile(tx, ty).offset + layerOffset(header->tile_size, header->flags, flag);
+}
+
+const float* heightfield_file::getTileNormals(unsigned int tx, unsigned int ty) const
+{
+	return (const float*)getTileLayer(tx, ty, HEIGHTFIELD_HAS_NORMALS);
+}
+
+const float* heightfield_file::getTileLighting(unsigned int tx, unsigned int ty) const
+{
+	return (const float*)getTileLayer(tx, ty, HEIGHTFIELD_HAS_LIGHTING);
+}
+
+const float* heightfield_file::getTileAccumulation(unsigned int tx, unsigned int ty) const
+{
+	return (const float*)getTileLayer(tx, ty, HEIGHTFIELD_HAS_FLOW);
+}
+
+const unsigned char* heightfield_file::getTileSplat(unsigned int tx, unsigned int ty) const
+{
+	return (const unsigned char*)getTileLayer(tx, ty, HEIGHTFIELD_HAS_SPLAT);
+}
@@ -0,0 +1,153 @@
+/* heightfield_file.h
+   A binary container for saved terrain heights, normals and the layers
+   worked out from them.
+
+   The file is laid out so that it can be memory mapped and used in place:
+
+     heightfield_header   fixed size, at offset 0
+     heightfield_tile[]   the tile index, one entry per tile in row order
+     tile data            one block per tile, each starting on a 4096 byte
+                          boundary so that a tile pages in on its own
+
+   Each tile block holds tile_size * tile_size heights followed by the
+   same number of points of each layer the flags say the file has, in
+   this order:
+     normals        three floats
+     lighting       two floats, ambient and sun visibility
+     flow           one float, the flow accumulation
+     splat          four bytes, the material weights
+   All of them are stored row by row. Tiles on the right and top edges are
+   padded by repeating the last row and column, so every tile has the
+   same size.
+
+   Rows of the grid run along the terrain's x axis and columns along its
+   z axis, matching the vertex order in terrain_object. All values are
+   little endian.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include "mapped_file.h"
+
+#define HEIGHTFIELD_MAGIC "TERRHFLD"
+#define HEIGHTFIELD_VERSION 1
+#define HEIGHTFIELD_TILE_ALIGNMENT 4096
+#define HEIGHTFIELD_MAX_TILE_SIZE 4096
+
+/* heightfield_header flags */
+#define HEIGHTFIELD_HAS_NORMALS 1
+#define HEIGHTFIELD_HAS_LIGHTING 2
+#define HEIGHTFIELD_HAS_FLOW 4
+#define HEIGHTFIELD_HAS_SPLAT 8
+
+struct heightfield_header
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int header_size;
+
+	/* Grid size in points, and the tile size and count */
+	unsigned int columns;
+	unsigned int rows;
+	unsigned int tile_size;
+	unsigned int tiles_x;
+	unsigned int tiles_y;
+	unsigned int flags;
+
+	/* Noise bounds the heights were generated from, and the noise seed */
+	double lower_x;
+	double upper_x;
+	double lower_z;
+	double upper_z;
+	int seed;
+	unsigned int reserved;
+
+	/* Hash of the module graph and parameters that generated the heights,
+	   used to tell whether a saved file is still current */
+	unsigned long long graph_hash;
+
+	/* Offset of the tile index from the start of the file */
+	unsigned long long index_offset;
+
+	/* Range of the heights over the whole grid */
+	float min_height;
+	float max_height;
+};
+
+struct heightfield_tile
+{
+	unsigned long long offset;
+	unsigned int columns;	/* Points in the tile that are not padding */
+	unsigned int rows;
+	float min_height;
+	float max_height;
+};
+
+/* The parts of the header that describe how the heights were generated */
+struct heightfield_desc
+{
+	double lower_x;
+	double upper_x;
+	double lower_z;
+	double upper_z;
+	int seed;
+	unsigned long long graph_hash;
+};
+
+/* The optional layers to write, each a point for every height in the same
+   order, or NULL to leave the layer out */
+struct heightfield_layers
+{
+	heightfield_layers() : normals(NULL), lighting(NULL), accumulation(NULL), splat(NULL) {}
+
+	const float* normals;
+	const float* lighting;
+	const float* accumulation;
+	const unsigned char* splat;
+};
+
+/* 64-bit FNV-1a hash, used to hash the module graph description.
+   Pass the previous result as hash to hash several blocks in turn. */
+unsigned long long heightfield_hash(const void* data, size_t size,
+	unsigned long long hash = 14695981039346656037ULL);
+
+class heightfield_file
+{
+public:
+	heightfield_file();
+
+	/* Write a grid of rows * columns heights, and the layers that are not
+	   NULL, to a new file. Returns false if the file could not be
+	   written. */
+	static bool write(const char* filename, const heightfield_desc& desc,
+		unsigned int columns, unsigned int rows, unsigned int tile_size,
+		const float* heights, const heightfield_layers& layers);
+
+	/* Map a saved file and check that its header and tile index are
+	   consistent with its size. Returns false if the file is missing or
+	   not a valid heightfield file. */
+	bool open(const char* filename);
+	void close();
+
+	const heightfield_header& getHeader() const { return *header; }
+	bool hasLayers(unsigned int flags) const { return (header->flags & flags) == flags; }
+	bool hasNormals() const { return hasLayers(HEIGHTFIELD_HAS_NORMALS); }
+
+	/* Tile index entry and data for tile (tx, ty). The layers are NULL if
+	   the file does not have them. */
+	const heightfield_tile& getTile(unsigned int tx, unsigned int ty) const;
+	const float* getTileHeights(unsigned int tx, unsigned int ty) const;
+	const float* getTileNormals(unsigned int tx, unsigned int ty) const;
+	const float* getTileLighting(unsigned int tx, unsigned int ty) const;
+	const float* getTileAccumulation(unsigned int tx, unsigned int ty) const;
+	const unsigned char* getTileSplat(unsigned int tx, unsigned int ty) const;
+
+private:
+	static size_t tileBytes(unsigned int tile_size, unsigned int flags);
+	const void* getTileLayer(unsigned int tx, unsigned int ty, unsigned int flag) const;
+
+	mapped_file file;
+	const heightfield_header* header;
+	const heightfield_tile* tiles;
+};
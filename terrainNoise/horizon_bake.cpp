@@ -0,0 +1,199 @@
+/* horizon_bake.cpp
+   Bakes ambient occlusion and sun visibility for every point of a height
+   map from its horizons.
+*/
+
+#include "horizon_bake.h"
+#include "job_system.h"
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+/* Lines swept by one job on the worker pool */
+const int HORIZON_LINE_GRAIN = 16;
+
+/* Points handled by one job when adding up the terms */
+const int HORIZON_POINT_GRAIN = 16384;
+
+/* Horizon slope of a point with nothing beyond it */
+const float HORIZON_NONE = -1e30f;
+
+/* Steps along the sixteen sweep directions, anticlockwise from +column.
+   The even entries are the eight grid axes and diagonals. */
+static const int SWEEP_COLUMN[16] = { 1, 2, 1, 1, 0, -1, -1, -2, -1, -2, -1, -1, 0, 1, 1, 2 };
+static const int SWEEP_ROW[16] = { 0, 1, 1, 2, 1, 2, 1, 1, 0, -1, -1, -2, -1, -2, -1, -1 };
+
+const float HORIZON_PI = 3.14159265f;
+
+horizon_bake_params::horizon_bake_params()
+{
+	directions = 8;
+	cell_size = 1.f;
+	sun_column = 1.f;
+	sun_row = 0.f;
+	sun_up = 1.f;
+	penumbra = 0.05f;
+}
+
+double horizon_bake_stats::pointsPerSecond() const
+{
+	return seconds > 0.0 ? double(points) / seconds : 0.0;
+}
+
+/* Sweep every line running along (step_column, step_row), writing the
+   horizon slope of each point in that direction */
+static void sweepDirection(const float* heights, int columns, int rows, int step_column, int step_row,
+	float cell_size, float* horizon)
+{
+	/* Lines start at the far end, where the next step leaves the grid */
+	std::vector<int> starts;
+	for (int y = 0; y < rows; y++)
+	{
+		for (int x = 0; x < columns; x++)
+		{
+			int nx = x + step_column;
+			int ny = y + step_row;
+			if (nx < 0 || nx >= columns || ny < 0 || ny >= rows) starts.push_back(y * columns + x);
+		}
+	}
+
+	float inv_step = 1.f / (cell_size * sqrtf(float(step_column * step_column + step_row * step_row)));
+	int step = step_row * columns + step_column;
+
+	job_system::instance().parallel_for(0, (int)starts.size(), HORIZON_LINE_GRAIN, [&](int begin, int end)
+	{
+		/* Upper hull of the points passed so far, farthest first, as
+		   (position along the line, height) */
+		std::vector<int> hull_position;
+		std::vector<float> hull_height;
+
+		for (int s = begin; s < end; s++)
+		{
+			hull_position.clear();
+			hull_height.clear();
+
+			int i = starts[s];
+			int x = i % columns;
+			int y = i / columns;
+			for (int position = 0; x >= 0 && x < columns && y >= 0 && y < rows; position++)
+			{
+				float h = heights[i];
+
+				/* Drop hull points that are under the line from this point
+				   to the one behind them */
+				size_t size = hull_position.size();
+				while (size >= 2)
+				{
+					float top = (hull_height[size - 1] - h) / float(position - hull_position[size - 1]);
+					float next = (hull_height[size - 2] - h) / float(position - hull_position[size - 2]);
+					if (top > next) break;
+					size--;
+				}
+				hull_position.resize(size);
+				hull_height.resize(size);
+
+				horizon[i] = size ? (hull_height[size - 1] - h) / float(position - hull_position[size - 1]) * inv_step
+					: HORIZON_NONE;
+
+				hull_position.push_back(position);
+				hull_height.push_back(h);
+
+				i -= step;
+				x -= step_column;
+				y -= step_row;
+			}
+		}
+	});
+}
+
+void horizon_bake::run(const float* heights, int columns, int rows, const horizon_bake_params& params,
+	float* ambient, float* sun, size_t stride, horizon_bake_stats* stats)
+{
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	horizon_bake_stats totals = {};
+	if (columns <= 0 || rows <= 0)
+	{
+		if (stats) *stats = totals;
+		return;
+	}
+
+	int count = columns * rows;
+	int spacing = params.directions >= 16 ? 1 : 2;
+	totals.points = (unsigned long long)count;
+
+	/* Each direction stands for the arc halfway to its neighbours */
+	float angle[16];
+	for (int d = 0; d < 16; d++) angle[d] = atan2f(float(SWEEP_ROW[d]), float(SWEEP_COLUMN[d]));
+	float weight[16];
+	for (int d = 0; d < 16; d += spacing)
+	{
+		float before = angle[d] - angle[(d + 16 - spacing) % 16];
+		float after = angle[(d + spacing) % 16] - angle[d];
+		if (before < 0.f) before += 2.f * HORIZON_PI;
+		if (after < 0.f) after += 2.f * HORIZON_PI;
+		weight[d] = (before + after) / (4.f * HORIZON_PI);
+	}
+
+	/* The two sweep directions either side of the sun */
+	float sun_azimuth = atan2f(params.sun_row, params.sun_column);
+	if (sun_azimuth < 0.f) sun_azimuth += 2.f * HORIZON_PI;
+	int sun_before = 0;
+	for (int d = 0; d < 16; d += spacing)
+	{
+		float a = angle[d] < 0.f ? angle[d] + 2.f * HORIZON_PI : angle[d];
+		if (a <= sun_azimuth) sun_before = d;
+	}
+	int sun_after = (sun_before + spacing) % 16;
+	float before_angle = angle[sun_before] < 0.f ? angle[sun_before] + 2.f * HORIZON_PI : angle[sun_before];
+	float arc = angle[sun_after] - angle[sun_before];
+	if (arc <= 0.f) arc += 2.f * HORIZON_PI;
+	float sun_blend = (sun_azimuth - before_angle) / arc;
+
+	float sun_elevation = atan2f(params.sun_up, sqrtf(params.sun_column * params.sun_column
+		+ params.sun_row * params.sun_row));
+	float inv_penumbra = params.penumbra > 0.f ? 1.f / params.penumbra : 1e6f;
+
+	std::vector<float> horizon(count);
+	std::vector<float> sun_horizon(count, 0.f);
+	std::vector<float> visible(count, 0.f);
+
+	for (int d = 0; d < 16; d += spacing)
+	{
+		sweepDirection(heights, columns, rows, SWEEP_COLUMN[d], SWEEP_ROW[d], params.cell_size, &horizon[0]);
+		totals.directions++;
+
+		/* Open sky above the horizon, weighted by the arc of this direction */
+		float w = weight[d];
+		float sun_weight = d == sun_before ? 1.f - sun_blend : (d == sun_after ? sun_blend : 0.f);
+		job_system::instance().parallel_for(0, count, HORIZON_POINT_GRAIN, [&](int begin, int end)
+		{
+			const float* hz = &horizon[0];
+			float* vis = &visible[0];
+			float* sh = &sun_horizon[0];
+			for (int i = begin; i < end; i++)
+			{
+				float s = hz[i] > 0.f ? hz[i] : 0.f;
+				vis[i] += w * (1.f - s / sqrtf(1.f + s * s));
+			}
+			if (sun_weight > 0.f)
+			{
+				for (int i = begin; i < end; i++) sh[i] += sun_weight * atanf(hz[i]);
+			}
+		});
+	}
+
+	/* Write out the visibilities, fading the sun out over the penumbra */
+	job_system::instance().parallel_for(0, count, HORIZON_POINT_GRAIN, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			float v = (sun_elevation - sun_horizon[i]) * inv_penumbra + 0.5f;
+			v = v < 0.f ? 0.f : (v > 1.f ? 1.f : v);
+			ambient[i * stride] = visible[i];
+			sun[i * stride] = sun_elevation > 0.f ? v : 0.f;
+		}
+	});
+
+	totals.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	if (stats) *stats = totals;
+}
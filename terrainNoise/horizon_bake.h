@@ -0,0 +1,59 @@
+/* horizon_bake.h
+   Bakes ambient occlusion and sun visibility for every point of a height
+   map from its horizons.
+
+   The horizon of a point in one direction is the steepest slope up to any
+   point further along that direction. It is found for every point at once
+   with a sweep along each line of the grid: walking back from the far end
+   of a line, the points already passed are kept as an upper convex hull,
+   and the horizon of the next point is the tangent from it to the hull.
+   Each point is pushed and popped at most once, so a direction costs one
+   pass over the map whatever the terrain looks like, and there is no
+   limit on how far away the horizon can be.
+
+   The lines of one direction are independent, so they are swept in
+   parallel on the job system. The occlusion and sun terms are then added
+   up for every point in a loop without branches that the compiler can
+   vectorize.
+
+   Ambient visibility is the average over the directions of 1 - sin of the
+   horizon angle, so 1 is open sky and 0 is the bottom of a deep slot.
+   Sun visibility compares the sun elevation with the horizon towards the
+   sun, interpolated between the two nearest directions, and fades over a
+   penumbra angle rather than switching hard.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+struct horizon_bake_params
+{
+	horizon_bake_params();
+
+	int directions;			/* 8 for the grid axes and diagonals, or 16 to add the knight's moves */
+	float cell_size;		/* Distance between neighbouring points, in height units */
+	float sun_column;		/* Direction towards the sun, along the columns, */
+	float sun_row;			/* along the rows */
+	float sun_up;			/* and up */
+	float penumbra;			/* Angle in radians over which the sun fades out */
+};
+
+struct horizon_bake_stats
+{
+	unsigned long long points;
+	int directions;
+	double seconds;
+	double pointsPerSecond() const;
+};
+
+class horizon_bake
+{
+public:
+	/* Bake a grid of rows * columns heights stored row by row. Writes the
+	   ambient visibility of each point to ambient and its sun visibility to
+	   sun, each in 0..1; both may be spaced out with a stride in floats, so
+	   they can be written straight into interleaved vertex data. */
+	static void run(const float* heights, int columns, int rows, const horizon_bake_params& params,
+		float* ambient, float* sun, size_t stride = 1, horizon_bake_stats* stats = NULL);
+};
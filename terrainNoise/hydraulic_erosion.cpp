@@ -0,0 +1,307 @@
+/* hydraulic_erosion.cpp
+   Particle based hydraulic erosion of a height array.
+*/
+
+#include "hydraulic_erosion.h"
+#include "job_system.h"
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+hydraulic_erosion_params::hydraulic_erosion_params()
+{
+	droplets = 0;
+	seed = 1;
+	rounds = 4;
+	tile_size = 64;
+	radius = 3;
+	max_lifetime = 30;
+	inertia = 0.05f;
+	capacity = 4.f;
+	min_capacity = 0.01f;
+	erode_speed = 0.3f;
+	deposit_speed = 0.3f;
+	evaporate_speed = 0.01f;
+	gravity = 4.f;
+	initial_speed = 1.f;
+	initial_water = 1.f;
+	cell_size = 1.f;
+}
+
+/* Small, fast generator for the droplet start points. Each tile has its
+   own, so tiles never share state. */
+class erosion_random
+{
+public:
+	explicit erosion_random(unsigned long long seed)
+	{
+		state = seed;
+	}
+
+	/* splitmix64 */
+	unsigned long long next()
+	{
+		unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	/* Uniform in [0, 1) */
+	float nextFloat()
+	{
+		return float(next() >> 40) * (1.f / 16777216.f);
+	}
+
+private:
+	unsigned long long state;
+};
+
+/* Offsets and weights of the points a droplet erodes around its cell */
+struct erosion_brush
+{
+	std::vector<int> dx;
+	std::vector<int> dy;
+	std::vector<float> weight;
+};
+
+/* A rectangle of points, with (x1, y1) excluded */
+struct erosion_area
+{
+	int x0, y0, x1, y1;
+};
+
+struct erosion_tile_stats
+{
+	unsigned long long droplets;
+	unsigned long long steps;
+	double eroded;
+	double deposited;
+};
+
+static erosion_brush makeBrush(int radius)
+{
+	erosion_brush brush;
+	float total = 0.f;
+	for (int y = -radius; y <= radius; y++)
+	{
+		for (int x = -radius; x <= radius; x++)
+		{
+			float distance = sqrtf(float(x * x + y * y));
+			if (distance < float(radius))
+			{
+				brush.dx.push_back(x);
+				brush.dy.push_back(y);
+				brush.weight.push_back(float(radius) - distance);
+				total += float(radius) - distance;
+			}
+		}
+	}
+	for (size_t i = 0; i < brush.weight.size(); i++) brush.weight[i] /= total;
+	return brush;
+}
+
+/* Bilinear height and gradient at (px, py) */
+static inline float heightAndGradient(const float* heights, int columns, float px, float py,
+	float inv_cell, float& gx, float& gy)
+{
+	int ix = (int)px;
+	int iy = (int)py;
+	float fx = px - float(ix);
+	float fy = py - float(iy);
+	const float* p = heights + (size_t)iy * columns + ix;
+	float h00 = p[0];
+	float h10 = p[1];
+	float h01 = p[columns];
+	float h11 = p[columns + 1];
+
+	gx = ((h10 - h00) * (1.f - fy) + (h11 - h01) * fy) * inv_cell;
+	gy = ((h01 - h00) * (1.f - fx) + (h11 - h10) * fx) * inv_cell;
+	return h00 * (1.f - fx) * (1.f - fy) + h10 * fx * (1.f - fy)
+		+ h01 * (1.f - fx) * fy + h11 * fx * fy;
+}
+
+/* Run count droplets that start in start and stay in bounds */
+static void runDroplets(float* heights, int columns, const hydraulic_erosion_params& params,
+	const erosion_brush& brush, const erosion_area& start, const erosion_area& bounds,
+	int count, erosion_random& random, erosion_tile_stats& stats)
+{
+	float inv_cell = 1.f / params.cell_size;
+	size_t brush_size = brush.weight.size();
+
+	for (int d = 0; d < count; d++)
+	{
+		float px = float(start.x0) + random.nextFloat() * float(start.x1 - start.x0);
+		float py = float(start.y0) + random.nextFloat() * float(start.y1 - start.y0);
+		float dirx = 0.f, diry = 0.f;
+		float speed = params.initial_speed;
+		float water = params.initial_water;
+		float sediment = 0.f;
+		stats.droplets++;
+
+		for (int life = 0; life < params.max_lifetime; life++)
+		{
+			int ix = (int)px;
+			int iy = (int)py;
+			float fx = px - float(ix);
+			float fy = py - float(iy);
+
+			float gx, gy;
+			float h = heightAndGradient(heights, columns, px, py, inv_cell, gx, gy);
+
+			/* Turn downhill, keeping some of the old direction */
+			dirx = dirx * params.inertia - gx * (1.f - params.inertia);
+			diry = diry * params.inertia - gy * (1.f - params.inertia);
+			float length = sqrtf(dirx * dirx + diry * diry);
+			if (length == 0.f) break;
+			dirx /= length;
+			diry /= length;
+			px += dirx;
+			py += diry;
+			stats.steps++;
+
+			if (px < float(bounds.x0) || px >= float(bounds.x1)
+				|| py < float(bounds.y0) || py >= float(bounds.y1))
+			{
+				break;
+			}
+
+			float new_gx, new_gy;
+			float dh = heightAndGradient(heights, columns, px, py, inv_cell, new_gx, new_gy) - h;
+			float capacity = -dh * speed * water * params.capacity;
+			if (capacity < params.min_capacity) capacity = params.min_capacity;
+
+			float* cell = heights + (size_t)iy * columns + ix;
+			if (sediment > capacity || dh > 0.f)
+			{
+				/* Fill the pit behind the droplet, or drop the excess,
+				   spread over the four corners of the cell it left */
+				float amount = dh > 0.f ? (dh < sediment ? dh : sediment)
+					: (sediment - capacity) * params.deposit_speed;
+				sediment -= amount;
+				cell[0] += amount * (1.f - fx) * (1.f - fy);
+				cell[1] += amount * fx * (1.f - fy);
+				cell[columns] += amount * (1.f - fx) * fy;
+				cell[columns + 1] += amount * fx * fy;
+				stats.deposited += amount;
+			}
+			else
+			{
+				/* Never erode more than the drop, so no pits are dug */
+				float amount = (capacity - sediment) * params.erode_speed;
+				if (amount > -dh) amount = -dh;
+				for (size_t b = 0; b < brush_size; b++)
+				{
+					cell[brush.dy[b] * columns + brush.dx[b]] -= amount * brush.weight[b];
+				}
+				sediment += amount;
+				stats.eroded += amount;
+			}
+
+			float speed2 = speed * speed - dh * params.gravity;
+			speed = speed2 > 0.f ? sqrtf(speed2) : 0.f;
+			water *= 1.f - params.evaporate_speed;
+		}
+	}
+}
+
+void hydraulic_erosion::run(float* heights, int columns, int rows,
+	const hydraulic_erosion_params& params, hydraulic_erosion_stats* stats)
+{
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	hydraulic_erosion_stats totals = {};
+
+	int radius = params.radius > 1 ? params.radius : 1;
+	int rounds = params.rounds > 1 ? params.rounds : 1;
+
+	/* Droplets must be able to leave their tile by at least a point */
+	int tile_size = params.tile_size;
+	if (tile_size < 2 * (radius + 3)) tile_size = 2 * (radius + 3);
+	int half_tile = tile_size / 2;
+	int margin = half_tile - radius - 2;
+
+	/* Keep the brush and the bilinear lookups inside the grid */
+	erosion_area interior = { radius, radius, columns - radius - 1, rows - radius - 1 };
+	if (params.droplets == 0 || interior.x0 >= interior.x1 || interior.y0 >= interior.y1)
+	{
+		if (stats) *stats = totals;
+		return;
+	}
+
+	erosion_brush brush = makeBrush(radius);
+	double interior_area = double(interior.x1 - interior.x0) * double(interior.y1 - interior.y0);
+
+	for (int round = 0; round < rounds; round++)
+	{
+		unsigned int round_droplets = params.droplets / rounds
+			+ ((unsigned int)round < params.droplets % rounds ? 1 : 0);
+
+		/* Move the tile grid by half a tile in x, then y, then both */
+		int shift_x = (round & 1) ? half_tile : 0;
+		int shift_y = (round & 2) ? half_tile : 0;
+		int tiles_x = (columns + shift_x + tile_size - 1) / tile_size;
+		int tiles_y = (rows + shift_y + tile_size - 1) / tile_size;
+
+		for (int phase = 0; phase < 4; phase++)
+		{
+			std::vector<int> phase_tiles;
+			for (int ty = phase >> 1; ty < tiles_y; ty += 2)
+			{
+				for (int tx = phase & 1; tx < tiles_x; tx += 2)
+				{
+					phase_tiles.push_back(ty * tiles_x + tx);
+				}
+			}
+
+			std::vector<erosion_tile_stats> tile_stats(phase_tiles.size());
+			job_system::instance().parallel_for(0, (int)phase_tiles.size(), 1, [&](int begin, int end)
+			{
+				for (int i = begin; i < end; i++)
+				{
+					int tx = phase_tiles[i] % tiles_x;
+					int ty = phase_tiles[i] / tiles_x;
+					int x0 = tx * tile_size - shift_x;
+					int y0 = ty * tile_size - shift_y;
+
+					erosion_area start = {
+						x0 > interior.x0 ? x0 : interior.x0,
+						y0 > interior.y0 ? y0 : interior.y0,
+						x0 + tile_size < interior.x1 ? x0 + tile_size : interior.x1,
+						y0 + tile_size < interior.y1 ? y0 + tile_size : interior.y1 };
+					erosion_area bounds = {
+						x0 - margin > interior.x0 ? x0 - margin : interior.x0,
+						y0 - margin > interior.y0 ? y0 - margin : interior.y0,
+						x0 + tile_size + margin < interior.x1 ? x0 + tile_size + margin : interior.x1,
+						y0 + tile_size + margin < interior.y1 ? y0 + tile_size + margin : interior.y1 };
+
+					erosion_tile_stats& ts = tile_stats[i];
+					ts.droplets = ts.steps = 0;
+					ts.eroded = ts.deposited = 0.0;
+					if (start.x0 >= start.x1 || start.y0 >= start.y1) continue;
+
+					/* Each tile gets droplets in proportion to its area */
+					double area = double(start.x1 - start.x0) * double(start.y1 - start.y0);
+					int count = (int)floor(round_droplets * area / interior_area + 0.5);
+
+					erosion_random random(params.seed
+						^ ((unsigned long long)round << 48)
+						^ ((unsigned long long)(unsigned int)ty << 24)
+						^ (unsigned long long)(unsigned int)tx);
+					runDroplets(heights, columns, params, brush, start, bounds, count, random, ts);
+				}
+			});
+
+			/* Add up in tile order so the totals do not depend on timing */
+			for (size_t i = 0; i < tile_stats.size(); i++)
+			{
+				totals.droplets += tile_stats[i].droplets;
+				totals.steps += tile_stats[i].steps;
+				totals.eroded += tile_stats[i].eroded;
+				totals.deposited += tile_stats[i].deposited;
+			}
+		}
+	}
+
+	totals.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	if (stats) *stats = totals;
+}
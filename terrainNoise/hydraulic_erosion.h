@@ -0,0 +1,65 @@
+/* hydraulic_erosion.h
+   Particle based hydraulic erosion of a height array.
+
+   Each droplet starts at a random point, runs downhill picking up sediment
+   where it speeds up and dropping it where it slows down or fills a pit,
+   and evaporates as it goes.
+
+   Droplets run in parallel by splitting the grid into square tiles and
+   running the tiles in four phases, like the squares of a checkerboard
+   taken one colour of each 2 x 2 block at a time. Tiles in the same phase
+   are a whole tile apart, and a droplet may only wander half a tile beyond
+   its own tile, so droplets running at the same time never touch the same
+   heights. Each round moves the tile grid by half a tile so that droplets
+   cross every tile border in some round.
+
+   Every tile seeds its own random numbers from the seed, the round and its
+   position, so the result only depends on the seed and the parameters, not
+   on the number of threads or the order the tiles run in.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+struct hydraulic_erosion_params
+{
+	hydraulic_erosion_params();
+
+	unsigned int droplets;		/* Total number of droplets; zero disables erosion */
+	unsigned int seed;
+	int rounds;					/* Droplets are split evenly over the rounds */
+	int tile_size;				/* Points along each side of a tile */
+	int radius;					/* Radius of the area a droplet erodes, in points */
+	int max_lifetime;			/* Most steps a droplet takes */
+	float inertia;				/* How much a droplet keeps its direction, 0 to 1 */
+	float capacity;				/* Sediment carried per unit of speed, water and drop */
+	float min_capacity;
+	float erode_speed;			/* Fraction of the spare capacity eroded per step */
+	float deposit_speed;		/* Fraction of the excess sediment dropped per step */
+	float evaporate_speed;		/* Fraction of the water lost per step */
+	float gravity;
+	float initial_speed;
+	float initial_water;
+	float cell_size;			/* Distance between points in height units */
+};
+
+struct hydraulic_erosion_stats
+{
+	unsigned long long droplets;
+	unsigned long long steps;
+	double eroded;
+	double deposited;
+	double seconds;
+
+	double dropletsPerSecond() const { return seconds > 0.0 ? droplets / seconds : 0.0; }
+};
+
+class hydraulic_erosion
+{
+public:
+	/* Erode a grid of rows * columns heights stored row by row. Fills in
+	   stats, if given, with what the droplets did and how long they took. */
+	static void run(float* heights, int columns, int rows,
+		const hydraulic_erosion_params& params, hydraulic_erosion_stats* stats = NULL);
+};
@@ -0,0 +1,419 @@
+/* job_system.cpp
+   A shared pool of worker threads used to run the noise map builders,
+   renderers and terrain stages in parallel, scheduled by work stealing.
+*/
+
+#include "job_system.h"
+#include "profiler.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#define JOB_THREAD_LOCAL __declspec(thread)
+#else
+#define JOB_THREAD_LOCAL __thread
+#endif
+
+/* The pool and deque of the calling thread, if it is one of the workers */
+static JOB_THREAD_LOCAL job_system* current_pool = NULL;
+static JOB_THREAD_LOCAL int current_worker = -1;
+
+job_system::job_system(unsigned num_threads)
+{
+	queued_items = 0;
+	queued_tasks = 0;
+	sleepers = 0;
+	stopping = false;
+	grain_scale = 1.0f;
+	resetStats();
+	startWorkers(num_threads);
+}
+
+job_system::~job_system()
+{
+	stopWorkers();
+}
+
+job_system& job_system::instance()
+{
+	static job_system pool;
+	return pool;
+}
+
+void job_system::setThreadCount(unsigned num_threads)
+{
+	stopWorkers();
+	startWorkers(num_threads);
+}
+
+unsigned job_system::getThreadCount() const
+{
+	/* The calling thread also runs work */
+	return (unsigned)workers.size() + 1;
+}
+
+void job_system::setGrainScale(float scale)
+{
+	grain_scale = scale > 0.0f ? scale : 1.0f;
+}
+
+float job_system::getGrainScale() const
+{
+	return grain_scale;
+}
+
+job_system_stats job_system::getStats() const
+{
+	job_system_stats stats;
+	stats.items = item_count;
+	stats.steals = steal_count;
+	stats.idle_seconds = idle_ns * 1e-9;
+	return stats;
+}
+
+void job_system::resetStats()
+{
+	item_count = 0;
+	steal_count = 0;
+	idle_ns = 0;
+}
+
+void job_system::startWorkers(unsigned num_threads)
+{
+	if (num_threads == 0)
+	{
+		num_threads = std::thread::hardware_concurrency();
+		if (num_threads == 0) num_threads = 1;
+	}
+
+	stopping = false;
+
+	/* Every deque must exist before the first worker looks for work */
+	worker_queues.clear();
+	for (unsigned i = 1; i < num_threads; i++)
+	{
+		worker_queues.push_back(std::unique_ptr<work_queue>(new work_queue));
+	}
+	for (unsigned i = 1; i < num_threads; i++)
+	{
+		workers.push_back(std::thread(&job_system::workerLoop, this, (int)i - 1));
+	}
+}
+
+void job_system::stopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+	workers.clear();
+}
+
+job_system::work_queue& job_system::localQueue()
+{
+	if (current_pool == this && current_worker >= 0) return *worker_queues[current_worker];
+	return shared_queue;
+}
+
+void job_system::push(work_queue& queue, std::atomic<int>& count, const work_item& item)
+{
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.items.push_back(item);
+	}
+
+	/* A sleeper counts itself before it checks the counts, and we count the
+	   item before we check for sleepers, so one of us always sees the other */
+	count++;
+	if (sleepers > 0) wakeAll();
+}
+
+bool job_system::pop(work_queue& queue, std::atomic<int>& count, bool back, work_item& item)
+{
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.items.empty()) return false;
+
+	if (back)
+	{
+		item = std::move(queue.items.back());
+		queue.items.pop_back();
+	}
+	else
+	{
+		item = std::move(queue.items.front());
+		queue.items.pop_front();
+	}
+	count--;
+	return true;
+}
+
+void job_system::wakeAll()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+	}
+	wake.notify_all();
+}
+
+/* Run one item: the newest from our own deque, otherwise the oldest from
+   another thread's, otherwise a background task if background is set */
+bool job_system::tryRun(bool background)
+{
+	int self = (current_pool == this) ? current_worker : -1;
+	int num_queues = (int)worker_queues.size();
+	work_item item;
+
+	if (pop(localQueue(), queued_items, true, item))
+	{
+		item();
+		return true;
+	}
+
+	bool found = self >= 0 && pop(shared_queue, queued_items, false, item);
+	for (int i = 1; !found && i <= num_queues; i++)
+	{
+		int victim = (self + i) % num_queues;
+		if (victim != self) found = pop(*worker_queues[victim], queued_items, false, item);
+	}
+	if (found)
+	{
+		steal_count++;
+		PROFILE_SCOPE("job_system::steal");
+		item();
+		return true;
+	}
+
+	if (background && pop(task_queue, queued_tasks, false, item))
+	{
+		item();
+		return true;
+	}
+	return false;
+}
+
+/* Sleep until there may be work for us or finished returns true. Returns
+   false if the pool is stopping. */
+bool job_system::waitForWork(const std::function<bool()>& finished, bool background)
+{
+	long long idle_start = profiler::now();
+	bool waited = false;
+	bool running;
+
+	sleepers++;
+	{
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		while (!stopping && !finished() && queued_items == 0 && (!background || queued_tasks == 0))
+		{
+			wake.wait(lock);
+			waited = true;
+		}
+		running = !stopping;
+	}
+	sleepers--;
+
+	if (waited)
+	{
+		long long idle_end = profiler::now();
+		idle_ns += idle_end - idle_start;
+		profiler::record("job_system::idle", idle_start, idle_end, 0, NULL);
+	}
+	return running;
+}
+
+void job_system::helpUntil(const std::function<bool()>& finished, bool background)
+{
+	while (!finished())
+	{
+		if (!tryRun(background)) waitForWork(finished, background);
+	}
+}
+
+void job_system::workerLoop(int index)
+{
+	current_pool = this;
+	current_worker = index;
+
+	std::function<bool()> never = []() { return false; };
+	for (;;)
+	{
+		if (tryRun(true)) continue;
+		if (!waitForWork(never, true)) return;
+	}
+}
+
+/* Leave the upper half of the chunks for other threads until one chunk is
+   left, then run it. Halves left behind are split the same way by whoever
+   takes them, so a thread that steals takes a large piece at once. */
+void job_system::runChunks(batch* b, int first, int last)
+{
+	work_queue& queue = localQueue();
+	while (last - first > 1)
+	{
+		int middle = first + (last - first) / 2;
+		push(queue, queued_items, [this, b, middle, last]() { runChunks(b, middle, last); });
+		last = middle;
+	}
+
+	try
+	{
+		PROFILE_SCOPE("job_system::chunk");
+		(*b->run_chunk)(first);
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(b->error_mutex);
+		if (!b->error) b->error = std::current_exception();
+	}
+	item_count++;
+
+	/* The batch may be gone as soon as remaining reaches zero */
+	if (--b->remaining == 0) wakeAll();
+}
+
+void job_system::run(int num_chunks, const std::function<void(int)>& run_chunk)
+{
+	if (num_chunks <= 0) return;
+
+	/* Nothing to share, so skip the hand-off to the workers */
+	if (num_chunks == 1 || workers.empty())
+	{
+		for (int i = 0; i < num_chunks; i++) run_chunk(i);
+		return;
+	}
+
+	batch b;
+	b.run_chunk = &run_chunk;
+	b.remaining = num_chunks;
+	runChunks(&b, 0, num_chunks);
+
+	/* Help with any work but background tasks until the last chunk is done */
+	helpUntil([&b]() { return b.remaining == 0; }, false);
+
+	if (b.error) std::rethrow_exception(b.error);
+}
+
+int job_system::scaleGrain(int grain) const
+{
+	int scaled = (int)(grain * grain_scale + 0.5f);
+	return scaled < 1 ? 1 : scaled;
+}
+
+void job_system::parallel_for(int begin, int end, int grain,
+	const std::function<void(int, int)>& body)
+{
+	if (end <= begin) return;
+	grain = scaleGrain(grain);
+
+	int num_chunks = (end - begin + grain - 1) / grain;
+	run(num_chunks, [&](int chunk)
+	{
+		int chunk_begin = begin + chunk * grain;
+		body(chunk_begin, std::min(chunk_begin + grain, end));
+	});
+}
+
+void job_system::parallel_for_tiles(int width, int height, int tile_width, int tile_height,
+	const std::function<void(int, int, int, int)>& body)
+{
+	if (width <= 0 || height <= 0) return;
+	if (tile_width < 1) tile_width = 1;
+	if (tile_height < 1) tile_height = 1;
+
+	/* Callers may rely on the tile size and alignment, so the grain scale
+	   changes how many tiles make up a chunk rather than the tiles */
+	int tiles_x = (width + tile_width - 1) / tile_width;
+	int tiles_y = (height + tile_height - 1) / tile_height;
+	int num_tiles = tiles_x * tiles_y;
+	int tiles_per_chunk = scaleGrain(1);
+	run((num_tiles + tiles_per_chunk - 1) / tiles_per_chunk, [&](int chunk)
+	{
+		int last = std::min((chunk + 1) * tiles_per_chunk, num_tiles);
+		for (int tile = chunk * tiles_per_chunk; tile < last; tile++)
+		{
+			int x0 = (tile % tiles_x) * tile_width;
+			int y0 = (tile / tiles_x) * tile_height;
+			body(x0, y0, std::min(x0 + tile_width, width), std::min(y0 + tile_height, height));
+		}
+	});
+}
+
+job_handle job_system::submit(const std::function<void()>& fn, const std::vector<job_handle>& after)
+{
+	job_handle task = std::make_shared<job_task>();
+	task->run = fn;
+	task->done = false;
+
+	/* Hold one count ourselves so that the task cannot be scheduled before
+	   every dependency has been seen */
+	task->waiting = 1;
+	for (size_t i = 0; i < after.size(); i++)
+	{
+		job_task* before = after[i].get();
+		if (!before) continue;
+
+		std::lock_guard<std::mutex> lock(before->mutex);
+		if (!before->done)
+		{
+			task->waiting++;
+			before->followers.push_back(task);
+		}
+	}
+	if (--task->waiting == 0) schedule(task);
+	return task;
+}
+
+void job_system::schedule(const job_handle& task)
+{
+	push(task_queue, queued_tasks, [this, task]() { runTask(task); });
+}
+
+/* Run the task and then, in place of queueing it, the first follower it
+   makes ready, so that a chain of tasks on the same data stays on one
+   thread while the data is in its cache */
+void job_system::runTask(const job_handle& first)
+{
+	job_handle task = first;
+	while (task)
+	{
+		try
+		{
+			PROFILE_SCOPE("job_system::task");
+			task->run();
+		}
+		catch (...)
+		{
+			task->error = std::current_exception();
+		}
+		task->run = std::function<void()>();
+		item_count++;
+
+		std::vector<job_handle> followers;
+		{
+			std::lock_guard<std::mutex> lock(task->mutex);
+			task->done = true;
+			followers.swap(task->followers);
+		}
+
+		job_handle next;
+		for (size_t i = 0; i < followers.size(); i++)
+		{
+			if (--followers[i]->waiting != 0) continue;
+			if (next) schedule(followers[i]);
+			else next = followers[i];
+		}
+		wakeAll();
+		task = next;
+	}
+}
+
+void job_system::wait(const job_handle& task)
+{
+	if (!task) return;
+
+	helpUntil([&task]() { return task->done == true; }, true);
+	if (task->error) std::rethrow_exception(task->error);
+}
@@ -0,0 +1,160 @@
+/* job_system.h
+   A shared pool of worker threads used to run the noise map builders,
+   renderers and terrain stages in parallel.
+   Every stage submits its work to the single pool returned by
+   job_system::instance() so that stages never oversubscribe the cores.
+
+   Work is scheduled by work stealing. Each worker has its own deque: it
+   pushes and pops work at the back, so it keeps working on what it split
+   most recently while that is still in cache, and idle threads steal from
+   the front, which holds the largest pieces. parallel_for hands out its
+   range by halving it, so a range is only split as far as there are idle
+   threads to take the halves.
+
+   Tasks, such as the stages of a terrain tile or writing files, are
+   submitted with the tasks they must follow and are run by the workers in
+   the background. A thread that finishes a task goes straight on to the
+   first follower it made ready. A parallel_for never runs tasks while it
+   waits, so background work cannot hold up a stage.
+
+   The profiler records the time each thread spends idle as
+   job_system::idle and every piece of work run by a thread that stole it
+   as job_system::steal. getStats returns the same totals.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A task submitted to the pool, which can be waited on or followed */
+struct job_task
+{
+	std::function<void()> run;
+	std::atomic<int> waiting;
+	std::atomic<bool> done;
+	std::mutex mutex;
+	std::vector<std::shared_ptr<job_task> > followers;
+	std::exception_ptr error;
+};
+
+typedef std::shared_ptr<job_task> job_handle;
+
+/* Totals since the pool started or resetStats was called */
+struct job_system_stats
+{
+	unsigned long long items;
+	unsigned long long steals;
+	double idle_seconds;
+};
+
+class job_system
+{
+public:
+	/* num_threads is the total number of threads that run work, including
+	   the thread that calls parallel_for. Zero selects one per core. */
+	explicit job_system(unsigned num_threads = 0);
+	~job_system();
+
+	/* The pool shared by the whole application */
+	static job_system& instance();
+
+	/* Restart the pool with a different number of threads. No work may be
+	   running or queued. */
+	void setThreadCount(unsigned num_threads);
+	unsigned getThreadCount() const;
+
+	/* Multiply the grain of every parallel_for, to trade load balance
+	   against scheduling overhead without changing each stage */
+	void setGrainScale(float scale);
+	float getGrainScale() const;
+
+	/* Split [begin, end) into chunks of at most grain items and call
+	   body(chunk_begin, chunk_end) for each chunk. Returns once every chunk
+	   has run. The calling thread runs chunks too, so parallel_for can be
+	   nested inside another parallel_for or a task. The grain is scaled by
+	   setGrainScale, so a body must not rely on the size of its chunk or
+	   on where it starts. */
+	void parallel_for(int begin, int end, int grain,
+		const std::function<void(int, int)>& body);
+
+	/* Split a width x height grid into tiles and call
+	   body(x0, y0, x1, y1) for each tile, where (x1, y1) is exclusive. */
+	void parallel_for_tiles(int width, int height, int tile_width, int tile_height,
+		const std::function<void(int, int, int, int)>& body);
+
+	/* Run fn in the background once every task in after has finished.
+	   With no workers it runs when it is waited on. */
+	job_handle submit(const std::function<void()>& fn,
+		const std::vector<job_handle>& after = std::vector<job_handle>());
+
+	/* Help run work until the task has finished, then rethrow anything
+	   it threw */
+	void wait(const job_handle& task);
+
+	job_system_stats getStats() const;
+	void resetStats();
+
+private:
+	typedef std::function<void()> work_item;
+
+	/* A deque of work owned by one thread */
+	struct work_queue
+	{
+		std::mutex mutex;
+		std::deque<work_item> items;
+	};
+
+	/* One call to parallel_for */
+	struct batch
+	{
+		const std::function<void(int)>* run_chunk;
+		std::atomic<int> remaining;
+		std::mutex error_mutex;
+		std::exception_ptr error;
+	};
+
+	void startWorkers(unsigned num_threads);
+	void stopWorkers();
+	void workerLoop(int index);
+	void run(int num_chunks, const std::function<void(int)>& run_chunk);
+	void runChunks(batch* b, int first, int last);
+	void runTask(const job_handle& task);
+	void schedule(const job_handle& task);
+	work_queue& localQueue();
+	int scaleGrain(int grain) const;
+	void push(work_queue& queue, std::atomic<int>& count, const work_item& item);
+	bool pop(work_queue& queue, std::atomic<int>& count, bool back, work_item& item);
+	bool tryRun(bool background);
+	void helpUntil(const std::function<bool()>& finished, bool background);
+	bool waitForWork(const std::function<bool()>& finished, bool background);
+	void wakeAll();
+
+	std::vector<std::thread> workers;
+
+	/* One deque per worker, one shared by every thread outside the pool and
+	   one for the background tasks. The counts say how many items the
+	   deques hold, so that idle threads know when to look again. */
+	std::vector<std::unique_ptr<work_queue> > worker_queues;
+	work_queue shared_queue;
+	work_queue task_queue;
+	std::atomic<int> queued_items;
+	std::atomic<int> queued_tasks;
+
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	std::atomic<int> sleepers;
+	bool stopping;
+	float grain_scale;
+
+	std::atomic<unsigned long long> item_count;
+	std::atomic<unsigned long long> steal_count;
+	std::atomic<long long> idle_ns;
+};
@@ -0,0 +1,208 @@
+/* mapped_file.cpp
+   A file mapped into memory, used to write large height maps straight to
+   disk without holding a second copy of them in memory, and to read saved
+   terrain without parsing it.
+*/
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file()
+{
+	data = NULL;
+	size = 0;
+	writable = false;
+#ifdef _WIN32
+	file_handle = INVALID_HANDLE_VALUE;
+	mapping_handle = NULL;
+#else
+	file_descriptor = -1;
+#endif
+}
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+unsigned char* mapped_file::create(const char* filename, size_t file_size)
+{
+	close();
+
+	file_handle = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE) return NULL;
+
+	/* An empty file cannot be mapped, but there is nothing to write either */
+	if (file_size == 0)
+	{
+		close();
+		return NULL;
+	}
+
+	unsigned long long size64 = file_size;
+	mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READWRITE,
+		(DWORD)(size64 >> 32), (DWORD)(size64 & 0xffffffff), NULL);
+	if (mapping_handle == NULL)
+	{
+		close();
+		return NULL;
+	}
+
+	data = (unsigned char*)MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, file_size);
+	if (data == NULL)
+	{
+		close();
+		return NULL;
+	}
+
+	size = file_size;
+	writable = true;
+	return data;
+}
+
+const unsigned char* mapped_file::open(const char* filename)
+{
+	close();
+
+	file_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE) return NULL;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0
+		|| (unsigned long long)file_size.QuadPart > (size_t)-1)
+	{
+		close();
+		return NULL;
+	}
+
+	mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping_handle == NULL)
+	{
+		close();
+		return NULL;
+	}
+
+	data = (unsigned char*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL)
+	{
+		close();
+		return NULL;
+	}
+
+	size = (size_t)file_size.QuadPart;
+	writable = false;
+	return data;
+}
+
+bool mapped_file::close()
+{
+	bool flushed = true;
+	if (data)
+	{
+		if (writable) flushed = FlushViewOfFile(data, 0) != 0;
+		UnmapViewOfFile(data);
+		data = NULL;
+	}
+	if (mapping_handle)
+	{
+		CloseHandle(mapping_handle);
+		mapping_handle = NULL;
+	}
+	if (file_handle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file_handle);
+		file_handle = INVALID_HANDLE_VALUE;
+	}
+	size = 0;
+	return flushed;
+}
+
+#else
+
+unsigned char* mapped_file::create(const char* filename, size_t file_size)
+{
+	close();
+
+	file_descriptor = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file_descriptor < 0) return NULL;
+
+	/* An empty file cannot be mapped, but there is nothing to write either */
+	if (file_size == 0 || ftruncate(file_descriptor, (off_t)file_size) != 0)
+	{
+		close();
+		return NULL;
+	}
+
+	void* mapping = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close();
+		return NULL;
+	}
+
+	data = (unsigned char*)mapping;
+	size = file_size;
+	writable = true;
+	return data;
+}
+
+const unsigned char* mapped_file::open(const char* filename)
+{
+	close();
+
+	file_descriptor = ::open(filename, O_RDONLY);
+	if (file_descriptor < 0) return NULL;
+
+	struct stat file_stat;
+	if (fstat(file_descriptor, &file_stat) != 0 || file_stat.st_size <= 0)
+	{
+		close();
+		return NULL;
+	}
+
+	void* mapping = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close();
+		return NULL;
+	}
+
+	data = (unsigned char*)mapping;
+	size = (size_t)file_stat.st_size;
+	writable = false;
+	return data;
+}
+
+bool mapped_file::close()
+{
+	bool flushed = true;
+	if (data)
+	{
+		if (writable) flushed = msync(data, size, MS_SYNC) == 0;
+		munmap(data, size);
+		data = NULL;
+	}
+	if (file_descriptor >= 0)
+	{
+		::close(file_descriptor);
+		file_descriptor = -1;
+	}
+	size = 0;
+	return flushed;
+}
+
+#endif
@@ -0,0 +1,47 @@
+/* mapped_file.h
+   A file mapped into memory, used to write large height maps straight to
+   disk without holding a second copy of them in memory, and to read saved
+   terrain without parsing it.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+class mapped_file
+{
+public:
+	mapped_file();
+	~mapped_file();
+
+	/* Create the file (replacing any existing file) with the given size in
+	   bytes and map it for writing. Returns NULL if the file could not be
+	   created or mapped. */
+	unsigned char* create(const char* filename, size_t size);
+
+	/* Map an existing file for reading. Returns NULL if the file could not
+	   be opened or mapped, or is empty. The data must not be written. */
+	const unsigned char* open(const char* filename);
+
+	/* Unmap the file, flushing the written pages to disk.
+	   Returns false if the flush failed. */
+	bool close();
+
+	unsigned char* getData() const { return data; }
+	size_t getSize() const { return size; }
+
+private:
+	/* Not copyable, as the mapping is released by the destructor */
+	mapped_file(const mapped_file&);
+	mapped_file& operator=(const mapped_file&);
+
+	unsigned char* data;
+	size_t size;
+	bool writable;
+#ifdef _WIN32
+	void* file_handle;
+	void* mapping_handle;
+#else
+	int file_descriptor;
+#endif
+};
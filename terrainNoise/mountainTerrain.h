@@ -1,14 +0,0 @@
-#pragma once
-
-#include <noise/noise.h>
-#include <glm/gtc/noise.hpp>
-#include "noiseutils.h"
-
-class mountainTerrain
-{
-public:
-	mountainTerrain();
-	noise::utils::NoiseMap generateMountainHeightMap();
-	~mountainTerrain();
-};
-
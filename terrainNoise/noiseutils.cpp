@@ -20,12 +20,19 @@
 // off every 'zig'.)
 //
 
+#include <atomic>
 #include <fstream>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
 
 #include <noise/interp.h>
 #include <noise/mathconsts.h>
 
 #include "noiseutils.h"
+#include "job_system.h"
+#include "mapped_file.h"
+#include "profiler.h"
 
 using namespace noise;
 using namespace noise::model;
@@ -34,6 +41,13 @@ using namespace noise::module;
 // Bitmap header size.
 const int BMP_HEADER_SIZE = 54;
 
+// Terragen terrain header size.
+const int TER_HEADER_SIZE = 64;
+
+// Number of lines that the writers convert as one job on the shared worker
+// pool.
+const int WRITE_LINE_GRAIN = 64;
+
 // Direction of the light source, in compass degrees (0 = north, 90 = east,
 // 180 = south, 270 = east)
 const double DEFAULT_LIGHT_AZIMUTH = 45.0;
@@ -45,6 +59,11 @@ const double DEFAULT_LIGHT_CONTRAST  =  1.0;
 // horizon, 90 = directly overhead)
 const double DEFAULT_LIGHT_ELEVATION = 45.0;
 
+// Size of the tiles that the renderers split an image into.  Each tile is
+// rendered as one job on the shared worker pool.
+const int RENDER_TILE_WIDTH  = 256;
+const int RENDER_TILE_HEIGHT = 32;
+
 //////////////////////////////////////////////////////////////////////////////
 // Miscellaneous functions
 
@@ -54,6 +73,16 @@ namespace noise
   namespace utils
   {
 
+    // Calculates the intensity of the light given the elevations of the four
+    // neighbors of a point and the light factors calculated by
+    // RendererImage::CalcLightFactors().
+    inline double CalcLightIntensity (double io, double ix, double iy,
+      double left, double right, double down, double up)
+    {
+      double intensity = (ix * (left - right) + iy * (down - up) + io);
+      return (intensity < 0.0)? 0.0: intensity;
+    }
+
     // Performs linear interpolation between two 8-bit channel values.
     inline noise::uint8 BlendChannel (const uint8 channel0,
       const uint8 channel1, float alpha)
@@ -107,6 +136,72 @@ namespace noise
       return bytes;
     }
 
+    // Converts one line of an image into 24-bit BGR pixels.  The color
+    // channels are stored as alpha, blue, green, red, so on Intel machines a
+    // pixel loaded as a 32-bit integer holds BGR in its upper three bytes.
+    // Four pixels are packed into three 32-bit words at a time.
+    inline void PackBGRLine (noise::uint8* pDest, const Color* pSource,
+      int width)
+    {
+      int x = 0;
+      for (; x + 4 <= width; x += 4) {
+        noise::uint32 p[4];
+        memcpy (p, pSource + x, sizeof (p));
+        noise::uint32 w[3];
+        w[0] = (p[0] >>  8) | (p[1] >>  8 << 24);
+        w[1] = (p[1] >> 16) | (p[2] >>  8 << 16);
+        w[2] = (p[2] >> 24) | (p[3] & 0xffffff00);
+        memcpy (pDest, w, sizeof (w));
+        pDest += sizeof (w);
+      }
+      for (; x < width; x++) {
+        *pDest++ = pSource[x].blue ;
+        *pDest++ = pSource[x].green;
+        *pDest++ = pSource[x].red  ;
+      }
+    }
+
+    // Converts a height value to an unsigned 16-bit integer.  A normalized
+    // value is scaled from the 0.0 to 1.0 range, any other value is clamped
+    // to the 0 to 65535 range.
+    inline noise::uint16 QuantizeUint16 (float value, bool isNormalized)
+    {
+      if (isNormalized) {
+        value *= 65535.0f;
+      }
+      value = GetMin (GetMax (value, 0.0f), 65535.0f);
+      return (noise::uint16)(value + 0.5f);
+    }
+
+    // Formats the text header of a portable graymap or floatmap and returns
+    // its length.  The last field is the maximum value of a graymap or the
+    // scale of a floatmap.  The header buffer must hold at least 64
+    // characters.
+    inline int FormatNetpbmHeader (char* header, const char* magic,
+      int width, int height, const char* lastField)
+    {
+      return sprintf (header, "%s\n%d %d\n%s\n", magic, width, height,
+        lastField);
+    }
+
+    // Writes a memory buffer to a file with a single call.
+    void WriteBufferToFile (const std::string& filename,
+      const noise::uint8* pBuffer, size_t bufferSize)
+    {
+      std::ofstream os;
+      os.open (filename.c_str (), std::ios::out | std::ios::binary);
+      if (os.fail () || os.bad ()) {
+        throw noise::ExceptionUnknown ();
+      }
+      os.write ((const char*)pBuffer, (std::streamsize)bufferSize);
+      if (os.fail () || os.bad ()) {
+        os.clear ();
+        os.close ();
+        throw noise::ExceptionUnknown ();
+      }
+      os.close ();
+    }
+
   }
 
 }
@@ -115,17 +210,66 @@ using namespace noise;
 
 using namespace noise::utils;
 
+//////////////////////////////////////////////////////////////////////////////
+// Buffer allocation
+
+// The allocator set with SetBufferAllocator(), or NULL for the heap.
+static std::atomic<BufferAllocator*> g_pBufferAllocator (NULL);
+
+void noise::utils::SetBufferAllocator (BufferAllocator* pAllocator)
+{
+  g_pBufferAllocator = pAllocator;
+}
+
+BufferAllocator* noise::utils::GetBufferAllocator ()
+{
+  return g_pBufferAllocator;
+}
+
+void* noise::utils::AllocateBuffer (size_t size, BufferAllocator*& pAllocator)
+{
+  pAllocator = g_pBufferAllocator;
+  if (pAllocator != NULL) {
+    return pAllocator->Allocate (size);
+  }
+  try {
+    return ::operator new (size);
+  }
+  catch (...) {
+    throw noise::ExceptionOutOfMemory ();
+  }
+}
+
+void noise::utils::FreeBuffer (void* pBuffer, BufferAllocator* pAllocator)
+{
+  if (pBuffer == NULL) {
+    return;
+  }
+  if (pAllocator != NULL) {
+    pAllocator->Free (pBuffer);
+  } else {
+    ::operator delete (pBuffer);
+  }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // GradientColor class
 
 GradientColor::GradientColor ()
 {
-  m_pGradientPoints = NULL;
+  m_pGradientPoints    = NULL;
+  m_gradientPointCount = 0;
+  m_isLookupTableValid = false;
+  m_lookupMinPos       = 0.0;
+  m_lookupScale        = 0.0;
+  m_lookupTableSize    = DEFAULT_GRADIENT_LOOKUP_SIZE;
+  m_pLookupTable       = NULL;
 }
 
 GradientColor::~GradientColor ()
 {
   delete[] m_pGradientPoints;
+  delete[] m_pLookupTable;
 }
 
 void GradientColor::AddGradientPoint (double gradientPos,
@@ -136,6 +280,37 @@ void GradientColor::AddGradientPoint (double gradientPos,
   // remain sorted by gradient position.
   int insertionPos = FindInsertionPos (gradientPos);
   InsertAtPos (insertionPos, gradientPos, gradientColor);
+  m_isLookupTableValid = false;
+}
+
+void GradientColor::BuildLookupTable ()
+{
+  if (m_gradientPointCount < 2) {
+    throw noise::ExceptionInvalidParam ();
+  }
+
+  // The table buffer is only allocated on the first build, or after the
+  // table size has changed.
+  if (m_pLookupTable == NULL) {
+    try {
+      m_pLookupTable = new Color[m_lookupTableSize];
+    }
+    catch (...) {
+      throw noise::ExceptionOutOfMemory ();
+    }
+  }
+
+  // Sample the gradient at evenly-spaced positions so that the first and
+  // last entries land exactly on the first and last gradient points.
+  double minPos = m_pGradientPoints[0].pos;
+  double maxPos = m_pGradientPoints[m_gradientPointCount - 1].pos;
+  double step = (maxPos - minPos) / (double)(m_lookupTableSize - 1);
+  for (int i = 0; i < m_lookupTableSize; i++) {
+    m_pLookupTable[i] = GetColor (minPos + step * (double)i);
+  }
+  m_lookupMinPos = minPos;
+  m_lookupScale  = 1.0 / step;
+  m_isLookupTableValid = true;
 }
 
 void GradientColor::Clear ()
@@ -143,6 +318,7 @@ void GradientColor::Clear ()
   delete[] m_pGradientPoints;
   m_pGradientPoints = NULL;
   m_gradientPointCount = 0;
+  m_isLookupTableValid = false;
 }
 
 int GradientColor::FindInsertionPos (double gradientPos)
@@ -163,7 +339,7 @@ int GradientColor::FindInsertionPos (double gradientPos)
   return insertionPos;
 }
 
-const Color& GradientColor::GetColor (double gradientPos) const
+Color GradientColor::GetColor (double gradientPos) const
 {
   assert (m_gradientPointCount >= 2);
 
@@ -187,8 +363,7 @@ const Color& GradientColor::GetColor (double gradientPos) const
   // the corresponding gradient color of the nearest gradient point and exit
   // now.
   if (index0 == index1) {
-    m_workingColor = m_pGradientPoints[index1].color;
-    return m_workingColor;
+    return m_pGradientPoints[index1].color;
   }
   
   // Compute the alpha value used for linear interpolation.
@@ -199,8 +374,9 @@ const Color& GradientColor::GetColor (double gradientPos) const
   // Now perform the linear interpolation given the alpha value.
   const Color& color0 = m_pGradientPoints[index0].color;
   const Color& color1 = m_pGradientPoints[index1].color;
-  LinearInterpColor (color0, color1, (float)alpha, m_workingColor);
-  return m_workingColor;
+  Color color;
+  LinearInterpColor (color0, color1, (float)alpha, color);
+  return color;
 }
 
 void GradientColor::InsertAtPos (int insertionPos, double gradientPos,
@@ -229,6 +405,19 @@ void GradientColor::InsertAtPos (int insertionPos, double gradientPos,
   m_pGradientPoints[insertionPos].color = gradientColor;
 }
 
+void GradientColor::SetLookupTableSize (int lookupTableSize)
+{
+  if (lookupTableSize < 2) {
+    throw noise::ExceptionInvalidParam ();
+  }
+  if (lookupTableSize != m_lookupTableSize) {
+    delete[] m_pLookupTable;
+    m_pLookupTable = NULL;
+    m_lookupTableSize = lookupTableSize;
+    m_isLookupTableValid = false;
+  }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // NoiseMap class
 
@@ -251,7 +440,7 @@ NoiseMap::NoiseMap (const NoiseMap& rhs)
 
 NoiseMap::~NoiseMap ()
 {
-  delete[] m_pNoiseMap;
+  FreeBuffer (m_pNoiseMap, m_pAllocator);
 }
 
 NoiseMap& NoiseMap::operator= (const NoiseMap& rhs)
@@ -290,7 +479,7 @@ void NoiseMap::CopyNoiseMap (const NoiseMap& source)
 
 void NoiseMap::DeleteNoiseMapAndReset ()
 {
-  delete[] m_pNoiseMap;
+  FreeBuffer (m_pNoiseMap, m_pAllocator);
   InitObj ();
 }
 
@@ -308,6 +497,7 @@ float NoiseMap::GetValue (int x, int y) const
 
 void NoiseMap::InitObj ()
 {
+  m_pAllocator = NULL;
   m_pNoiseMap = NULL;
   m_height    = 0;
   m_width     = 0;
@@ -322,15 +512,12 @@ void NoiseMap::ReclaimMem ()
   if (m_memUsed > newMemUsage) {
     // There is wasted memory.  Create the smallest buffer that can fit the
     // data and copy the data to it.
-    float* pNewNoiseMap = NULL;
-    try {
-      pNewNoiseMap = new float[newMemUsage];
-    }
-    catch (...) {
-      throw noise::ExceptionOutOfMemory ();
-    }
+    BufferAllocator* pNewAllocator;
+    float* pNewNoiseMap = (float*)AllocateBuffer (newMemUsage * sizeof (float),
+      pNewAllocator);
     memcpy (pNewNoiseMap, m_pNoiseMap, newMemUsage * sizeof (float));
-    delete[] m_pNoiseMap;
+    FreeBuffer (m_pNoiseMap, m_pAllocator);
+    m_pAllocator = pNewAllocator;
     m_pNoiseMap = pNewNoiseMap;
     m_memUsed = newMemUsage;
   }
@@ -355,12 +542,8 @@ void NoiseMap::SetSize (int width, int height)
       // The new size is too big for the current noise map buffer.  We need to
       // reallocate.
       DeleteNoiseMapAndReset ();
-      try {
-        m_pNoiseMap = new float[newMemUsage];
-      }
-      catch (...) {
-        throw noise::ExceptionOutOfMemory ();
-      }
+      m_pNoiseMap = (float*)AllocateBuffer (newMemUsage * sizeof (float),
+        m_pAllocator);
       m_memUsed = newMemUsage;
     }
     m_stride = (int)CalcStride (width);
@@ -382,7 +565,8 @@ void NoiseMap::TakeOwnership (NoiseMap& source)
 {
   // Copy the values and the noise map buffer from the source noise map to
   // this noise map.  Now this noise map pwnz the source buffer.
-  delete[] m_pNoiseMap;
+  FreeBuffer (m_pNoiseMap, m_pAllocator);
+  m_pAllocator = source.m_pAllocator;
   m_memUsed   = source.m_memUsed;
   m_height    = source.m_height;
   m_pNoiseMap = source.m_pNoiseMap;
@@ -394,6 +578,202 @@ void NoiseMap::TakeOwnership (NoiseMap& source)
   source.InitObj ();
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// NoiseMapPyramid class
+
+NoiseMapPyramid::NoiseMapPyramid ():
+  m_levelCount (0),
+  m_pAverageLevels (NULL),
+  m_pMaxLevels (NULL),
+  m_pMinLevels (NULL)
+{
+}
+
+NoiseMapPyramid::~NoiseMapPyramid ()
+{
+  Clear ();
+}
+
+void NoiseMapPyramid::Build (const NoiseMap& sourceNoiseMap)
+{
+  int width  = sourceNoiseMap.GetWidth  ();
+  int height = sourceNoiseMap.GetHeight ();
+  if (width <= 0 || height <= 0) {
+    throw noise::ExceptionInvalidParam ();
+  }
+
+  PROFILE_SCOPE_NAMED (scope, "NoiseMapPyramid::Build");
+  scope.setCount ((unsigned long long)width * height, "points");
+
+  // Halve the size, rounding up, until a single point is left.
+  int levelCount = 1;
+  for (int w = width, h = height; w > 1 || h > 1; levelCount++) {
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+  }
+
+  Clear ();
+  try {
+    m_pAverageLevels = new NoiseMap[levelCount];
+    m_pMaxLevels     = new NoiseMap[levelCount];
+    m_pMinLevels     = new NoiseMap[levelCount];
+  }
+  catch (...) {
+    Clear ();
+    throw noise::ExceptionOutOfMemory ();
+  }
+  m_levelCount = levelCount;
+
+  try {
+    m_pAverageLevels[0].SetSize (width, height);
+    for (int level = 1, w = width, h = height; level < levelCount; level++) {
+      w = (w + 1) / 2;
+      h = (h + 1) / 2;
+      m_pAverageLevels[level].SetSize (w, h);
+      m_pMaxLevels[level].SetSize (w, h);
+      m_pMinLevels[level].SetSize (w, h);
+    }
+  }
+  catch (...) {
+    Clear ();
+    throw;
+  }
+
+  // The levels that fit inside one tile.  A tile's points in these levels
+  // only depend on the tile's own source points, because the tile size is
+  // a power of two and the tiles are aligned to it.
+  int tileLevels = 0;
+  while ((1 << tileLevels) < PYRAMID_TILE_SIZE) {
+    tileLevels++;
+  }
+  if (tileLevels > levelCount - 1) {
+    tileLevels = levelCount - 1;
+  }
+
+  NoiseMap& base = m_pAverageLevels[0];
+  job_system::instance ().parallel_for_tiles (width, height,
+    PYRAMID_TILE_SIZE, PYRAMID_TILE_SIZE,
+    [&] (int x0, int y0, int x1, int y1) {
+      for (int y = y0; y < y1; y++) {
+        memcpy (base.GetSlabPtr (x0, y), sourceNoiseMap.GetConstSlabPtr (x0, y),
+          (size_t)(x1 - x0) * sizeof (float));
+      }
+      for (int level = 1; level <= tileLevels; level++) {
+        int mask = (1 << level) - 1;
+        BuildLevelRegion (level, x0 >> level, y0 >> level,
+          (x1 + mask) >> level, (y1 + mask) >> level);
+      }
+    });
+
+  // The remaining levels are at most 1 / PYRAMID_TILE_SIZE of the size of
+  // the source noise map in each direction.
+  for (int level = tileLevels + 1; level < levelCount; level++) {
+    int levelWidth = m_pAverageLevels[level].GetWidth ();
+    job_system::instance ().parallel_for (0,
+      m_pAverageLevels[level].GetHeight (), PYRAMID_TILE_SIZE,
+      [&] (int rowBegin, int rowEnd) {
+        BuildLevelRegion (level, 0, rowBegin, levelWidth, rowEnd);
+      });
+  }
+}
+
+void NoiseMapPyramid::BuildLevelRegion (int level, int x0, int y0, int x1,
+  int y1)
+{
+  const NoiseMap& srcAverage = m_pAverageLevels[level - 1];
+  const NoiseMap& srcMin = GetMinLevel (level - 1);
+  const NoiseMap& srcMax = GetMaxLevel (level - 1);
+  NoiseMap& destAverage = m_pAverageLevels[level];
+  NoiseMap& destMin = m_pMinLevels[level];
+  NoiseMap& destMax = m_pMaxLevels[level];
+  int srcWidth  = srcAverage.GetWidth  ();
+  int srcHeight = srcAverage.GetHeight ();
+
+  for (int y = y0; y < y1; y++) {
+    // Points on the right and upper edges of a level with an odd size
+    // cover a single row or column of the level below.
+    int srcY0 = y * 2;
+    int srcY1 = (srcY0 + 1 < srcHeight) ? srcY0 + 1: srcY0;
+    const float* pAverage0 = srcAverage.GetConstSlabPtr (srcY0);
+    const float* pAverage1 = srcAverage.GetConstSlabPtr (srcY1);
+    const float* pMin0 = srcMin.GetConstSlabPtr (srcY0);
+    const float* pMin1 = srcMin.GetConstSlabPtr (srcY1);
+    const float* pMax0 = srcMax.GetConstSlabPtr (srcY0);
+    const float* pMax1 = srcMax.GetConstSlabPtr (srcY1);
+    float* pDestAverage = destAverage.GetSlabPtr (y);
+    float* pDestMin = destMin.GetSlabPtr (y);
+    float* pDestMax = destMax.GetSlabPtr (y);
+    int rowCount = srcY1 - srcY0 + 1;
+
+    for (int x = x0; x < x1; x++) {
+      int srcX0 = x * 2;
+      int srcX1 = (srcX0 + 1 < srcWidth) ? srcX0 + 1: srcX0;
+      int count = rowCount * (srcX1 - srcX0 + 1);
+
+      // Repeating a row or column on an edge leaves the minimum and
+      // maximum unchanged, so only the average needs the true count.
+      float sum = pAverage0[srcX0];
+      if (srcX1 != srcX0) sum += pAverage0[srcX1];
+      if (srcY1 != srcY0) {
+        sum += pAverage1[srcX0];
+        if (srcX1 != srcX0) sum += pAverage1[srcX1];
+      }
+      pDestAverage[x] = sum / (float)count;
+      pDestMin[x] = GetMin (GetMin (pMin0[srcX0], pMin0[srcX1]),
+        GetMin (pMin1[srcX0], pMin1[srcX1]));
+      pDestMax[x] = GetMax (GetMax (pMax0[srcX0], pMax0[srcX1]),
+        GetMax (pMax1[srcX0], pMax1[srcX1]));
+    }
+  }
+}
+
+void NoiseMapPyramid::Clear ()
+{
+  delete[] m_pAverageLevels;
+  delete[] m_pMaxLevels;
+  delete[] m_pMinLevels;
+  m_pAverageLevels = NULL;
+  m_pMaxLevels     = NULL;
+  m_pMinLevels     = NULL;
+  m_levelCount = 0;
+}
+
+void NoiseMapPyramid::GetRegionMinMax (int x0, int y0, int x1, int y1,
+  float& minValue, float& maxValue) const
+{
+  if (m_levelCount == 0) {
+    throw noise::ExceptionInvalidParam ();
+  }
+
+  const NoiseMap& base = m_pAverageLevels[0];
+  x0 = GetMax (x0, 0);
+  y0 = GetMax (y0, 0);
+  x1 = GetMin (x1, base.GetWidth  ());
+  y1 = GetMin (y1, base.GetHeight ());
+  if (x0 >= x1 || y0 >= y1) {
+    throw noise::ExceptionInvalidParam ();
+  }
+
+  // Find the first level where the region spans at most two points in
+  // each direction.
+  int level = 0;
+  while (((x1 - 1) >> level) - (x0 >> level) > 1
+    || ((y1 - 1) >> level) - (y0 >> level) > 1) {
+    level++;
+  }
+
+  const NoiseMap& levelMin = GetMinLevel (level);
+  const NoiseMap& levelMax = GetMaxLevel (level);
+  minValue = levelMin.GetValue (x0 >> level, y0 >> level);
+  maxValue = levelMax.GetValue (x0 >> level, y0 >> level);
+  for (int y = y0 >> level; y <= (y1 - 1) >> level; y++) {
+    for (int x = x0 >> level; x <= (x1 - 1) >> level; x++) {
+      minValue = GetMin (minValue, *levelMin.GetConstSlabPtr (x, y));
+      maxValue = GetMax (maxValue, *levelMax.GetConstSlabPtr (x, y));
+    }
+  }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // Image class
 
@@ -416,7 +796,7 @@ Image::Image (const Image& rhs)
 
 Image::~Image ()
 {
-  delete[] m_pImage;
+  FreeBuffer (m_pImage, m_pAllocator);
 }
 
 Image& Image::operator= (const Image& rhs)
@@ -455,7 +835,7 @@ void Image::CopyImage (const Image& source)
 
 void Image::DeleteImageAndReset ()
 {
-  delete[] m_pImage;
+  FreeBuffer (m_pImage, m_pAllocator);
   InitObj ();
 }
 
@@ -473,6 +853,7 @@ Color Image::GetValue (int x, int y) const
 
 void Image::InitObj ()
 {
+  m_pAllocator = NULL;
   m_pImage  = NULL;
   m_height  = 0;
   m_width   = 0;
@@ -487,15 +868,12 @@ void Image::ReclaimMem ()
   if (m_memUsed > newMemUsage) {
     // There is wasted memory.  Create the smallest buffer that can fit the
     // data and copy the data to it.
-    Color* pNewImage = NULL;
-    try {
-      pNewImage = new Color[newMemUsage];
-    }
-    catch (...) {
-      throw noise::ExceptionOutOfMemory ();
-    }
+    BufferAllocator* pNewAllocator;
+    Color* pNewImage = (Color*)AllocateBuffer (newMemUsage * sizeof (Color),
+      pNewAllocator);
     memcpy (pNewImage, m_pImage, newMemUsage * sizeof (float));
-    delete[] m_pImage;
+    FreeBuffer (m_pImage, m_pAllocator);
+    m_pAllocator = pNewAllocator;
     m_pImage = pNewImage;
     m_memUsed = newMemUsage;
   }
@@ -520,12 +898,8 @@ void Image::SetSize (int width, int height)
       // The new size is too big for the current image buffer.  We need to
       // reallocate.
       DeleteImageAndReset ();
-      try {
-        m_pImage = new Color[newMemUsage];
-      }
-      catch (...) {
-        throw noise::ExceptionOutOfMemory ();
-      }
+      m_pImage = (Color*)AllocateBuffer (newMemUsage * sizeof (Color),
+        m_pAllocator);
       m_memUsed = newMemUsage;
     }
     m_stride = (int)CalcStride (width);
@@ -547,7 +921,8 @@ void Image::TakeOwnership (Image& source)
 {
   // Copy the values and the image buffer from the source image to this image.
   // Now this image pwnz the source buffer.
-  delete[] m_pImage;
+  FreeBuffer (m_pImage, m_pAllocator);
+  m_pAllocator = source.m_pAllocator;
   m_memUsed = source.m_memUsed;
   m_height  = source.m_height;
   m_pImage  = source.m_pImage;
@@ -567,11 +942,23 @@ int WriterBMP::CalcWidthByteCount (int width) const
   return ((width * 3) + 3) & ~0x03;
 }
 
-void WriterBMP::WriteDestFile ()
+size_t WriterBMP::CalcDestSize () const
 {
   if (m_pSourceImage == NULL) {
     throw noise::ExceptionInvalidParam ();
   }
+  return (size_t)CalcWidthByteCount (m_pSourceImage->GetWidth ())
+    * m_pSourceImage->GetHeight () + BMP_HEADER_SIZE;
+}
+
+void WriterBMP::WriteDestBuffer (noise::uint8* pDestBuffer,
+  size_t destBufferSize) const
+{
+  if (m_pSourceImage == NULL
+    || pDestBuffer == NULL
+    || destBufferSize < CalcDestSize ()) {
+    throw noise::ExceptionInvalidParam ();
+  }
 
   int width  = m_pSourceImage->GetWidth  ();
   int height = m_pSourceImage->GetHeight ();
@@ -580,77 +967,57 @@ void WriterBMP::WriteDestFile ()
   int bufferSize = CalcWidthByteCount (width);
   int destSize   = bufferSize * height;
 
-  // This buffer holds one horizontal line in the destination file.
-  noise::uint8* pLineBuffer = NULL;
+  // Build the header.
+  noise::uint8* d = pDestBuffer;
+  memcpy (d, "BM", 2); d += 2;
+  d = UnpackLittle32 (d, destSize + BMP_HEADER_SIZE) + 4;
+  memset (d, 0, 4); d += 4;
+  d = UnpackLittle32 (d, (noise::uint32)BMP_HEADER_SIZE) + 4;
+  d = UnpackLittle32 (d, 40) + 4;       // Palette offset
+  d = UnpackLittle32 (d, (noise::uint32)width ) + 4;
+  d = UnpackLittle32 (d, (noise::uint32)height) + 4;
+  d = UnpackLittle16 (d, 1 ) + 2;       // Planes per pixel
+  d = UnpackLittle16 (d, 24) + 2;       // Bits per plane
+  memset (d, 0, 4); d += 4;             // Compression (0 = none)
+  d = UnpackLittle32 (d, (noise::uint32)destSize) + 4;
+  d = UnpackLittle32 (d, 2834) + 4;     // X pixels per meter
+  d = UnpackLittle32 (d, 2834) + 4;     // Y pixels per meter
+  memset (d, 0, 8);
+
+  // Build each horizontal line, including its padding.
+  noise::uint8* pLines = pDestBuffer + BMP_HEADER_SIZE;
+  const Image& sourceImage = *m_pSourceImage;
+  job_system::instance ().parallel_for (0, height, WRITE_LINE_GRAIN,
+    [&] (int y0, int y1) {
+      for (int y = y0; y < y1; y++) {
+        noise::uint8* pDest = pLines + (size_t)y * bufferSize;
+        PackBGRLine (pDest, sourceImage.GetConstSlabPtr (y), width);
+        memset (pDest + width * 3, 0, bufferSize - width * 3);
+      }
+    });
+}
 
-  // File object used to write the file.
-  std::ofstream os;
-  os.clear ();
-  
-  // Allocate a buffer to hold one horizontal line in the bitmap.
-  try {
-    pLineBuffer = new noise::uint8[bufferSize];
-  }
-  catch (...) {
-    throw noise::ExceptionOutOfMemory ();
-  }
+void WriterBMP::WriteDestFile ()
+{
+  PROFILE_SCOPE_NAMED (scope, "WriterBMP::WriteDestFile");
+  scope.setCount (CalcDestSize (), "bytes");
 
-  // Open the destination file.
-  os.open (m_destFilename.c_str (), std::ios::out | std::ios::binary);
-  if (os.fail () || os.bad ()) {
-    delete[] pLineBuffer;
-    throw noise::ExceptionUnknown ();
-  }
+  size_t destSize = CalcDestSize ();
 
-  // Build the header.
-  noise::uint8 d[4];
-  os.write ("BM", 2);
-  os.write ((char*)UnpackLittle32 (d, destSize + BMP_HEADER_SIZE), 4);
-  os.write ("\0\0\0\0", 4);
-  os.write ((char*)UnpackLittle32 (d, (noise::uint32)BMP_HEADER_SIZE), 4);
-  os.write ((char*)UnpackLittle32 (d, 40), 4);   // Palette offset
-  os.write ((char*)UnpackLittle32 (d, (noise::uint32)width ), 4);
-  os.write ((char*)UnpackLittle32 (d, (noise::uint32)height), 4);
-  os.write ((char*)UnpackLittle16 (d, 1 ), 2);   // Planes per pixel
-  os.write ((char*)UnpackLittle16 (d, 24), 2);   // Bits per plane
-  os.write ("\0\0\0\0", 4); // Compression (0 = none)
-  os.write ((char*)UnpackLittle32 (d, (noise::uint32)destSize), 4);
-  os.write ((char*)UnpackLittle32 (d, 2834), 4); // X pixels per meter
-  os.write ((char*)UnpackLittle32 (d, 2834), 4); // Y pixels per meter
-  os.write ("\0\0\0\0", 4);
-  os.write ("\0\0\0\0", 4);
-  if (os.fail () || os.bad ()) {
-    os.clear ();
-    os.close ();
-    os.clear ();
-    delete[] pLineBuffer;
-    throw noise::ExceptionUnknown ();
-  }
+  // This buffer holds the entire file.
+  BufferAllocator* pAllocator;
+  noise::uint8* pFileBuffer = (noise::uint8*)AllocateBuffer (destSize,
+    pAllocator);
 
-  // Build and write each horizontal line to the file.
-  for (int y = 0; y < height; y++) {
-    memset (pLineBuffer, 0, bufferSize);
-    Color* pSource = m_pSourceImage->GetSlabPtr (y);
-    noise::uint8* pDest   = pLineBuffer;
-    for (int x = 0; x < width; x++) {
-      *pDest++ = pSource->blue ;
-      *pDest++ = pSource->green;
-      *pDest++ = pSource->red  ;
-      ++pSource;
-    }
-    os.write ((char*)pLineBuffer, (size_t)bufferSize);
-    if (os.fail () || os.bad ()) {
-      os.clear ();
-      os.close ();
-      os.clear ();
-      delete[] pLineBuffer;
-      throw noise::ExceptionUnknown ();
-    }
+  try {
+    WriteDestBuffer (pFileBuffer, destSize);
+    WriteBufferToFile (m_destFilename, pFileBuffer, destSize);
   }
-
-  os.close ();
-  os.clear ();
-  delete[] pLineBuffer;
+  catch (...) {
+    FreeBuffer (pFileBuffer, pAllocator);
+    throw;
+  }
+  FreeBuffer (pFileBuffer, pAllocator);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -661,92 +1028,347 @@ int WriterTER::CalcWidthByteCount (int width) const
   return (width * sizeof (int16));
 }
 
-void WriterTER::WriteDestFile ()
+size_t WriterTER::CalcDestSize () const
 {
   if (m_pSourceNoiseMap == NULL) {
     throw noise::ExceptionInvalidParam ();
   }
+  return (size_t)CalcWidthByteCount (m_pSourceNoiseMap->GetWidth ())
+    * m_pSourceNoiseMap->GetHeight () + TER_HEADER_SIZE;
+}
+
+void WriterTER::WriteDestBuffer (noise::uint8* pDestBuffer,
+  size_t destBufferSize) const
+{
+  if (m_pSourceNoiseMap == NULL
+    || pDestBuffer == NULL
+    || destBufferSize < CalcDestSize ()) {
+    throw noise::ExceptionInvalidParam ();
+  }
 
   int width  = m_pSourceNoiseMap->GetWidth  ();
   int height = m_pSourceNoiseMap->GetHeight ();
 
   int bufferSize = CalcWidthByteCount (width);
-  int destSize   = bufferSize * height;
 
-  // This buffer holds one horizontal line in the destination file.
-  noise::uint8* pLineBuffer = NULL;
+  // Build the header.
+  noise::uint8* d = pDestBuffer;
+  int16 heightScale = (int16)(floor (32768.0 / (double)m_metersPerPoint));
+  memcpy (d, "TERRAGENTERRAIN ", 16); d += 16;
+  memcpy (d, "SIZE", 4); d += 4;
+  d = UnpackLittle16 (d, GetMin (width, height) - 1) + 2;
+  memset (d, 0, 2); d += 2;
+  memcpy (d, "XPTS", 4); d += 4;
+  d = UnpackLittle16 (d, width) + 2;
+  memset (d, 0, 2); d += 2;
+  memcpy (d, "YPTS", 4); d += 4;
+  d = UnpackLittle16 (d, height) + 2;
+  memset (d, 0, 2); d += 2;
+  memcpy (d, "SCAL", 4); d += 4;
+  d = UnpackFloat (d, m_metersPerPoint) + 4;
+  d = UnpackFloat (d, m_metersPerPoint) + 4;
+  d = UnpackFloat (d, m_metersPerPoint) + 4;
+  memcpy (d, "ALTW", 4); d += 4;
+  d = UnpackLittle16 (d, heightScale) + 2;
+  memset (d, 0, 2);
+
+  // Build each horizontal line.
+  noise::uint8* pLines = pDestBuffer + TER_HEADER_SIZE;
+  const NoiseMap& sourceNoiseMap = *m_pSourceNoiseMap;
+  job_system::instance ().parallel_for (0, height, WRITE_LINE_GRAIN,
+    [&] (int y0, int y1) {
+      for (int y = y0; y < y1; y++) {
+        const float* pSource = sourceNoiseMap.GetConstSlabPtr (y);
+        noise::uint8* pDest = pLines + (size_t)y * bufferSize;
+        for (int x = 0; x < width; x++) {
+          int16 scaledHeight = (int16)(floor (pSource[x] * 2.0));
+          UnpackLittle16 (pDest, scaledHeight);
+          pDest += 2;
+        }
+      }
+    });
+}
 
-  // File object used to write the file.
-  std::ofstream os;
-  os.clear ();
+void WriterTER::WriteDestFile ()
+{
+  PROFILE_SCOPE_NAMED (scope, "WriterTER::WriteDestFile");
+  scope.setCount (CalcDestSize (), "bytes");
+
+  size_t destSize = CalcDestSize ();
+
+  // This buffer holds the entire file.
+  BufferAllocator* pAllocator;
+  noise::uint8* pFileBuffer = (noise::uint8*)AllocateBuffer (destSize,
+    pAllocator);
 
-  // Allocate a buffer to hold one horizontal line in the height map.
   try {
-    pLineBuffer = new noise::uint8[bufferSize];
+    WriteDestBuffer (pFileBuffer, destSize);
+    WriteBufferToFile (m_destFilename, pFileBuffer, destSize);
   }
   catch (...) {
-    throw noise::ExceptionOutOfMemory ();
+    FreeBuffer (pFileBuffer, pAllocator);
+    throw;
   }
+  FreeBuffer (pFileBuffer, pAllocator);
+}
 
-  // Open the destination file.
-  os.open (m_destFilename.c_str (), std::ios::out | std::ios::binary);
-  if (os.fail () || os.bad ()) {
-    os.clear ();
-    delete[] pLineBuffer;
-    throw noise::ExceptionUnknown ();
+/////////////////////////////////////////////////////////////////////////////
+// WriterHeightMap class
+
+WriterHeightMap::WriterHeightMap ():
+  m_hasNormalizeBounds    (false),
+  m_isMappedOutputEnabled (false),
+  m_isNormalizeEnabled    (false),
+  m_normalizeLowerBound   (0.0f),
+  m_normalizeUpperBound   (1.0f),
+  m_pSourceNoiseMap       (NULL)
+{
+}
+
+size_t WriterHeightMap::CalcDestSize () const
+{
+  if (m_pSourceNoiseMap == NULL
+    || m_pSourceNoiseMap->GetWidth  () <= 0
+    || m_pSourceNoiseMap->GetHeight () <= 0) {
+    throw noise::ExceptionInvalidParam ();
   }
 
-  // Build the header.
-  noise::uint8 d[4];
-  int16 heightScale = (int16)(floor (32768.0 / (double)m_metersPerPoint));
-  os.write ("TERRAGENTERRAIN ", 16);
-  os.write ("SIZE", 4);
-  os.write ((char*)UnpackLittle16 (d, GetMin (width, height) - 1), 2);
-  os.write ("\0\0", 2);
-  os.write ("XPTS", 4);
-  os.write ((char*)UnpackLittle16 (d, width), 2);
-  os.write ("\0\0", 2);
-  os.write ("YPTS", 4);
-  os.write ((char*)UnpackLittle16 (d, height), 2);
-  os.write ("\0\0", 2);
-  os.write ("SCAL", 4);
-  os.write ((char*)UnpackFloat (d, m_metersPerPoint), 4);
-  os.write ((char*)UnpackFloat (d, m_metersPerPoint), 4);
-  os.write ((char*)UnpackFloat (d, m_metersPerPoint), 4);
-  os.write ("ALTW", 4);
-  os.write ((char*)UnpackLittle16 (d, heightScale), 2);
-  os.write ("\0\0", 2);
-  if (os.fail () || os.bad ()) {
-    os.clear ();
-    os.close ();
-    os.clear ();
-    delete[] pLineBuffer;
-    throw noise::ExceptionUnknown ();
+  int width  = m_pSourceNoiseMap->GetWidth  ();
+  int height = m_pSourceNoiseMap->GetHeight ();
+  return (size_t)width * height * GetPointSize ()
+    + CalcHeaderSize (width, height);
+}
+
+void WriterHeightMap::SetNormalizeBounds (float lowerBound, float upperBound)
+{
+  if (lowerBound >= upperBound) {
+    throw noise::ExceptionInvalidParam ();
+  }
+
+  m_normalizeLowerBound = lowerBound;
+  m_normalizeUpperBound = upperBound;
+  m_hasNormalizeBounds  = true;
+}
+
+void WriterHeightMap::WriteDestBuffer (noise::uint8* pDestBuffer,
+  size_t destBufferSize) const
+{
+  if (pDestBuffer == NULL || destBufferSize < CalcDestSize ()) {
+    throw noise::ExceptionInvalidParam ();
   }
 
-  // Build and write each horizontal line to the file.
-  for (int y = 0; y < height; y++) {
-    float* pSource = m_pSourceNoiseMap->GetSlabPtr (y);
-    noise::uint8* pDest   = pLineBuffer;
-    for (int x = 0; x < width; x++) {
-      int16 scaledHeight = (int16)(floor (*pSource * 2.0));
-      UnpackLittle16 (pDest, scaledHeight);
-      pDest += 2;
-      ++pSource;
+  int width  = m_pSourceNoiseMap->GetWidth  ();
+  int height = m_pSourceNoiseMap->GetHeight ();
+  const NoiseMap& sourceNoiseMap = *m_pSourceNoiseMap;
+
+  // Find the range of values to normalize, scanning the noise map if no
+  // bounds have been set.
+  ValueMapping mapping;
+  mapping.normalize = m_isNormalizeEnabled;
+  mapping.scale = 1.0f;
+  mapping.bias  = 0.0f;
+  if (m_isNormalizeEnabled) {
+    float lowerBound = m_normalizeLowerBound;
+    float upperBound = m_normalizeUpperBound;
+    if (!m_hasNormalizeBounds) {
+      lowerBound = upperBound = sourceNoiseMap.GetValue (0, 0);
+      std::mutex boundsMutex;
+      job_system::instance ().parallel_for (0, height, WRITE_LINE_GRAIN,
+        [&] (int y0, int y1) {
+          float lineMin = sourceNoiseMap.GetValue (0, y0);
+          float lineMax = lineMin;
+          for (int y = y0; y < y1; y++) {
+            const float* pSource = sourceNoiseMap.GetConstSlabPtr (y);
+            for (int x = 0; x < width; x++) {
+              lineMin = GetMin (lineMin, pSource[x]);
+              lineMax = GetMax (lineMax, pSource[x]);
+            }
+          }
+          std::lock_guard<std::mutex> lock (boundsMutex);
+          lowerBound = GetMin (lowerBound, lineMin);
+          upperBound = GetMax (upperBound, lineMax);
+        });
     }
-    os.write ((char*)pLineBuffer, (size_t)bufferSize);
-    if (os.fail () || os.bad ()) {
-      os.clear ();
-      os.close ();
-      os.clear ();
-      delete[] pLineBuffer;
+    // A flat noise map has no range; map every value to 0.0.
+    if (upperBound > lowerBound) {
+      mapping.scale = 1.0f / (upperBound - lowerBound);
+    } else {
+      mapping.scale = 0.0f;
+    }
+    mapping.bias = -lowerBound * mapping.scale;
+  }
+
+  WriteHeader (pDestBuffer, width, height);
+
+  // Encode each horizontal line in the order that the file stores them.
+  noise::uint8* pLines = pDestBuffer + CalcHeaderSize (width, height);
+  size_t lineSize = (size_t)width * GetPointSize ();
+  bool isTopLineFirst = IsTopLineFirst ();
+  job_system::instance ().parallel_for (0, height, WRITE_LINE_GRAIN,
+    [&] (int y0, int y1) {
+      for (int y = y0; y < y1; y++) {
+        int fileLine = isTopLineFirst? height - 1 - y: y;
+        WriteLine (pLines + fileLine * lineSize,
+          sourceNoiseMap.GetConstSlabPtr (y), width, mapping);
+      }
+    });
+}
+
+void WriterHeightMap::WriteDestFile ()
+{
+  PROFILE_SCOPE_NAMED (scope, "WriterHeightMap::WriteDestFile");
+  scope.setCount (CalcDestSize (), "bytes");
+
+  size_t destSize = CalcDestSize ();
+
+  if (m_isMappedOutputEnabled) {
+    mapped_file destFile;
+    noise::uint8* pFileData = destFile.create (m_destFilename.c_str (),
+      destSize);
+    if (pFileData == NULL) {
+      throw noise::ExceptionUnknown ();
+    }
+    WriteDestBuffer (pFileData, destSize);
+    if (!destFile.close ()) {
       throw noise::ExceptionUnknown ();
     }
+    return;
   }
 
-  os.close ();
-  os.clear ();
-  delete[] pLineBuffer;
+  // This buffer holds the entire file.
+  BufferAllocator* pAllocator;
+  noise::uint8* pFileBuffer = (noise::uint8*)AllocateBuffer (destSize,
+    pAllocator);
+
+  try {
+    WriteDestBuffer (pFileBuffer, destSize);
+    WriteBufferToFile (m_destFilename, pFileBuffer, destSize);
+  }
+  catch (...) {
+    FreeBuffer (pFileBuffer, pAllocator);
+    throw;
+  }
+  FreeBuffer (pFileBuffer, pAllocator);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// WriterRAW16 class
+
+int WriterRAW16::CalcHeaderSize (int /*width*/, int /*height*/) const
+{
+  return 0;
+}
+
+int WriterRAW16::GetPointSize () const
+{
+  return sizeof (noise::uint16);
+}
+
+void WriterRAW16::WriteHeader (noise::uint8* /*pDest*/, int /*width*/,
+  int /*height*/) const
+{
+}
+
+void WriterRAW16::WriteLine (noise::uint8* pDest, const float* pSource,
+  int width, const ValueMapping& mapping) const
+{
+  for (int x = 0; x < width; x++) {
+    UnpackLittle16 (pDest, QuantizeUint16 (mapping.Apply (pSource[x]),
+      mapping.normalize));
+    pDest += 2;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// WriterRAWF32 class
+
+int WriterRAWF32::CalcHeaderSize (int /*width*/, int /*height*/) const
+{
+  return 0;
+}
+
+int WriterRAWF32::GetPointSize () const
+{
+  return sizeof (float);
+}
+
+void WriterRAWF32::WriteHeader (noise::uint8* /*pDest*/, int /*width*/,
+  int /*height*/) const
+{
+}
+
+void WriterRAWF32::WriteLine (noise::uint8* pDest, const float* pSource,
+  int width, const ValueMapping& mapping) const
+{
+  for (int x = 0; x < width; x++) {
+    UnpackFloat (pDest, mapping.Apply (pSource[x]));
+    pDest += 4;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// WriterPGM class
+
+int WriterPGM::CalcHeaderSize (int width, int height) const
+{
+  char header[64];
+  return FormatNetpbmHeader (header, "P5", width, height, "65535");
+}
+
+int WriterPGM::GetPointSize () const
+{
+  return sizeof (noise::uint16);
+}
+
+void WriterPGM::WriteHeader (noise::uint8* pDest, int width,
+  int height) const
+{
+  char header[64];
+  int headerSize = FormatNetpbmHeader (header, "P5", width, height, "65535");
+  memcpy (pDest, header, headerSize);
+}
+
+void WriterPGM::WriteLine (noise::uint8* pDest, const float* pSource,
+  int width, const ValueMapping& mapping) const
+{
+  for (int x = 0; x < width; x++) {
+    noise::uint16 value = QuantizeUint16 (mapping.Apply (pSource[x]),
+      mapping.normalize);
+    *pDest++ = (noise::uint8)(value >> 8);
+    *pDest++ = (noise::uint8)(value & 0xff);
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// WriterPFM class
+
+int WriterPFM::CalcHeaderSize (int width, int height) const
+{
+  char header[64];
+  return FormatNetpbmHeader (header, "Pf", width, height, "-1.0");
+}
+
+int WriterPFM::GetPointSize () const
+{
+  return sizeof (float);
+}
+
+void WriterPFM::WriteHeader (noise::uint8* pDest, int width,
+  int height) const
+{
+  // A negative scale marks the values as little endian.
+  char header[64];
+  int headerSize = FormatNetpbmHeader (header, "Pf", width, height, "-1.0");
+  memcpy (pDest, header, headerSize);
+}
+
+void WriterPFM::WriteLine (noise::uint8* pDest, const float* pSource,
+  int width, const ValueMapping& mapping) const
+{
+  for (int x = 0; x < width; x++) {
+    UnpackFloat (pDest, mapping.Apply (pSource[x]));
+    pDest += 4;
+  }
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -788,6 +1410,9 @@ void NoiseMapBuilderCylinder::Build ()
     throw noise::ExceptionInvalidParam ();
   }
 
+  PROFILE_SCOPE_NAMED (scope, "NoiseMapBuilderCylinder::Build");
+  scope.setCount ((unsigned long long)m_destWidth * m_destHeight, "samples");
+
   // Resize the destination noise map so that it can store the new output
   // values from the source model.
   m_pDestNoiseMap->SetSize (m_destWidth, m_destHeight);
@@ -842,6 +1467,9 @@ void NoiseMapBuilderPlane::Build ()
     throw noise::ExceptionInvalidParam ();
   }
 
+  PROFILE_SCOPE_NAMED (scope, "NoiseMapBuilderPlane::Build");
+  scope.setCount ((unsigned long long)m_destWidth * m_destHeight, "samples");
+
   // Resize the destination noise map so that it can store the new output
   // values from the source model.
   m_pDestNoiseMap->SetSize (m_destWidth, m_destHeight);
@@ -850,36 +1478,14 @@ void NoiseMapBuilderPlane::Build ()
   model::Plane planeModel;
   planeModel.SetModule (*m_pSourceModule);
 
-  double xExtent = m_upperXBound - m_lowerXBound;
   double zExtent = m_upperZBound - m_lowerZBound;
-  double xDelta  = xExtent / (double)m_destWidth ;
   double zDelta  = zExtent / (double)m_destHeight;
-  double xCur    = m_lowerXBound;
   double zCur    = m_lowerZBound;
 
   // Fill every point in the noise map with the output values from the model.
   for (int z = 0; z < m_destHeight; z++) {
-    float* pDest = m_pDestNoiseMap->GetSlabPtr (z);
-    xCur = m_lowerXBound;
-    for (int x = 0; x < m_destWidth; x++) {
-      float finalValue;
-      if (!m_isSeamlessEnabled) {
-        finalValue = planeModel.GetValue (xCur, zCur);
-      } else {
-        double swValue, seValue, nwValue, neValue;
-        swValue = planeModel.GetValue (xCur          , zCur          );
-        seValue = planeModel.GetValue (xCur + xExtent, zCur          );
-        nwValue = planeModel.GetValue (xCur          , zCur + zExtent);
-        neValue = planeModel.GetValue (xCur + xExtent, zCur + zExtent);
-        double xBlend = 1.0 - ((xCur - m_lowerXBound) / xExtent);
-        double zBlend = 1.0 - ((zCur - m_lowerZBound) / zExtent);
-        double z0 = LinearInterp (swValue, seValue, xBlend);
-        double z1 = LinearInterp (nwValue, neValue, xBlend);
-        finalValue = (float)LinearInterp (z0, z1, zBlend);
-      }
-      *pDest++ = finalValue;
-      xCur += xDelta;
-    }
+    BuildRow (planeModel, m_pDestNoiseMap->GetSlabPtr (z), m_destWidth, zCur,
+      0, m_destWidth);
     zCur += zDelta;
     if (m_pCallback != NULL) {
       m_pCallback (z);
@@ -887,6 +1493,193 @@ void NoiseMapBuilderPlane::Build ()
   }
 }
 
+void NoiseMapBuilderPlane::BuildRegion (int x0, int z0, int x1, int z1,
+  float* pDest, int destStride) const
+{
+  if ( m_upperXBound <= m_lowerXBound
+    || m_upperZBound <= m_lowerZBound
+    || m_pSourceModule == NULL
+    || x0 < 0 || z0 < 0 || x1 > m_destWidth || z1 > m_destHeight) {
+    throw noise::ExceptionInvalidParam ();
+  }
+
+  model::Plane planeModel;
+  planeModel.SetModule (*m_pSourceModule);
+
+  // Step to the first row the same way as Build(), so that the rows get
+  // exactly the same z coordinates.
+  double zExtent = m_upperZBound - m_lowerZBound;
+  double zDelta  = zExtent / (double)m_destHeight;
+  double zCur    = m_lowerZBound;
+  for (int z = 0; z < z0; z++) {
+    zCur += zDelta;
+  }
+
+  for (int z = z0; z < z1; z++) {
+    BuildRow (planeModel, pDest, m_destWidth, zCur, x0, x1);
+    pDest += destStride;
+    zCur += zDelta;
+  }
+}
+
+void NoiseMapBuilderPlane::BuildRow (const model::Plane& planeModel,
+  float* pDest, int width, double zCur, int xBegin, int xEnd) const
+{
+  double xExtent = m_upperXBound - m_lowerXBound;
+  double zExtent = m_upperZBound - m_lowerZBound;
+  double xDelta  = xExtent / (double)width;
+  double xCur    = m_lowerXBound;
+  for (int x = 0; x < xBegin; x++) {
+    xCur += xDelta;
+  }
+
+  for (int x = xBegin; x < xEnd; x++) {
+    float finalValue;
+    if (!m_isSeamlessEnabled) {
+      finalValue = planeModel.GetValue (xCur, zCur);
+    } else {
+      double swValue, seValue, nwValue, neValue;
+      swValue = planeModel.GetValue (xCur          , zCur          );
+      seValue = planeModel.GetValue (xCur + xExtent, zCur          );
+      nwValue = planeModel.GetValue (xCur          , zCur + zExtent);
+      neValue = planeModel.GetValue (xCur + xExtent, zCur + zExtent);
+      double xBlend = 1.0 - ((xCur - m_lowerXBound) / xExtent);
+      double zBlend = 1.0 - ((zCur - m_lowerZBound) / zExtent);
+      double z0 = LinearInterp (swValue, seValue, xBlend);
+      double z1 = LinearInterp (nwValue, neValue, xBlend);
+      finalValue = (float)LinearInterp (z0, z1, zBlend);
+    }
+    *pDest++ = finalValue;
+    xCur += xDelta;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// NoiseMapBuilderPlaneStream class
+
+NoiseMapBuilderPlaneStream::NoiseMapBuilderPlaneStream ():
+  m_bandHeight (DEFAULT_STREAM_BAND_HEIGHT),
+  m_tileSize   (0)
+{
+}
+
+void NoiseMapBuilderPlaneStream::Build ()
+{
+  if ( GetUpperXBound () <= GetLowerXBound ()
+    || GetUpperZBound () <= GetLowerZBound ()
+    || m_destWidth <= 0
+    || m_destHeight <= 0
+    || m_pSourceModule == NULL
+    || m_destFilename.empty ()) {
+    throw noise::ExceptionInvalidParam ();
+  }
+
+  PROFILE_SCOPE_NAMED (scope, "NoiseMapBuilderPlaneStream::Build");
+  scope.setCount ((unsigned long long)m_destWidth * m_destHeight, "samples");
+
+  int width  = m_destWidth;
+  int height = m_destHeight;
+  int bandHeight = (m_tileSize > 0)? m_tileSize: m_bandHeight;
+  bandHeight = GetMin (bandHeight, height);
+  size_t bandSize = (size_t)width * bandHeight;
+
+  // One buffer holds the band as it is built; the other holds the band
+  // rearranged into tiles.
+  BufferAllocator* pBandAllocator;
+  BufferAllocator* pTilesAllocator = NULL;
+  float* pBand = (float*)AllocateBuffer (bandSize * sizeof (float),
+    pBandAllocator);
+  float* pTiles = NULL;
+  if (m_tileSize > 0) {
+    try {
+      pTiles = (float*)AllocateBuffer (bandSize * sizeof (float),
+        pTilesAllocator);
+    }
+    catch (...) {
+      FreeBuffer (pBand, pBandAllocator);
+      throw;
+    }
+  }
+
+  std::ofstream os;
+  os.open (m_destFilename.c_str (), std::ios::out | std::ios::binary);
+  if (os.fail () || os.bad ()) {
+    FreeBuffer (pTiles, pTilesAllocator);
+    FreeBuffer (pBand, pBandAllocator);
+    throw noise::ExceptionUnknown ();
+  }
+
+  // Create the plane model.
+  model::Plane planeModel;
+  planeModel.SetModule (*m_pSourceModule);
+
+  // The z coordinate is accumulated row by row, exactly as
+  // NoiseMapBuilderPlane does, so that the values match.
+  double zExtent = GetUpperZBound () - GetLowerZBound ();
+  double zDelta  = zExtent / (double)height;
+  double zCur    = GetLowerZBound ();
+  std::vector<double> zRows (bandHeight);
+
+  try {
+    for (int z0 = 0; z0 < height; z0 += bandHeight) {
+      int rowCount = GetMin (bandHeight, height - z0);
+      for (int row = 0; row < rowCount; row++) {
+        zRows[row] = zCur;
+        zCur += zDelta;
+      }
+
+      // Build the rows of the band in parallel.
+      job_system::instance ().parallel_for (0, rowCount, 1,
+        [&] (int row0, int row1) {
+          for (int row = row0; row < row1; row++) {
+            BuildRow (planeModel, pBand + (size_t)row * width, width,
+              zRows[row], 0, width);
+          }
+        });
+
+      // Rearrange the band into tiles, clipping the last tile to the
+      // width of the noise map.
+      const float* pOut = pBand;
+      if (m_tileSize > 0) {
+        float* pDest = pTiles;
+        for (int x0 = 0; x0 < width; x0 += m_tileSize) {
+          int tileWidth = GetMin (m_tileSize, width - x0);
+          for (int row = 0; row < rowCount; row++) {
+            memcpy (pDest, pBand + (size_t)row * width + x0,
+              tileWidth * sizeof (float));
+            pDest += tileWidth;
+          }
+        }
+        pOut = pTiles;
+      }
+
+      // The values are written in the native byte order of Intel machines.
+      os.write ((const char*)pOut,
+        (std::streamsize)((size_t)rowCount * width * sizeof (float)));
+      if (os.fail () || os.bad ()) {
+        throw noise::ExceptionUnknown ();
+      }
+
+      if (m_pCallback != NULL) {
+        for (int row = 0; row < rowCount; row++) {
+          m_pCallback (z0 + row);
+        }
+      }
+    }
+  }
+  catch (...) {
+    os.clear ();
+    os.close ();
+    FreeBuffer (pTiles, pTilesAllocator);
+    FreeBuffer (pBand, pBandAllocator);
+    throw;
+  }
+
+  os.close ();
+  FreeBuffer (pTiles, pTilesAllocator);
+  FreeBuffer (pBand, pBandAllocator);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // NoiseMapBuilderSphere class
 
@@ -909,6 +1702,9 @@ void NoiseMapBuilderSphere::Build ()
     throw noise::ExceptionInvalidParam ();
   }
 
+  PROFILE_SCOPE_NAMED (scope, "NoiseMapBuilderSphere::Build");
+  scope.setCount ((unsigned long long)m_destWidth * m_destHeight, "samples");
+
   // Resize the destination noise map so that it can store the new output
   // values from the source model.
   m_pDestNoiseMap->SetSize (m_destWidth, m_destHeight);
@@ -1035,12 +1831,12 @@ Color RendererImage::CalcDestColor (const Color& sourceColor,
   return newColor;
 }
 
-double RendererImage::CalcLightIntensity (double center, double left,
-  double right, double down, double up) const
+void RendererImage::CalcLightFactors (double& io, double& ix,
+  double& iy) const
 {
   // Recalculate the sine and cosine of the various light values if
-  // necessary so it does not have to be calculated each time this method is
-  // called.
+  // necessary so it does not have to be calculated each time the image is
+  // rendered.
   if (m_recalcLightValues) {
     m_cosAzimuth = cos (m_lightAzimuth * DEG_TO_RAD);
     m_sinAzimuth = sin (m_lightAzimuth * DEG_TO_RAD);
@@ -1049,18 +1845,13 @@ double RendererImage::CalcLightIntensity (double center, double left,
     m_recalcLightValues = false;
   }
 
-  // Now do the lighting calculations.
+  // These factors are constant over the whole image.
   const double I_MAX = 1.0;
-  double io = I_MAX * SQRT_2 * m_sinElev / 2.0;
-  double ix = (I_MAX - io) * m_lightContrast * SQRT_2 * m_cosElev
+  io = I_MAX * SQRT_2 * m_sinElev / 2.0;
+  ix = (I_MAX - io) * m_lightContrast * SQRT_2 * m_cosElev
     * m_cosAzimuth;
-  double iy = (I_MAX - io) * m_lightContrast * SQRT_2 * m_cosElev
+  iy = (I_MAX - io) * m_lightContrast * SQRT_2 * m_cosElev
     * m_sinAzimuth; 
-  double intensity = (ix * (left - right) + iy * (down - up) + io);
-  if (intensity < 0.0) {
-    intensity = 0.0;
-  }
-  return intensity;
 }
 
 void RendererImage::ClearGradient ()
@@ -1078,6 +1869,10 @@ void RendererImage::Render ()
     throw noise::ExceptionInvalidParam ();
   }
 
+  PROFILE_SCOPE_NAMED (scope, "RendererImage::Render");
+  scope.setCount ((unsigned long long)m_pSourceNoiseMap->GetWidth ()
+    * m_pSourceNoiseMap->GetHeight (), "pixels");
+
   int width  = m_pSourceNoiseMap->GetWidth  ();
   int height = m_pSourceNoiseMap->GetHeight ();
 
@@ -1096,108 +1891,105 @@ void RendererImage::Render ()
     m_pDestImage->SetSize (width, height);
   }
 
-  for (int y = 0; y < height; y++) {
+  // Map the noise values through the color lookup table rather than
+  // searching the gradient points for every pixel.
+  if (!m_gradient.IsLookupTableValid ()) {
+    m_gradient.BuildLookupTable ();
+  }
+
+  // The light vector does not change from pixel to pixel, so calculate it
+  // once before any tiles are rendered.
+  double io = 0.0, ix = 0.0, iy = 0.0;
+  if (m_isLightEnabled) {
+    CalcLightFactors (io, ix, iy);
+  }
+
+  // Each tile writes a disjoint region of the destination image, so the
+  // result does not depend on the order in which the tiles run.
+  job_system::instance ().parallel_for_tiles (width, height,
+    RENDER_TILE_WIDTH, RENDER_TILE_HEIGHT,
+    [&] (int x0, int y0, int x1, int y1) {
+      RenderTile (x0, y0, x1, y1, io, ix, iy);
+    });
+}
+
+void RendererImage::RenderTile (int x0, int y0, int x1, int y1, double io,
+  double ix, double iy)
+{
+  int width  = m_pSourceNoiseMap->GetWidth  ();
+  int height = m_pSourceNoiseMap->GetHeight ();
+
+  // Light intensities for one row of the tile.
+  double lightRow[RENDER_TILE_WIDTH];
+
+  for (int y = y0; y < y1; y++) {
     const Color* pBackground = NULL;
     if (m_pBackgroundImage != NULL) {
-      pBackground = m_pBackgroundImage->GetConstSlabPtr (y);
+      pBackground = m_pBackgroundImage->GetConstSlabPtr (x0, y);
     }
     const float* pSource = m_pSourceNoiseMap->GetConstSlabPtr (y);
-    Color* pDest = m_pDestImage->GetSlabPtr (y);
-    for (int x = 0; x < width; x++) {
-
-      // Get the color based on the value at the current point in the noise
-      // map.
-      Color destColor = m_gradient.GetColor (*pSource);
-
-      // If lighting is enabled, calculate the light intensity based on the
-      // rate of change at the current point in the noise map.
-      double lightIntensity;
-      if (m_isLightEnabled) {
-
-        // Calculate the positions of the current point's four-neighbors.
-        int xLeftOffset, xRightOffset;
-        int yUpOffset  , yDownOffset ;
-        if (m_isWrapEnabled) {
-          if (x == 0) {
-            xLeftOffset  = (int)width - 1;
-            xRightOffset = 1;
-          } else if (x == (int)width - 1) {
-            xLeftOffset  = -1;
-            xRightOffset = -((int)width - 1);
-          } else {
-            xLeftOffset  = -1;
-            xRightOffset = 1;
-          }
-          if (y == 0) {
-            yDownOffset = (int)height - 1;
-            yUpOffset   = 1;
-          } else if (y == (int)height - 1) {
-            yDownOffset = -1;
-            yUpOffset   = -((int)height - 1);
-          } else {
-            yDownOffset = -1;
-            yUpOffset   = 1;
-          }
-        } else {
-          if (x == 0) {
-            xLeftOffset  = 0;
-            xRightOffset = 1;
-          } else if (x == (int)width - 1) {
-            xLeftOffset  = -1;
-            xRightOffset = 0;
-          } else {
-            xLeftOffset  = -1;
-            xRightOffset = 1;
-          }
-          if (y == 0) {
-            yDownOffset = 0;
-            yUpOffset   = 1;
-          } else if (y == (int)height - 1) {
-            yDownOffset = -1;
-            yUpOffset   = 0;
-          } else {
-            yDownOffset = -1;
-            yUpOffset   = 1;
-          }
-        }
-        yDownOffset *= m_pSourceNoiseMap->GetStride ();
-        yUpOffset   *= m_pSourceNoiseMap->GetStride ();
-
-        // Get the noise value of the current point in the source noise map
-        // and the noise values of its four-neighbors.
-        double nc = (double)(*pSource);
-        double nl = (double)(*(pSource + xLeftOffset ));
-        double nr = (double)(*(pSource + xRightOffset));
-        double nd = (double)(*(pSource + yDownOffset ));
-        double nu = (double)(*(pSource + yUpOffset   ));
+    Color* pDest = m_pDestImage->GetSlabPtr (x0, y);
 
-        // Now we can calculate the lighting intensity.
-        lightIntensity = CalcLightIntensity (nc, nl, nr, nd, nu);
-        lightIntensity *= m_lightBrightness;
+    if (m_isLightEnabled) {
 
+      // Find the rows containing the current point's down and up neighbors.
+      // Neighbors outside the noise map either wrap to the opposite side or
+      // are cropped to the edge of the noise map.
+      int yDown, yUp;
+      if (y == 0) {
+        yDown = m_isWrapEnabled? height - 1: 0;
       } else {
-
-        // These values will apply no lighting to the destination image.
-        lightIntensity = 1.0;
+        yDown = y - 1;
       }
-
-      // Get the current background color from the background image.
-      Color backgroundColor (255, 255, 255, 255);
-      if (m_pBackgroundImage != NULL) {
-        backgroundColor = *pBackground;
+      if (y == height - 1) {
+        yUp = m_isWrapEnabled? 0: height - 1;
+      } else {
+        yUp = y + 1;
+      }
+      const float* pDown = m_pSourceNoiseMap->GetConstSlabPtr (yDown);
+      const float* pUp   = m_pSourceNoiseMap->GetConstSlabPtr (yUp  );
+
+      // Only the first and last columns need special neighbor handling; the
+      // loop over the remaining points has no branches.
+      int xBegin = GetMax (x0, 1);
+      int xEnd   = GetMin (x1, width - 1);
+      if (x0 == 0) {
+        int xLeft  = m_isWrapEnabled? width - 1: 0;
+        int xRight = (width > 1)? 1: 0;
+        lightRow[0] = CalcLightIntensity (io, ix, iy,
+          pSource[xLeft], pSource[xRight], pDown[0], pUp[0]);
+      }
+      for (int x = xBegin; x < xEnd; x++) {
+        lightRow[x - x0] = CalcLightIntensity (io, ix, iy,
+          pSource[x - 1], pSource[x + 1], pDown[x], pUp[x]);
+      }
+      if (x1 == width && width > 1) {
+        int x = width - 1;
+        int xRight = m_isWrapEnabled? 0: x;
+        lightRow[x - x0] = CalcLightIntensity (io, ix, iy,
+          pSource[x - 1], pSource[xRight], pDown[x], pUp[x]);
+      }
+      for (int x = x0; x < x1; x++) {
+        lightRow[x - x0] *= m_lightBrightness;
       }
 
-      // Blend the destination color, background color, and the light
-      // intensity together, then update the destination image with that
-      // color.
-      *pDest = CalcDestColor (destColor, backgroundColor, lightIntensity);
+    } else {
+
+      // These values will apply no lighting to the destination image.
+      for (int x = x0; x < x1; x++) {
+        lightRow[x - x0] = 1.0;
+      }
+    }
 
-      // Go to the next point.
-      ++pSource;
-      ++pDest;
-      if (m_pBackgroundImage != NULL) {
-        ++pBackground;
+    // Blend the gradient color, background color, and the light intensity
+    // together, then update the destination image with that color.
+    Color backgroundColor (255, 255, 255, 255);
+    for (int x = x0; x < x1; x++) {
+      if (pBackground != NULL) {
+        backgroundColor = *pBackground++;
       }
+      *pDest++ = CalcDestColor (m_gradient.GetLookupColor (pSource[x]),
+        backgroundColor, lightRow[x - x0]);
     }
   }
 }
@@ -1207,26 +1999,33 @@ void RendererImage::Render ()
 
 RendererNormalMap::RendererNormalMap ():
   m_bumpHeight      (1.0),
+  m_bumpHeightY     (1.0),
   m_isWrapEnabled   (false),
   m_pDestImage      (NULL),
+  m_pDestNormals    (NULL),
   m_pSourceNoiseMap (NULL)
 {
 };
 
-Color RendererNormalMap::CalcNormalColor (double nc, double nr, double nu,
-  double bumpHeight) const
+void RendererNormalMap::CalcNormal (double nc, double nr, double nu,
+  double bumpHeightX, double bumpHeightY, double& vx, double& vy,
+  double& vz) const
 {
-  // Calculate the surface normal.
-  nc *= bumpHeight;
-  nr *= bumpHeight;
-  nu *= bumpHeight;
-  double ncr = (nc - nr);
-  double ncu = (nc - nu);
+  double ncx = nc * bumpHeightX;
+  double ncy = nc * bumpHeightY;
+  nr *= bumpHeightX;
+  nu *= bumpHeightY;
+  double ncr = (ncx - nr);
+  double ncu = (ncy - nu);
   double d = sqrt ((ncu * ncu) + (ncr * ncr) + 1);
-  double vxc = (nc - nr) / d;
-  double vyc = (nc - nu) / d;
-  double vzc = 1.0 / d;
+  vx = ncr / d;
+  vy = ncu / d;
+  vz = 1.0 / d;
+}
 
+Color RendererNormalMap::CalcNormalColor (double vxc, double vyc,
+  double vzc) const
+{
   // Map the normal range from the (-1.0 .. +1.0) range to the (0 .. 255)
   // range.
   noise::uint8 xc, yc, zc;
@@ -1240,60 +2039,85 @@ Color RendererNormalMap::CalcNormalColor (double nc, double nr, double nu,
 void RendererNormalMap::Render ()
 {
   if ( m_pSourceNoiseMap == NULL
-    || m_pDestImage == NULL
+    || (m_pDestImage == NULL && m_pDestNormals == NULL)
     || m_pSourceNoiseMap->GetWidth  () <= 0
     || m_pSourceNoiseMap->GetHeight () <= 0) {
     throw noise::ExceptionInvalidParam ();
   }
 
+  PROFILE_SCOPE_NAMED (scope, "RendererNormalMap::Render");
+  scope.setCount ((unsigned long long)m_pSourceNoiseMap->GetWidth ()
+    * m_pSourceNoiseMap->GetHeight (), "pixels");
+
   int width  = m_pSourceNoiseMap->GetWidth  ();
   int height = m_pSourceNoiseMap->GetHeight ();
 
-  for (int y = 0; y < height; y++) {
-    const float* pSource = m_pSourceNoiseMap->GetConstSlabPtr (y);
-    Color* pDest = m_pDestImage->GetSlabPtr (y);
-    for (int x = 0; x < width; x++) {
-
-      // Calculate the positions of the current point's right and up
-      // neighbors.
-      int xRightOffset, yUpOffset;
-      if (m_isWrapEnabled) {
-        if (x == (int)width - 1) {
-          xRightOffset = -((int)width - 1);
-        } else {
-          xRightOffset = 1;
-        }
-        if (y == (int)height - 1) {
-          yUpOffset = -((int)height - 1);
-        } else {
-          yUpOffset = 1;
-        }
-      } else {
-        if (x == (int)width - 1) {
-          xRightOffset = 0;
-        } else {
-          xRightOffset = 1;
-        }
-        if (y == (int)height - 1) {
-          yUpOffset = 0;
-        } else {
-          yUpOffset = 1;
-        }
-      }
-      yUpOffset *= m_pSourceNoiseMap->GetStride ();
+  if (m_pDestImage != NULL) {
+    m_pDestImage->SetSize (width, height);
+  }
 
-      // Get the noise value of the current point in the source noise map
-      // and the noise values of its right and up neighbors.
-      double nc = (double)(*pSource);
-      double nr = (double)(*(pSource + xRightOffset));
-      double nu = (double)(*(pSource + yUpOffset   ));
+  job_system::instance ().parallel_for_tiles (width, height,
+    RENDER_TILE_WIDTH, RENDER_TILE_HEIGHT,
+    [&] (int x0, int y0, int x1, int y1) {
+      RenderTile (x0, y0, x1, y1);
+    });
+}
 
-      // Calculate the normal product.
-      *pDest = CalcNormalColor (nc, nr, nu, m_bumpHeight);
+void RendererNormalMap::RenderRegion (int x0, int y0, int x1, int y1)
+{
+  if ( m_pSourceNoiseMap == NULL
+    || m_pDestNormals == NULL
+    || m_pDestImage != NULL
+    || x0 < 0 || y0 < 0
+    || x1 > m_pSourceNoiseMap->GetWidth  ()
+    || y1 > m_pSourceNoiseMap->GetHeight ()) {
+    throw noise::ExceptionInvalidParam ();
+  }
 
-      // Go to the next point.
-      ++pSource;
-      ++pDest;
+  RenderTile (x0, y0, x1, y1);
+}
+
+void RendererNormalMap::RenderTile (int x0, int y0, int x1, int y1)
+{
+  int width  = m_pSourceNoiseMap->GetWidth  ();
+  int height = m_pSourceNoiseMap->GetHeight ();
+
+  for (int y = y0; y < y1; y++) {
+    const float* pSource = m_pSourceNoiseMap->GetConstSlabPtr (y);
+    Color* pDest = NULL;
+    if (m_pDestImage != NULL) {
+      pDest = m_pDestImage->GetSlabPtr (x0, y);
+    }
+    float* pNormal = NULL;
+    if (m_pDestNormals != NULL) {
+      pNormal = m_pDestNormals + ((size_t)y * width + x0) * 3;
+    }
+
+    // Find the row containing the current point's up neighbor.
+    int yUp;
+    if (y == height - 1) {
+      yUp = m_isWrapEnabled? 0: y;
+    } else {
+      yUp = y + 1;
+    }
+    const float* pUp = m_pSourceNoiseMap->GetConstSlabPtr (yUp);
+
+    // Only the last column needs special handling for its right neighbor.
+    int lastX = width - 1;
+    int xRightLast = m_isWrapEnabled? 0: lastX;
+    for (int x = x0; x < x1; x++) {
+      int xRight = (x < lastX)? x + 1: xRightLast;
+      double vx, vy, vz;
+      CalcNormal (pSource[x], pSource[xRight], pUp[x], m_bumpHeight,
+        m_bumpHeightY, vx, vy, vz);
+      if (pDest != NULL) {
+        *pDest++ = CalcNormalColor (vx, vy, vz);
+      }
+      if (pNormal != NULL) {
+        *pNormal++ = (float)vx;
+        *pNormal++ = (float)vy;
+        *pNormal++ = (float)vz;
+      }
     }
   }
 }
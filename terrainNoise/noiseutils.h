@@ -23,6 +23,7 @@
 #ifndef NOISEUTILS_H
 #define NOISEUTILS_H
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <string>
@@ -104,6 +105,83 @@ namespace noise
     /// canuckleheads.
     const double DEFAULT_METRES_PER_POINT = DEFAULT_METERS_PER_POINT;
 
+    /// Default number of entries in the color lookup table of a gradient.
+    const int DEFAULT_GRADIENT_LOOKUP_SIZE = 4096;
+
+    /// Default number of lines that NoiseMapBuilderPlaneStream builds at a
+    /// time.
+    const int DEFAULT_STREAM_BAND_HEIGHT = 64;
+
+    /// Width and height of the tiles that NoiseMapPyramid builds as one job.
+    /// Must be a power of two.
+    const int PYRAMID_TILE_SIZE = 64;
+
+    /// Allocates the buffers of noise maps and images, and the buffers that
+    /// the writers and the stream builder work in.
+    ///
+    /// By default these buffers come from the heap.  An application can
+    /// install its own allocator with SetBufferAllocator(), for example to
+    /// take every buffer made while building a terrain from one arena.
+    /// Each buffer remembers the allocator it came from and is given back
+    /// to that allocator, so the allocator can be changed at any time.
+    ///
+    /// An allocator must be safe to call from several threads at once,
+    /// since the builders and renderers run on the shared worker pool.
+    class BufferAllocator
+    {
+
+      public:
+
+        /// Destructor.
+        virtual ~BufferAllocator ()
+        {
+        }
+
+        /// Allocates a buffer.
+        ///
+        /// @param size The size of the buffer, in bytes.
+        ///
+        /// @returns A buffer aligned for any type.
+        ///
+        /// @throw noise::ExceptionOutOfMemory Out of memory.
+        virtual void* Allocate (size_t size) = 0;
+
+        /// Gives back a buffer returned by Allocate().
+        ///
+        /// @param pBuffer The buffer.
+        virtual void Free (void* pBuffer) = 0;
+
+    };
+
+    /// Sets the allocator of the buffers allocated from now on, by any
+    /// thread.
+    ///
+    /// @param pAllocator The allocator, or NULL for the heap.
+    ///
+    /// The allocator must exist until every buffer allocated from it has
+    /// been given back.
+    void SetBufferAllocator (BufferAllocator* pAllocator);
+
+    /// Returns the allocator set with SetBufferAllocator(), or NULL if
+    /// buffers come from the heap.
+    BufferAllocator* GetBufferAllocator ();
+
+    /// Allocates a buffer from the current allocator.
+    ///
+    /// @param size The size of the buffer, in bytes.
+    /// @param pAllocator Receives the allocator the buffer came from.
+    ///
+    /// @returns The buffer.
+    ///
+    /// @throw noise::ExceptionOutOfMemory Out of memory.
+    void* AllocateBuffer (size_t size, BufferAllocator*& pAllocator);
+
+    /// Gives back a buffer returned by AllocateBuffer().
+    ///
+    /// @param pBuffer The buffer, or NULL.
+    /// @param pAllocator The allocator the buffer came from.
+    void FreeBuffer (void* pBuffer, BufferAllocator* pAllocator);
+
     /// Defines a color.
     ///
     /// A color object contains four 8-bit channels: red, green, blue, and an
@@ -197,6 +275,19 @@ namespace noise
     /// If an application passes 0.25 to the GetColor() method, this method
     /// will return a very light pink color that is one quarter of the way
     /// between white and red.
+    ///
+    /// <b>Lookup table</b>
+    ///
+    /// GetColor() searches the gradient points and interpolates on every
+    /// call.  When many colors are needed (for example, once per pixel of a
+    /// rendered image), call BuildLookupTable() once after the gradient
+    /// points are defined and then call GetLookupColor() instead.  The lookup
+    /// table samples the gradient at evenly-spaced positions between the
+    /// first and last gradient points; its resolution is set by the
+    /// SetLookupTableSize() method.
+    ///
+    /// GetColor() and GetLookupColor() do not modify the object, so they
+    /// may be called from several threads at once.
     class GradientColor
     {
 
@@ -226,12 +317,24 @@ namespace noise
         /// @post All gradient points from this gradient object are deleted.
         void Clear ();
 
+        /// Builds the color lookup table from the current gradient points.
+        ///
+        /// @pre There are at least two gradient points in the gradient.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        /// @throw noise::ExceptionOutOfMemory Out of memory.
+        ///
+        /// The lookup table is invalidated whenever a gradient point is added
+        /// or the gradient is cleared.  Call this method again before calling
+        /// GetLookupColor().
+        void BuildLookupTable ();
+
         /// Returns the color at the specified position in the color gradient.
         ///
         /// @param gradientPos The specified position.
         ///
         /// @returns The color at that position.
-        const Color& GetColor (double gradientPos) const;
+        Color GetColor (double gradientPos) const;
 
         /// Returns a pointer to the array of gradient points in this object.
         ///
@@ -256,6 +359,62 @@ namespace noise
           return m_gradientPointCount;
         }
 
+        /// Returns the color nearest to the specified position in the color
+        /// lookup table.
+        ///
+        /// @param gradientPos The specified position.
+        ///
+        /// @returns The color at that position.
+        ///
+        /// @pre BuildLookupTable() has been called since the gradient was
+        /// last changed.
+        ///
+        /// Positions outside the range of the gradient points return the
+        /// color of the nearest end of the gradient, as GetColor() does.
+        const Color& GetLookupColor (double gradientPos) const
+        {
+          assert (m_isLookupTableValid);
+          double index = (gradientPos - m_lookupMinPos) * m_lookupScale + 0.5;
+          if (!(index > 0.0)) {
+            return m_pLookupTable[0];
+          } else if (index >= (double)m_lookupTableSize) {
+            return m_pLookupTable[m_lookupTableSize - 1];
+          }
+          return m_pLookupTable[(int)index];
+        }
+
+        /// Returns the number of entries in the color lookup table.
+        ///
+        /// @returns The number of entries in the color lookup table.
+        int GetLookupTableSize () const
+        {
+          return m_lookupTableSize;
+        }
+
+        /// Determines if the color lookup table matches the current gradient
+        /// points.
+        ///
+        /// @returns
+        /// - @a true if the lookup table is up to date.
+        /// - @a false if BuildLookupTable() must be called first.
+        bool IsLookupTableValid () const
+        {
+          return m_isLookupTableValid;
+        }
+
+        /// Sets the number of entries in the color lookup table.
+        ///
+        /// @param lookupTableSize The number of entries.
+        ///
+        /// @pre The number of entries is at least two.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        ///
+        /// More entries reduce the banding between gradient points at the
+        /// cost of memory.  The lookup table must be rebuilt after calling
+        /// this method.
+        void SetLookupTableSize (int lookupTableSize);
+
       private:
 
         /// Determines the array index in which to insert the gradient point
@@ -299,9 +458,21 @@ namespace noise
         /// Array that stores the gradient points.
         GradientPoint* m_pGradientPoints;
 
-        /// A color object that is used by a gradient object to store a
-        /// temporary value.
-        mutable Color m_workingColor;
+        /// A flag specifying whether the lookup table matches the current
+        /// gradient points.
+        bool m_isLookupTableValid;
+
+        /// The gradient position of the first entry in the lookup table.
+        double m_lookupMinPos;
+
+        /// The number of lookup table entries per unit of gradient position.
+        double m_lookupScale;
+
+        /// The number of entries in the lookup table.
+        int m_lookupTableSize;
+
+        /// Array that stores the lookup table.
+        Color* m_pLookupTable;
     };
 
     /// Implements a noise map, a 2-dimensional array of floating-point
@@ -691,6 +862,9 @@ namespace noise
         /// the noise map, not the number of bytes.
         size_t m_memUsed;
 
+        /// The allocator the noise map buffer came from.
+        BufferAllocator* m_pAllocator;
+
         /// A pointer to the noise map buffer.
         float* m_pNoiseMap;
 
@@ -702,6 +876,161 @@ namespace noise
 
     };
 
+    /// Implements a mipmap pyramid of a noise map, storing the average,
+    /// minimum and maximum value of each block of the source noise map.
+    ///
+    /// Level 0 is a copy of the source noise map.  Each point in level @a n
+    /// + 1 covers a 2 x 2 block of points in level @a n, so level @a n is
+    /// ( @a width / 2<sup>n</sup> ) x ( @a height / 2<sup>n</sup> ) points,
+    /// rounded up.  The last level is a single point holding the range of
+    /// the whole noise map.
+    ///
+    /// The averages give coarse previews of the noise map.  The minimum and
+    /// maximum values bound every point below them, which is what bounding
+    /// boxes, culling and ray marching need.
+    ///
+    /// <b>Building the pyramid</b>
+    ///
+    /// The source noise map is split into square tiles whose size is a power
+    /// of two.  The tiles are processed in parallel on the shared worker
+    /// pool, and each tile builds all of its levels while its values are
+    /// still in the cache.  The few levels that are coarser than one tile
+    /// are built afterwards.
+    class NoiseMapPyramid
+    {
+
+      public:
+
+        /// Constructor.
+        ///
+        /// Creates an empty pyramid.
+        NoiseMapPyramid ();
+
+        /// Destructor.
+        ~NoiseMapPyramid ();
+
+        /// Builds the pyramid from a noise map.
+        ///
+        /// @param sourceNoiseMap The source noise map.
+        ///
+        /// @pre The source noise map is not empty.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        /// @throw noise::ExceptionOutOfMemory Out of memory.
+        ///
+        /// The pyramid keeps its own copy of the values, so the source noise
+        /// map may be changed or destroyed afterwards.
+        void Build (const NoiseMap& sourceNoiseMap);
+
+        /// Frees all levels of the pyramid.
+        void Clear ();
+
+        /// Returns the average values at a level of the pyramid.
+        ///
+        /// @param level The level; zero is the source noise map.
+        ///
+        /// @returns The noise map of average values for the level.
+        ///
+        /// @pre The level exists.
+        const NoiseMap& GetAverageLevel (int level) const
+        {
+          assert (level >= 0 && level < m_levelCount);
+          return m_pAverageLevels[level];
+        }
+
+        /// Returns the number of levels in the pyramid.
+        ///
+        /// @returns The number of levels, or zero if the pyramid is empty.
+        int GetLevelCount () const
+        {
+          return m_levelCount;
+        }
+
+        /// Returns the maximum values at a level of the pyramid.
+        ///
+        /// @param level The level; zero is the source noise map.
+        ///
+        /// @returns The noise map of maximum values for the level.
+        ///
+        /// @pre The level exists.
+        const NoiseMap& GetMaxLevel (int level) const
+        {
+          assert (level >= 0 && level < m_levelCount);
+          return level == 0 ? m_pAverageLevels[0]: m_pMaxLevels[level];
+        }
+
+        /// Returns the minimum values at a level of the pyramid.
+        ///
+        /// @param level The level; zero is the source noise map.
+        ///
+        /// @returns The noise map of minimum values for the level.
+        ///
+        /// @pre The level exists.
+        const NoiseMap& GetMinLevel (int level) const
+        {
+          assert (level >= 0 && level < m_levelCount);
+          return level == 0 ? m_pAverageLevels[0]: m_pMinLevels[level];
+        }
+
+        /// Returns bounds on the values within a region of the source noise
+        /// map.
+        ///
+        /// @param x0 The left edge of the region, in source points.
+        /// @param y0 The lower edge of the region.
+        /// @param x1 The right edge of the region; this column is excluded.
+        /// @param y1 The upper edge of the region; this row is excluded.
+        /// @param minValue On exit, a value no greater than any value in the
+        /// region.
+        /// @param maxValue On exit, a value no less than any value in the
+        /// region.
+        ///
+        /// @pre The pyramid is not empty.
+        /// @pre The region contains at least one point of the source noise
+        /// map once it is clipped to the noise map.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        ///
+        /// This method reads at most 2 x 2 points from the first level
+        /// whose points are large enough, so it takes the same time for any
+        /// size of region.  The bounds are conservative: they are the range
+        /// of a block of points that contains the region and is less than
+        /// four times its size along each axis.
+        void GetRegionMinMax (int x0, int y0, int x1, int y1, float& minValue,
+          float& maxValue) const;
+
+      private:
+
+        /// Copy constructor; not implemented, as pyramids are not copied.
+        NoiseMapPyramid (const NoiseMapPyramid& rhs);
+
+        /// Assignment operator; not implemented.
+        NoiseMapPyramid& operator= (const NoiseMapPyramid& rhs);
+
+        /// Builds a rectangle of points in one level from the level below.
+        ///
+        /// @param level The level to build; at least 1.
+        /// @param x0 The left edge of the rectangle, in points of the level.
+        /// @param y0 The lower edge of the rectangle.
+        /// @param x1 The right edge of the rectangle; this column is
+        /// excluded.
+        /// @param y1 The upper edge of the rectangle; this row is excluded.
+        void BuildLevelRegion (int level, int x0, int y0, int x1, int y1);
+
+        /// The number of levels in the pyramid.
+        int m_levelCount;
+
+        /// The average values of each level.  Level 0 holds the copy of
+        /// the source noise map.
+        NoiseMap* m_pAverageLevels;
+
+        /// The maximum values of each level.  Level 0 is unused.
+        NoiseMap* m_pMaxLevels;
+
+        /// The minimum values of each level.  Level 0 is unused.
+        NoiseMap* m_pMinLevels;
+
+    };
+
     /// Implements an image, a 2-dimensional array of color values.
     ///
     /// An image can be used to store a color texture.
@@ -1084,6 +1413,9 @@ namespace noise
         /// the image, not the number of bytes.
         size_t m_memUsed;
 
+        /// The allocator the image buffer came from.
+        BufferAllocator* m_pAllocator;
+
         /// A pointer to the image buffer.
         Color* m_pImage;
 
@@ -1120,6 +1452,16 @@ namespace noise
         {
         }
 
+        /// Returns the size of the encoded file, in bytes.
+        ///
+        /// @pre SetSourceImage() has been previously called.
+        ///
+        /// @returns The number of bytes that WriteDestFile() writes to the
+        /// file and WriteDestBuffer() writes to the buffer.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        size_t CalcDestSize () const;
+
         /// Returns the name of the file to write.
         ///
         /// @returns The name of the file to write.
@@ -1163,8 +1505,28 @@ namespace noise
         /// file.  Before calling this method, call the SetSourceImage()
         /// method to specify the image, then call the SetDestFilename()
         /// method to specify the name of the file to write.
+        ///
+        /// The whole file is encoded into memory by WriteDestBuffer() and
+        /// then written with a single call.
         void WriteDestFile ();
 
+        /// Encodes the contents of the image object into a memory buffer.
+        ///
+        /// @param pDestBuffer The buffer that receives the encoded file.
+        /// @param destBufferSize The size of the buffer, in bytes.
+        ///
+        /// @pre SetSourceImage() has been previously called.
+        /// @pre The buffer is at least CalcDestSize() bytes long.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        ///
+        /// The buffer receives exactly the bytes that WriteDestFile() would
+        /// write to the file, so the caller may send them anywhere (a
+        /// memory-mapped file, an archive or a network stream.)  The lines
+        /// are converted in parallel on the shared worker pool.
+        void WriteDestBuffer (noise::uint8* pDestBuffer,
+          size_t destBufferSize) const;
+
       protected:
 
         /// Calculates the width of one horizontal line in the file, in bytes.
@@ -1217,6 +1579,16 @@ namespace noise
         {
         }
 
+        /// Returns the size of the encoded file, in bytes.
+        ///
+        /// @pre SetSourceNoiseMap() has been previously called.
+        ///
+        /// @returns The number of bytes that WriteDestFile() writes to the
+        /// file and WriteDestBuffer() writes to the buffer.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        size_t CalcDestSize () const;
+
         /// Returns the name of the file to write.
         ///
         /// @returns The name of the file to write.
@@ -1282,8 +1654,28 @@ namespace noise
         ///
         /// This object assumes that the noise values represent elevations in
         /// meters.
+        ///
+        /// The whole file is encoded into memory by WriteDestBuffer() and
+        /// then written with a single call.
         void WriteDestFile ();
 
+        /// Encodes the contents of the noise map object into a memory
+        /// buffer.
+        ///
+        /// @param pDestBuffer The buffer that receives the encoded file.
+        /// @param destBufferSize The size of the buffer, in bytes.
+        ///
+        /// @pre SetSourceNoiseMap() has been previously called.
+        /// @pre The buffer is at least CalcDestSize() bytes long.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        ///
+        /// The buffer receives exactly the bytes that WriteDestFile() would
+        /// write to the file.  The lines are converted in parallel on the
+        /// shared worker pool.
+        void WriteDestBuffer (noise::uint8* pDestBuffer,
+          size_t destBufferSize) const;
+
       protected:
     
         /// Calculates the width of one horizontal line in the file, in bytes.
@@ -1305,6 +1697,351 @@ namespace noise
 
     };
 
+    /// Abstract base class for a raw height-map writer.
+    ///
+    /// A height-map writer stores the values of a noise map at full
+    /// precision, unlike WriterBMP, which stores an 8-bit rendering of the
+    /// noise map.  Each derived class defines one file format.
+    ///
+    /// <b>Normalizing the values</b>
+    ///
+    /// If normalization is enabled, the writer maps the values in the noise
+    /// map onto the 0.0 to 1.0 range before encoding them.  By default the
+    /// lowest and highest values in the noise map are mapped to 0.0 and 1.0;
+    /// call SetNormalizeBounds() to use a fixed range instead, so that
+    /// several maps share the same scale.  Values outside of the range are
+    /// clamped.  Integer formats then scale the 0.0 to 1.0 range to their
+    /// full range of values.
+    ///
+    /// <b>Writing the height map</b>
+    ///
+    /// To write the height map, perform the following steps:
+    /// - Pass the filename to the SetDestFilename() method.
+    /// - Pass a NoiseMap object to the SetSourceNoiseMap() method.
+    /// - Call the WriteDestFile() method.
+    ///
+    /// Alternatively, call the WriteDestBuffer() method to encode the file
+    /// into memory supplied by the caller.
+    ///
+    /// If mapped output is enabled, WriteDestFile() encodes the file
+    /// directly into a memory-mapped view of the destination file (see
+    /// mapped_file.h) instead of a temporary buffer, so the file never needs
+    /// a second copy in memory.
+    class WriterHeightMap
+    {
+
+      public:
+
+        /// Constructor.
+        WriterHeightMap ();
+
+        /// Destructor.
+        virtual ~WriterHeightMap ()
+        {
+        }
+
+        /// Returns the size of the encoded file, in bytes.
+        ///
+        /// @pre SetSourceNoiseMap() has been previously called.
+        ///
+        /// @returns The number of bytes that WriteDestFile() writes to the
+        /// file and WriteDestBuffer() writes to the buffer.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        size_t CalcDestSize () const;
+
+        /// Clears the normalization bounds so that the lowest and highest
+        /// values in the noise map are used instead.
+        void ClearNormalizeBounds ()
+        {
+          m_hasNormalizeBounds = false;
+        }
+
+        /// Enables or disables writing through a memory-mapped file.
+        ///
+        /// @param enable A flag that enables or disables mapped output.
+        void EnableMappedOutput (bool enable = true)
+        {
+          m_isMappedOutputEnabled = enable;
+        }
+
+        /// Enables or disables normalization of the noise-map values.
+        ///
+        /// @param enable A flag that enables or disables normalization.
+        void EnableNormalize (bool enable = true)
+        {
+          m_isNormalizeEnabled = enable;
+        }
+
+        /// Returns the name of the file to write.
+        ///
+        /// @returns The name of the file to write.
+        std::string GetDestFilename () const
+        {
+          return m_destFilename;
+        }
+
+        /// Determines if writing through a memory-mapped file is enabled.
+        ///
+        /// @returns
+        /// - @a true if mapped output is enabled.
+        /// - @a false if mapped output is disabled.
+        bool IsMappedOutputEnabled () const
+        {
+          return m_isMappedOutputEnabled;
+        }
+
+        /// Determines if normalization of the noise-map values is enabled.
+        ///
+        /// @returns
+        /// - @a true if normalization is enabled.
+        /// - @a false if normalization is disabled.
+        bool IsNormalizeEnabled () const
+        {
+          return m_isNormalizeEnabled;
+        }
+
+        /// Sets the name of the file to write.
+        ///
+        /// @param filename The name of the file to write.
+        ///
+        /// Call this method before calling the WriteDestFile() method.
+        void SetDestFilename (const std::string& filename)
+        {
+          m_destFilename = filename;
+        }
+
+        /// Sets a fixed range of values to map onto the 0.0 to 1.0 range
+        /// when normalization is enabled.
+        ///
+        /// @param lowerBound The value that is mapped to 0.0.
+        /// @param upperBound The value that is mapped to 1.0.
+        ///
+        /// @pre The lower bound is less than the upper bound.
+        ///
+        /// @throw noise::ExceptionInvalidParam An invalid parameter was
+        /// specified; see the preconditions for more information.
+        void SetNormalizeBounds (float lowerBound, float upperBound);
+
+        /// Sets the noise map object that is written to the file.
+        ///
+        /// @param sourceNoiseMap The noise map object to write.
+        ///
+        /// This object only stores a pointer to a noise map object, so make
+        /// sure this object exists before calling the WriteDestFile() method.
+        void SetSourceNoiseMap (const NoiseMap& sourceNoiseMap)
+        {
+          m_pSourceNoiseMap = &sourceNoiseMap;
+        }
+
+        /// Encodes the contents of the noise map object into a memory
+        /// buffer.
+        ///
+        /// @param pDestBuffer The buffer that receives the encoded file.
+        /// @param destBufferSize The size of the buffer, in bytes.
+        ///
+        /// @pre SetSourceNoiseMap() has been previously called.
+        /// @pre The buffer is at least CalcDestSize() bytes long.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        ///
+        /// The buffer receives exactly the bytes that WriteDestFile() would
+        /// write to the file.  The lines are converted in parallel on the
+        /// shared worker pool.
+        void WriteDestBuffer (noise::uint8* pDestBuffer,
+          size_t destBufferSize) const;
+
+        /// Writes the contents of the noise map object to the file.
+        ///
+        /// @pre SetDestFilename() has been previously called.
+        /// @pre SetSourceNoiseMap() has been previously called.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        /// @throw noise::ExceptionOutOfMemory Out of memory.
+        /// @throw noise::ExceptionUnknown An unknown exception occurred.
+        /// Possibly the file could not be written.
+        void WriteDestFile ();
+
+      protected:
+
+        /// Converts noise-map values to normalized values.  A value v
+        /// becomes v * scale + bias, clamped to the 0.0 to 1.0 range, if
+        /// normalize is set; otherwise it is left unchanged.
+        struct ValueMapping
+        {
+          bool normalize;
+          float scale;
+          float bias;
+
+          float Apply (float value) const
+          {
+            if (!normalize) {
+              return value;
+            }
+            return GetMin (GetMax (value * scale + bias, 0.0f), 1.0f);
+          }
+        };
+
+        /// Returns the size of the file header, in bytes.
+        ///
+        /// @param width The width of the noise map, in points.
+        /// @param height The height of the noise map, in points.
+        virtual int CalcHeaderSize (int width, int height) const = 0;
+
+        /// Returns the size of one encoded point, in bytes.
+        virtual int GetPointSize () const = 0;
+
+        /// Determines if the file stores the top line of the noise map
+        /// first.  The noise map stores its bottom line first.
+        virtual bool IsTopLineFirst () const
+        {
+          return false;
+        }
+
+        /// Encodes the file header.
+        ///
+        /// @param pDest The buffer that receives the header.
+        /// @param width The width of the noise map, in points.
+        /// @param height The height of the noise map, in points.
+        virtual void WriteHeader (noise::uint8* pDest, int width,
+          int height) const = 0;
+
+        /// Encodes one horizontal line of the noise map.
+        ///
+        /// @param pDest The buffer that receives the line.
+        /// @param pSource The values in the line.
+        /// @param width The number of values in the line.
+        /// @param mapping The mapping to apply to each value.
+        virtual void WriteLine (noise::uint8* pDest, const float* pSource,
+          int width, const ValueMapping& mapping) const = 0;
+
+        /// Name of the file to write.
+        std::string m_destFilename;
+
+        /// Determines if the normalization bounds have been set.
+        bool m_hasNormalizeBounds;
+
+        /// A flag specifying whether mapped output is enabled.
+        bool m_isMappedOutputEnabled;
+
+        /// A flag specifying whether normalization is enabled.
+        bool m_isNormalizeEnabled;
+
+        /// The value mapped to 0.0 by normalization.
+        float m_normalizeLowerBound;
+
+        /// The value mapped to 1.0 by normalization.
+        float m_normalizeUpperBound;
+
+        /// A pointer to the noise map that will be written to the file.
+        const NoiseMap* m_pSourceNoiseMap;
+
+    };
+
+    /// 16-bit raw height-map writer class.
+    ///
+    /// This class creates a headerless file of unsigned 16-bit little-endian
+    /// integers, one for each point in the noise map.  The lines are stored
+    /// in the same order as the noise map, starting with line 0.
+    ///
+    /// If normalization is disabled, each value is rounded to the nearest
+    /// integer and clamped to the 0 to 65535 range, so the noise map should
+    /// already hold values in that range.  Otherwise the normalized 0.0 to
+    /// 1.0 range is scaled to the 0 to 65535 range.
+    class WriterRAW16: public WriterHeightMap
+    {
+
+      protected:
+
+        virtual int CalcHeaderSize (int width, int height) const;
+
+        virtual int GetPointSize () const;
+
+        virtual void WriteHeader (noise::uint8* pDest, int width,
+          int height) const;
+
+        virtual void WriteLine (noise::uint8* pDest, const float* pSource,
+          int width, const ValueMapping& mapping) const;
+
+    };
+
+    /// 32-bit floating-point raw height-map writer class.
+    ///
+    /// This class creates a headerless file of 32-bit little-endian
+    /// floating-point values, one for each point in the noise map.  The
+    /// lines are stored in the same order as the noise map, starting with
+    /// line 0.
+    class WriterRAWF32: public WriterHeightMap
+    {
+
+      protected:
+
+        virtual int CalcHeaderSize (int width, int height) const;
+
+        virtual int GetPointSize () const;
+
+        virtual void WriteHeader (noise::uint8* pDest, int width,
+          int height) const;
+
+        virtual void WriteLine (noise::uint8* pDest, const float* pSource,
+          int width, const ValueMapping& mapping) const;
+
+    };
+
+    /// Portable graymap (*.pgm) writer class.
+    ///
+    /// This class creates a binary 16-bit portable graymap, which most image
+    /// editors can open.  The values are encoded in the same way as
+    /// WriterRAW16, but in big-endian order as the format requires, and the
+    /// top line of the noise map is stored first.
+    ///
+    /// Enable normalization unless the noise map already holds values in
+    /// the 0 to 65535 range.
+    class WriterPGM: public WriterHeightMap
+    {
+
+      protected:
+
+        virtual int CalcHeaderSize (int width, int height) const;
+
+        virtual int GetPointSize () const;
+
+        virtual bool IsTopLineFirst () const
+        {
+          return true;
+        }
+
+        virtual void WriteHeader (noise::uint8* pDest, int width,
+          int height) const;
+
+        virtual void WriteLine (noise::uint8* pDest, const float* pSource,
+          int width, const ValueMapping& mapping) const;
+
+    };
+
+    /// Portable floatmap (*.pfm) writer class.
+    ///
+    /// This class creates a single-channel portable floatmap holding one
+    /// 32-bit little-endian floating-point value for each point in the noise
+    /// map.  As the format requires, the bottom line of the noise map is
+    /// stored first.
+    class WriterPFM: public WriterHeightMap
+    {
+
+      protected:
+
+        virtual int CalcHeaderSize (int width, int height) const;
+
+        virtual int GetPointSize () const;
+
+        virtual void WriteHeader (noise::uint8* pDest, int width,
+          int height) const;
+
+        virtual void WriteLine (noise::uint8* pDest, const float* pSource,
+          int width, const ValueMapping& mapping) const;
+
+    };
+
     /// Abstract base class for a noise-map builder
     ///
     /// A builder class builds a noise map by filling it with coherent-noise
@@ -1607,6 +2344,28 @@ namespace noise
 
         virtual void Build ();
 
+        /// Builds one rectangular region of the noise map into a buffer.
+        ///
+        /// @param x0 The left edge of the region.
+        /// @param z0 The bottom edge of the region.
+        /// @param x1 One past the right edge of the region.
+        /// @param z1 One past the top edge of the region.
+        /// @param pDest The buffer that receives the region.
+        /// @param destStride The number of floats from one row of the
+        /// region to the next in the buffer.
+        ///
+        /// @pre SetBounds(), SetDestSize() and SetSourceModule() have been
+        /// previously called.
+        /// @pre The region lies within the destination size.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        ///
+        /// The destination noise map is not used.  Each point has the same
+        /// value that Build() gives it, so a noise map can be built a region
+        /// at a time by callers that schedule the regions themselves.
+        void BuildRegion (int x0, int z0, int x1, int z1, float* pDest,
+          int destStride) const;
+
         /// Enables or disables seamless tiling.
         ///
         /// @param enable A flag that enables or disables seamless tiling.
@@ -1692,6 +2451,23 @@ namespace noise
           m_upperZBound = upperZBound;
         }
 
+      protected:
+
+        /// Fills one row of a planar noise map.
+        ///
+        /// @param planeModel The plane model wrapping the source module.
+        /// @param pDest The row to fill.
+        /// @param width The number of points in the row.
+        /// @param zCur The z coordinate of the row.
+        /// @param xBegin The first point of the row to fill.
+        /// @param xEnd One past the last point of the row to fill.
+        ///
+        /// pDest receives the points from xBegin to xEnd.  Both this class
+        /// and NoiseMapBuilderPlaneStream fill their rows with this method,
+        /// so they produce identical values.
+        void BuildRow (const model::Plane& planeModel, float* pDest,
+          int width, double zCur, int xBegin, int xEnd) const;
+
       private:
 
         /// A flag specifying whether seamless tiling is enabled.
@@ -1711,6 +2487,139 @@ namespace noise
 
     };
 
+    /// Builds a planar noise map of any size and streams it to a file.
+    ///
+    /// NoiseMapBuilderPlane needs the whole noise map in memory, and a
+    /// NoiseMap object is limited to RASTER_MAX_WIDTH by RASTER_MAX_HEIGHT
+    /// points.  This builder instead fills the noise map in horizontal bands
+    /// and writes each band to the destination file as soon as it is
+    /// complete, so it only ever holds two bands in memory.  The values are
+    /// identical to those built by NoiseMapBuilderPlane with the same
+    /// settings.
+    ///
+    /// The file holds one 32-bit little-endian floating-point value for
+    /// each point, with no header, in one of two layouts:
+    /// - If the tile size is zero, the lines are stored one after another,
+    ///   starting with line 0.
+    /// - Otherwise the noise map is split into square tiles, which are
+    ///   stored one after another in row order starting with the tile
+    ///   holding point (0, 0).  Each tile stores its own lines in order.
+    ///   The tiles on the right and top edges are clipped to the noise map,
+    ///   so the file is the same size in both layouts.
+    ///
+    /// The bounds, seamless flag, source module, destination size and
+    /// callback are set as for NoiseMapBuilderPlane; the destination noise
+    /// map is not used.  The callback is called for every row in order after
+    /// its band has been written.
+    ///
+    /// The rows in each band are built in parallel on the shared worker pool
+    /// (see job_system.h), so the source module must be safe to call from
+    /// several threads at once.  This rules out module::Cache.
+    class NoiseMapBuilderPlaneStream: public NoiseMapBuilderPlane
+    {
+
+      public:
+
+        /// Constructor.
+        NoiseMapBuilderPlaneStream ();
+
+        /// Builds the noise map and writes it to the destination file.
+        ///
+        /// @pre SetBounds() has been previously called.
+        /// @pre SetDestFilename() has been previously called.
+        /// @pre SetDestSize() has been previously called.
+        /// @pre SetSourceModule() has been previously called.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        /// @throw noise::ExceptionOutOfMemory Out of memory.
+        /// @throw noise::ExceptionUnknown The file could not be written.
+        virtual void Build ();
+
+        /// Returns the number of lines built and written at a time when
+        /// the tile size is zero.
+        ///
+        /// @returns The band height, in points.
+        int GetBandHeight () const
+        {
+          return m_bandHeight;
+        }
+
+        /// Returns the name of the file to write.
+        ///
+        /// @returns The name of the file to write.
+        std::string GetDestFilename () const
+        {
+          return m_destFilename;
+        }
+
+        /// Returns the width and height of the tiles in the file.
+        ///
+        /// @returns The tile size, in points, or zero if the lines are
+        /// stored one after another.
+        int GetTileSize () const
+        {
+          return m_tileSize;
+        }
+
+        /// Sets the number of lines built and written at a time when the
+        /// tile size is zero.
+        ///
+        /// @param bandHeight The band height, in points.
+        ///
+        /// @pre The band height is at least 1.
+        ///
+        /// @throw noise::ExceptionInvalidParam An invalid parameter was
+        /// specified; see the preconditions for more information.
+        ///
+        /// Larger bands give the worker pool more rows to share but take
+        /// more memory.  When tiles are written, the band height is the
+        /// tile size instead.
+        void SetBandHeight (int bandHeight)
+        {
+          if (bandHeight < 1) {
+            throw noise::ExceptionInvalidParam ();
+          }
+          m_bandHeight = bandHeight;
+        }
+
+        /// Sets the name of the file to write.
+        ///
+        /// @param filename The name of the file to write.
+        void SetDestFilename (const std::string& filename)
+        {
+          m_destFilename = filename;
+        }
+
+        /// Sets the width and height of the tiles in the file.
+        ///
+        /// @param tileSize The tile size, in points, or zero to store the
+        /// lines one after another.
+        ///
+        /// @pre The tile size is not negative.
+        ///
+        /// @throw noise::ExceptionInvalidParam An invalid parameter was
+        /// specified; see the preconditions for more information.
+        void SetTileSize (int tileSize)
+        {
+          if (tileSize < 0) {
+            throw noise::ExceptionInvalidParam ();
+          }
+          m_tileSize = tileSize;
+        }
+
+      private:
+
+        /// The number of lines built at a time when the tile size is zero.
+        int m_bandHeight;
+
+        /// Name of the file to write.
+        std::string m_destFilename;
+
+        /// The width and height of the tiles in the file, or zero.
+        int m_tileSize;
+
+    };
+
 
     /// Builds a spherical noise map.
     ///
@@ -2061,6 +2970,15 @@ namespace noise
           return m_lightElev;
         }
 
+        /// Returns the number of entries in the color lookup table used by
+        /// the Render() method.
+        ///
+        /// @returns The number of entries in the color lookup table.
+        int GetGradientLookupSize () const
+        {
+          return m_gradient.GetLookupTableSize ();
+        }
+
         /// Returns the intensity of the light source.
         ///
         /// @returns The intensity of the light source.
@@ -2116,6 +3034,10 @@ namespace noise
         /// The background image and the destination image can safely refer to
         /// the same image, although in this case, the destination image is
         /// irretrievably blended into the background image.
+        ///
+        /// The image is rendered as tiles on the shared worker pool (see
+        /// job_system.h).  The result is identical to rendering the image
+        /// one row at a time.
         void Render ();
 
         /// Sets the background image.
@@ -2135,6 +3057,23 @@ namespace noise
           m_pBackgroundImage = &backgroundImage;
         }
 
+        /// Sets the number of entries in the color lookup table used by the
+        /// Render() method.
+        ///
+        /// @param lookupSize The number of entries.
+        ///
+        /// @pre The number of entries is at least two.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        ///
+        /// The Render() method maps each noise value to a color through a
+        /// lookup table that is built once per change to the color gradient.
+        /// Larger tables reduce banding between gradient points.
+        void SetGradientLookupSize (int lookupSize)
+        {
+          m_gradient.SetLookupTableSize (lookupSize);
+        }
+
         /// Sets the destination image.
         ///
         /// @param destImage The destination image.
@@ -2280,20 +3219,32 @@ namespace noise
         Color CalcDestColor (const Color& sourceColor,
           const Color& backgroundColor, double lightValue) const;
 
-        /// Calculates the intensity of the light given some elevation values.
+        /// Calculates the light factors that are constant over the image.
         ///
-        /// @param center Elevation of the center point.
-        /// @param left Elevation of the point directly left of the center
-        /// point.
-        /// @param right Elevation of the point directly right of the center
-        /// point.
-        /// @param down Elevation of the point directly below the center
-        /// point.
-        /// @param up Elevation of the point directly above the center point.
+        /// @param io Receives the ambient intensity of the light.
+        /// @param ix Receives the weight of the horizontal slope.
+        /// @param iy Receives the weight of the vertical slope.
         ///
-        /// These values come directly from the noise map.
-        double CalcLightIntensity (double center, double left, double right,
-          double down, double up) const;
+        /// The intensity of the light at a point is ( @a ix * ( left - right
+        /// ) + @a iy * ( down - up ) + @a io ), where left, right, down and
+        /// up are the elevations of the point's four-neighbors.
+        void CalcLightFactors (double& io, double& ix, double& iy) const;
+
+        /// Renders a rectangular tile of the destination image.
+        ///
+        /// @param x0 The left edge of the tile.
+        /// @param y0 The bottom edge of the tile.
+        /// @param x1 One past the right edge of the tile.
+        /// @param y1 One past the top edge of the tile.
+        /// @param io The ambient intensity of the light.
+        /// @param ix The weight of the horizontal slope.
+        /// @param iy The weight of the vertical slope.
+        ///
+        /// The Render() method runs this method for every tile on the
+        /// shared worker pool.  The tile must be no wider than the tiles
+        /// used by the Render() method.
+        void RenderTile (int x0, int y0, int x1, int y1, double io, double ix,
+          double iy);
 
         /// The cosine of the azimuth of the light source.
         mutable double m_cosAzimuth;
@@ -2337,11 +3288,11 @@ namespace noise
         /// A pointer to the source noise map.
         const NoiseMap* m_pSourceNoiseMap;
 
-        /// Used by the CalcLightIntensity() method to recalculate the light
+        /// Used by the CalcLightFactors() method to recalculate the light
         /// values only if the light parameters change.
         ///
         /// When the light parameters change, this value is set to True.  When
-        /// the CalcLightIntensity() method is called, this value is set to
+        /// the CalcLightFactors() method is called, this value is set to
         /// false.
         mutable bool m_recalcLightValues;
 
@@ -2442,16 +3393,44 @@ namespace noise
           return m_isWrapEnabled;
         }
 
-        /// Renders the noise map to the destination image.
+        /// Renders the noise map to the destination image and/or the
+        /// destination normal buffer.
         ///
         /// @pre SetSourceNoiseMap() has been previously called.
-        /// @pre SetDestImage() has been previously called.
+        /// @pre SetDestImage() or SetDestNormalBuffer() has been previously
+        /// called.
         ///
         /// @post The original contents of the destination image is destroyed.
+        /// @post The destination image has the same size as the source noise
+        /// map.
         ///
         /// @throw noise::ExceptionInvalidParam See the preconditions.
+        ///
+        /// The image is rendered as tiles on the shared worker pool (see
+        /// job_system.h).  If both destinations are set, each normal is
+        /// calculated once and written to both of them.
         void Render ();
 
+        /// Renders one rectangular region of the destination normal buffer
+        /// on the calling thread.
+        ///
+        /// @param x0 The left edge of the region.
+        /// @param y0 The bottom edge of the region.
+        /// @param x1 One past the right edge of the region.
+        /// @param y1 One past the top edge of the region.
+        ///
+        /// @pre SetSourceNoiseMap() and SetDestNormalBuffer() have been
+        /// previously called, and no destination image is set.
+        /// @pre The region lies within the source noise map.
+        ///
+        /// @throw noise::ExceptionInvalidParam See the preconditions.
+        ///
+        /// Each normal reads its right and up neighbors, so those points of
+        /// the source noise map must be final before the region is
+        /// rendered.  Rendering every region gives the same normals as
+        /// Render().
+        void RenderRegion (int x0, int y0, int x1, int y1);
+
         /// Sets the bump height.
         ///
         /// @param bumpHeight The bump height.
@@ -2465,7 +3444,24 @@ namespace noise
         /// the application.
         void SetBumpHeight (double bumpHeight)
         {
-          m_bumpHeight = bumpHeight;
+          m_bumpHeight  = bumpHeight;
+          m_bumpHeightY = bumpHeight;
+        }
+
+        /// Sets separate bump heights along the x and y axes.
+        ///
+        /// @param bumpHeightX The bump height between a point and its right
+        /// neighbor.
+        /// @param bumpHeightY The bump height between a point and its up
+        /// neighbor.
+        ///
+        /// Use this when the points of the noise map are not equally far
+        /// apart along x and y.  GetBumpHeight() returns the bump height
+        /// along x.
+        void SetBumpHeights (double bumpHeightX, double bumpHeightY)
+        {
+          m_bumpHeight  = bumpHeightX;
+          m_bumpHeightY = bumpHeightY;
         }
 
         /// Sets the destination image.
@@ -2482,6 +3478,29 @@ namespace noise
           m_pDestImage = &destImage;
         }
 
+        /// Sets the destination normal buffer.
+        ///
+        /// @param pDestNormals A pointer to the destination normal buffer,
+        /// or NULL to stop writing to a normal buffer.
+        ///
+        /// The buffer receives three floats (x, y, z) for each point of the
+        /// source noise map, stored row by row with no padding, so it must
+        /// hold at least width * height * 3 floats.  The normals are unit
+        /// vectors in the same space as the normal map image: x points
+        /// along the rows, y points along the columns and z points out of
+        /// the noise map.  They are not quantized, so a mesh built from the
+        /// same noise map can use them directly.
+        ///
+        /// The destination image may be left unset if only the normal
+        /// buffer is needed.
+        ///
+        /// The buffer must exist throughout the lifetime of this object
+        /// unless another buffer replaces it.
+        void SetDestNormalBuffer (float* pDestNormals)
+        {
+          m_pDestNormals = pDestNormals;
+        }
+
         /// Sets the source noise map.
         ///
         /// @param sourceNoiseMap The source noise map.
@@ -2498,9 +3517,29 @@ namespace noise
         /// Calculates the normal vector at a given point on the noise map.
         ///
         /// @param nc The height of the given point in the noise map.
-        /// @param nr The height of the left neighbor.
+        /// @param nr The height of the right neighbor.
         /// @param nu The height of the up neighbor.
-        /// @param bumpHeight The bump height.
+        /// @param bumpHeightX The bump height towards the right neighbor.
+        /// @param bumpHeightY The bump height towards the up neighbor.
+        /// @param vx Receives the x component of the unit normal.
+        /// @param vy Receives the y component of the unit normal.
+        /// @param vz Receives the z component of the unit normal.
+        ///
+        /// The bump height specifies the ratio of spatial resolution to
+        /// elevation resolution.  For example, if your noise map has a
+        /// spatial resolution of 30 meters and an elevation resolution of one
+        /// meter, set the bump height to 1.0 / 30.0.
+        ///
+        /// The normal image and the normal buffer are both written from
+        /// this one calculation, so they always agree.
+        void CalcNormal (double nc, double nr, double nu, double bumpHeightX,
+          double bumpHeightY, double& vx, double& vy, double& vz) const;
+
+        /// Encodes a normal vector as a color.
+        ///
+        /// @param vxc The x component of the unit normal.
+        /// @param vyc The y component of the unit normal.
+        /// @param vzc The z component of the unit normal.
         ///
         /// @returns The normal vector represented as a color.
         ///
@@ -2508,26 +3547,34 @@ namespace noise
         /// into the (red, green, blue) channels of the returned color.  In
         /// order to represent the vector as a color, each coordinate of the
         /// normal is mapped from the -1.0 to 1.0 range to the 0 to 255 range.
+        Color CalcNormalColor (double vxc, double vyc, double vzc) const;
+
+        /// Renders a rectangular tile of the destination image.
         ///
-        /// The bump height specifies the ratio of spatial resolution to
-        /// elevation resolution.  For example, if your noise map has a
-        /// spatial resolution of 30 meters and an elevation resolution of one
-        /// meter, set the bump height to 1.0 / 30.0.
-        /// 
-        /// The spatial resolution and elevation resolution are determined by
-        /// the application.
-        Color CalcNormalColor (double nc, double nr, double nu,
-          double bumpHeight) const;
+        /// @param x0 The left edge of the tile.
+        /// @param y0 The bottom edge of the tile.
+        /// @param x1 One past the right edge of the tile.
+        /// @param y1 One past the top edge of the tile.
+        ///
+        /// The Render() method runs this method for every tile on the
+        /// shared worker pool.
+        void RenderTile (int x0, int y0, int x1, int y1);
 
-        /// The bump height for the normal map.
+        /// The bump height for the normal map along x.
         double m_bumpHeight;
 
+        /// The bump height for the normal map along y.
+        double m_bumpHeightY;
+
         /// A flag specifying whether wrapping is enabled.
         bool m_isWrapEnabled;
 
         /// A pointer to the destination image.
         Image* m_pDestImage;
 
+        /// A pointer to the destination normal buffer.
+        float* m_pDestNormals;
+
         /// A pointer to the source noise map.
         const NoiseMap* m_pSourceNoiseMap;
 
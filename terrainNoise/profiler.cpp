@@ -0,0 +1,270 @@
+/* profiler.cpp
+   Scoped timers for the terrain stages, exported as a Chrome trace and as
+   a summary table.
+*/
+
+#include "profiler.h"
+#include <atomic>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#define PROFILE_THREAD_LOCAL __declspec(thread)
+#else
+#include <chrono>
+#define PROFILE_THREAD_LOCAL __thread
+#endif
+
+/* Events in one chunk of a thread's buffer */
+const int PROFILE_CHUNK_EVENTS = 4096;
+
+struct profile_event
+{
+	const char* name;
+	long long start;
+	long long end;
+	unsigned long long count;
+	const char* unit;
+};
+
+/* Chunks are only ever added, so a reader can follow next and count while
+   the owning thread keeps appending */
+struct profile_chunk
+{
+	profile_chunk() : count(0), next(NULL) {}
+
+	profile_event events[PROFILE_CHUNK_EVENTS];
+	std::atomic<int> count;
+	std::atomic<profile_chunk*> next;
+};
+
+/* Only the owning thread changes a buffer's chunks and last. generation
+   is the clear the owner last caught up with: its events are current
+   only if that is still profile_generation. */
+struct profile_thread_buffer
+{
+	int thread_index;
+	profile_chunk* first;
+	profile_chunk* last;
+	std::atomic<unsigned int> generation;
+};
+
+/* Every thread's buffer, in the order the threads first recorded. The
+   mutex is only taken the first time a thread records, and by readers. */
+static std::mutex registry_mutex;
+static std::vector<profile_thread_buffer*> registry;
+
+/* Number of calls to clear so far */
+static std::atomic<unsigned int> profile_generation(0);
+
+static PROFILE_THREAD_LOCAL profile_thread_buffer* thread_buffer = NULL;
+
+long long profiler::now()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency = { 0 };
+	if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (long long)(counter.QuadPart / frequency.QuadPart) * 1000000000LL
+		+ (long long)(counter.QuadPart % frequency.QuadPart) * 1000000000LL / frequency.QuadPart;
+#else
+	return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void profiler::record(const char* name, long long start, long long end,
+	unsigned long long count, const char* unit)
+{
+	profile_thread_buffer* buffer = thread_buffer;
+	if (!buffer)
+	{
+		buffer = new profile_thread_buffer;
+		buffer->first = buffer->last = new profile_chunk;
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		buffer->generation.store(profile_generation.load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+		buffer->thread_index = (int)registry.size();
+		registry.push_back(buffer);
+		thread_buffer = buffer;
+	}
+
+	/* Drop the events from before a clear. The chunks are kept for reuse,
+	   so this only resets their counts. */
+	unsigned int generation = profile_generation.load(std::memory_order_acquire);
+	if (buffer->generation.load(std::memory_order_relaxed) != generation)
+	{
+		for (profile_chunk* chunk = buffer->first; chunk;
+			chunk = chunk->next.load(std::memory_order_relaxed))
+		{
+			chunk->count.store(0, std::memory_order_relaxed);
+		}
+		buffer->last = buffer->first;
+		buffer->generation.store(generation, std::memory_order_release);
+	}
+
+	profile_chunk* chunk = buffer->last;
+	int index = chunk->count.load(std::memory_order_relaxed);
+	if (index == PROFILE_CHUNK_EVENTS)
+	{
+		profile_chunk* next = chunk->next.load(std::memory_order_relaxed);
+		if (!next)
+		{
+			next = new profile_chunk;
+			chunk->next.store(next, std::memory_order_release);
+		}
+		buffer->last = chunk = next;
+		index = 0;
+	}
+
+	profile_event& e = chunk->events[index];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+	e.count = count;
+	e.unit = unit;
+	chunk->count.store(index + 1, std::memory_order_release);
+}
+
+/* Call fn(thread_index, event) for every event recorded since the last
+   clear. clear needs the mutex too, so the generation cannot change
+   while this runs, and a buffer whose owner has not caught up with it
+   holds only older events. */
+template <typename Fn>
+static void forEachEvent(Fn fn)
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	unsigned int generation = profile_generation.load(std::memory_order_relaxed);
+	for (size_t t = 0; t < registry.size(); t++)
+	{
+		if (registry[t]->generation.load(std::memory_order_acquire) != generation) continue;
+		for (profile_chunk* chunk = registry[t]->first; chunk;
+			chunk = chunk->next.load(std::memory_order_acquire))
+		{
+			int count = chunk->count.load(std::memory_order_acquire);
+			for (int i = 0; i < count; i++) fn(registry[t]->thread_index, chunk->events[i]);
+		}
+	}
+}
+
+/* Other threads may be recording, and only a buffer's owner may change
+   it, so clearing only starts a new generation. Each thread drops its
+   events the next time it records, and until then readers skip them. */
+void profiler::clear()
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	profile_generation.fetch_add(1, std::memory_order_release);
+}
+
+/* Write a string as a JSON string literal */
+static void writeJsonString(FILE* out, const char* s)
+{
+	fputc('"', out);
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\') fputc('\\', out);
+		if ((unsigned char)*s >= 0x20) fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+bool profiler::writeChromeTrace(const char* filename)
+{
+	FILE* out = fopen(filename, "w");
+	if (!out) return false;
+
+	/* Times are written in microseconds from the first event */
+	long long origin = 0;
+	bool first = true;
+	forEachEvent([&](int, const profile_event& e)
+	{
+		if (first || e.start < origin) origin = e.start;
+		first = false;
+	});
+
+	fprintf(out, "{\"traceEvents\":[\n");
+	size_t threads;
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		threads = registry.size();
+	}
+	for (size_t t = 0; t < threads; t++)
+	{
+		fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+			"\"args\":{\"name\":\"thread %d\"}}", t ? ",\n" : "", (int)t, (int)t);
+	}
+
+	bool any = threads > 0;
+	forEachEvent([&](int thread, const profile_event& e)
+	{
+		fprintf(out, "%s{\"name\":", any ? ",\n" : "");
+		writeJsonString(out, e.name);
+		fprintf(out, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+			thread, (e.start - origin) / 1000.0, (e.end - e.start) / 1000.0);
+		if (e.unit)
+		{
+			fprintf(out, ",\"args\":{");
+			writeJsonString(out, e.unit);
+			fprintf(out, ":%llu}", e.count);
+		}
+		fprintf(out, "}");
+		any = true;
+	});
+	fprintf(out, "\n]}\n");
+
+	bool ok = !ferror(out);
+	return fclose(out) == 0 && ok;
+}
+
+struct profile_total
+{
+	profile_total() : calls(0), total(0), longest(0), count(0), unit(NULL) {}
+
+	unsigned long long calls;
+	long long total;
+	long long longest;
+	unsigned long long count;
+	const char* unit;
+};
+
+void profiler::printSummary(FILE* out)
+{
+	std::map<std::string, profile_total> totals;
+	forEachEvent([&](int, const profile_event& e)
+	{
+		profile_total& t = totals[e.name];
+		long long duration = e.end - e.start;
+		t.calls++;
+		t.total += duration;
+		t.longest = std::max(t.longest, duration);
+		if (e.unit)
+		{
+			t.count += e.count;
+			t.unit = e.unit;
+		}
+	});
+
+	std::vector<std::pair<std::string, profile_total> > rows(totals.begin(), totals.end());
+	std::sort(rows.begin(), rows.end(),
+		[](const std::pair<std::string, profile_total>& a, const std::pair<std::string, profile_total>& b)
+		{
+			return a.second.total > b.second.total;
+		});
+
+	fprintf(out, "%-40s %8s %11s %11s %11s  %s\n", "Stage", "Calls", "Total ms", "Mean ms", "Max ms", "Rate");
+	for (size_t i = 0; i < rows.size(); i++)
+	{
+		const profile_total& t = rows[i].second;
+		fprintf(out, "%-40s %8llu %11.3f %11.3f %11.3f", rows[i].first.c_str(), t.calls,
+			t.total / 1e6, t.total / 1e6 / double(t.calls), t.longest / 1e6);
+		if (t.unit && t.total > 0) fprintf(out, "  %.4g %s/s", double(t.count) * 1e9 / double(t.total), t.unit);
+		fprintf(out, "\n");
+	}
+}
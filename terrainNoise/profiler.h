@@ -0,0 +1,102 @@
+/* profiler.h
+   Scoped timers for the terrain stages, exported as a Chrome trace
+   (chrome://tracing or https://ui.perfetto.dev) and as a summary table.
+
+   PROFILE_SCOPE("name") times the rest of the enclosing block. Each thread
+   appends its events to its own buffer, which is a list of fixed size
+   chunks that only that thread writes, so recording an event takes no
+   lock and never moves earlier events. A scope can carry a count of the
+   items it handled, such as samples or triangles, and the summary turns
+   the counts into rates.
+
+   Profiling is compiled in unless TERRAIN_PROFILE is defined as 0, and a
+   scope costs two clock reads. Names must be string literals or otherwise
+   outlive the profiler, since only the pointer is kept.
+
+   writeChromeTrace and printSummary read every thread's events, so call
+   them between stages rather than while one is running. clear can be
+   called at any time: each thread drops its own events the next time it
+   records.
+*/
+
+#pragma once
+
+#include <stdio.h>
+
+#ifndef TERRAIN_PROFILE
+#define TERRAIN_PROFILE 1
+#endif
+
+class profiler
+{
+public:
+	/* Nanoseconds on a steady clock */
+	static long long now();
+
+	/* Add an event to the calling thread's buffer. unit names what count
+	   counts, or is NULL if there is no count. */
+	static void record(const char* name, long long start, long long end,
+		unsigned long long count, const char* unit);
+
+	/* Drop every event recorded so far */
+	static void clear();
+
+	/* Write the events in the Chrome trace event format. Returns false if
+	   the file cannot be written. */
+	static bool writeChromeTrace(const char* filename);
+
+	/* Print calls, total, mean and longest time and rate for each name,
+	   longest total first */
+	static void printSummary(FILE* out = stdout);
+};
+
+#if TERRAIN_PROFILE
+
+/* Times its own lifetime */
+class profile_scope
+{
+public:
+	explicit profile_scope(const char* name)
+		: name(name), count(0), unit(NULL), start(profiler::now()) {}
+
+	~profile_scope()
+	{
+		profiler::record(name, start, profiler::now(), count, unit);
+	}
+
+	/* Number of items handled in the scope, such as "samples" */
+	void setCount(unsigned long long items, const char* item_unit)
+	{
+		count = items;
+		unit = item_unit;
+	}
+
+private:
+	profile_scope(const profile_scope&);
+	profile_scope& operator=(const profile_scope&);
+
+	const char* name;
+	unsigned long long count;
+	const char* unit;
+	long long start;
+};
+
+#else
+
+class profile_scope
+{
+public:
+	explicit profile_scope(const char*) {}
+	void setCount(unsigned long long, const char*) {}
+};
+
+#endif
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+
+/* Time the rest of the block */
+#define PROFILE_SCOPE(name) profile_scope PROFILE_JOIN(profile_scope_, __LINE__)(name)
+
+/* The same, with a named scope so that a count can be set on it */
+#define PROFILE_SCOPE_NAMED(var, name) profile_scope var(name)
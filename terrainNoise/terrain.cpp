@@ -23,15 +23,16 @@ if you prefer */
 #include <glm/gtc/type_ptr.hpp>
 #include "object_ldr.h"
 #include "terrain_object.h"
+#include "profiler.h"
+#include "artifact_exporter.h"
+#include "terrain_recipe.h"
+#include "arena.h"
 
 /* Define buffer object indices */
 GLuint positionBufferObject, colourObject, normalsBufferObject;
 GLuint sphereBufferObject, sphereNormals, sphereColours, sphereTexCoords;
 GLuint elementbuffer;
 
-// Shadow frame buffer object for rendering depth maps
-GLuint shadowFBO, depthTex;
-
 GLuint program;		/* Identifier for the shader prgoram */
 GLuint vao;			/* Vertex array (Containor) object. This is the index of the VAO that will be the container for
 					   our buffer objects */
@@ -49,8 +50,7 @@ GLuint numlats, numlongs;	//Define the resolution of the sphere object
 /* Uniforms*/
 GLuint modelID, viewID, projectionID;
 GLuint colourmodeID;
-GLuint shadowID;
-GLuint depthMatrixID;
+GLuint sunID;
 
 GLfloat aspect_ratio;		/* Aspect ratio of the window defined in the reshape callback*/
 GLuint numspherevertices;
@@ -60,12 +60,43 @@ int octaves;
 GLfloat perlin_scale, perlin_frequency;
 GLfloat land_size;
 
+/* Terrain saved by the last run, reused if the parameters still match */
+const char* TERRAIN_FILE = "terrain.hfd";
+
+/* Module graph of the terrain, read once at start up from RECIPE_FILE if
+   there is one and kept for every regeneration */
+const char* RECIPE_FILE = "terrain.recipe";
+terrain_recipe recipe;
+
+/* Every buffer of the terrain and of building it comes from here, and is
+   all given back at once before the next regeneration */
+arena terrain_arena;
+
+/* Stage timings of the last terrain build, for chrome://tracing */
+const char* TRACE_FILE = "terrain_trace.json";
+
+/* Hydraulic erosion, toggled with H */
+bool hydraulic_enabled;
+const unsigned int HYDRAULIC_DROPLETS = 250000;
+
+/* Thermal erosion, toggled with G */
+bool thermal_enabled;
+const int THERMAL_ITERATIONS = 200;
+
+/* Order the terrain's triangles are drawn in, cycled with I */
+grid_topology terrain_topology = GRID_STRIP_RESTART;
+
+/* Direction towards the sun in terrain space. The terrain bakes its
+   shadows and ambient occlusion for it and the shader lights with it. */
+const glm::vec3 SUN_DIRECTION = glm::vec3(0.6f, 0.45f, 0.3f);
+
 /* Function prototypes */
 /* Note that a better design would be to make a sphere class. I've suggested that as one of the
   extras to do in the lab for this week. */
 void makeUnitSphere(GLfloat *pVertices, GLfloat *pTexCoords, GLuint numlats, GLuint numlongs);
 GLuint makeSphereVBO(GLuint numlats, GLuint numlongs);
 void drawSphere();
+void createHeightfield();
 
 /*
 This function is called before entering the main rendering loop.
@@ -224,42 +255,6 @@ GLfloat texcoords[] =
 	1.f, 1.f, 0, 1.f, 0, 0
 };
 
-	/* start of example code to create frame buffer objects: http://luugiathuy.com/2011/09/create-frame-buffer-object-opengl/ */
-
-	GLuint depthTexture;
-	glGenTextures(1, &depthTexture);
-	// bind the texture
-	glBindTexture(GL_TEXTURE_2D, depthTexture);
-	// set texture parameters
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	// create the texture in the GPU
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, 640, 480, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
-	// unbind the texture
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// attach to frame buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
-
-	glm::vec3 lightInvDir = glm::vec3(0.5f, 2, 2);
-	
-	// Compute the MVP matrix from the light's point of view
-	glm::mat4 depthProjectionMatrix = glm::ortho<float>(-10, 10, -10, 10, -10, 20);
-	glm::mat4 depthViewMatrix = glm::lookAt(lightInvDir, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
-	glm::mat4 depthModelMatrix = glm::mat4(1.0);
-	glm::mat4 depthMVP = depthProjectionMatrix * depthViewMatrix * depthModelMatrix;
-	
-	// Send our transformation to the currently bound shader,
-	// in the "MVP" uniform
-	glUniformMatrix4fv(depthMatrixID, 1, GL_FALSE, &depthMVP[0][0]);
-
-
-
-	/* end of example code */
-
 	/* Create the vertex buffer for the cube */
 	glGenBuffers(1, &positionBufferObject);
 	glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
@@ -286,9 +281,15 @@ GLfloat texcoords[] =
 	perlin_scale = 2.f;
 	perlin_frequency = 1.f;
 	land_size = 50.f;
-	heightfield = new terrain_object(octaves, perlin_frequency, perlin_scale);
-	heightfield->createTerrain(256, 256, land_size, land_size);
-	heightfield->createObject();
+	hydraulic_enabled = false;
+	thermal_enabled = false;
+	std::string recipe_error;
+	if (!recipe.load(RECIPE_FILE, recipe_error))
+	{
+		std::cout << "Using the standard terrain recipe: " << recipe_error << std::endl;
+		recipe = terrain_recipe::standard();
+	}
+	createHeightfield();
 	
 	/* Load and build the vertex and fragment shaders */
 	try
@@ -307,33 +308,69 @@ GLfloat texcoords[] =
 	colourmodeID = glGetUniformLocation(program, "colourmode");
 	viewID = glGetUniformLocation(program, "view");
 	projectionID = glGetUniformLocation(program, "projection");
-	shadowID = glGetUniformLocation(program, "shadow");
+	sunID = glGetUniformLocation(program, "sun_dir");
 }
 
-void shadow_matrix(glm::vec4 lt, glm::vec4 pl, glm::mat4 shadow_proj)
+/* Load the terrain saved by the last run if it was made with the same
+   parameters, otherwise generate it from noise and save it for next time */
+void createHeightfield()
 {
-	// dot product of normal and light position/direction
-	GLfloat rdotl;
-	rdotl = pl.x*lt.x + pl.y*lt.y + pl.z*lt.z + pl.w*lt.w;
-
-	shadow_proj[0][0] = -pl.x*lt.x + rdotl;
-	shadow_proj[0][1] = -pl.x*lt.y;
-	shadow_proj[0][2] = -pl.x*lt.z;
-	shadow_proj[0][3] = -pl.x*lt.w;
-	shadow_proj[1][0] = -pl.y*lt.x;
-	shadow_proj[1][1] = -pl.y*lt.y + rdotl;
-	shadow_proj[1][2] = -pl.y*lt.z;
-	shadow_proj[1][3] = -pl.y*lt.w;
-	shadow_proj[2][0] = -pl.z*lt.x;
-	shadow_proj[2][1] = -pl.z*lt.y;
-	shadow_proj[2][2] = -pl.z*lt.z + rdotl;
-	shadow_proj[2][3] = -pl.z*lt.w;
-	shadow_proj[3][0] = -pl.w*lt.x;
-	shadow_proj[3][1] = -pl.w*lt.y;
-	shadow_proj[3][2] = -pl.w*lt.z;
-	shadow_proj[3][3] = -pl.w*lt.w + rdotl;
-}
+	/* The old terrain has been deleted, so once the debug exports that
+	   still hold its maps are written nothing is left in the arena. The
+	   exports record into the profiler, so clear it only after them. */
+	artifact_exporter::instance().flush();
+	profiler::clear();
+
+	if (!terrain_arena.reset())
+	{
+		std::cout << "Terrain arena still has " << terrain_arena.getLiveCount()
+			<< " buffers in use, so its memory cannot be reused" << std::endl;
+	}
+	arena_scope scope(terrain_arena);
+
+	heightfield = new terrain_object(octaves, perlin_frequency, perlin_scale);
+	heightfield->recipe = &recipe;
+	heightfield->hydraulic.droplets = hydraulic_enabled ? HYDRAULIC_DROPLETS : 0;
+	heightfield->thermal.iterations = thermal_enabled ? THERMAL_ITERATIONS : 0;
+	heightfield->sun_direction = SUN_DIRECTION;
+	heightfield->topology = terrain_topology;
+	if (!heightfield->loadTerrain(TERRAIN_FILE, 256, 256, land_size, land_size))
+	{
+		heightfield->createTerrain(256, 256, land_size, land_size);
+		heightfield->exportFlowMaps();
+		if (hydraulic_enabled)
+		{
+			const hydraulic_erosion_stats& stats = heightfield->hydraulic_stats;
+			printf("\nHydraulic erosion: %llu droplets, %llu steps in %.3f s (%.0f droplets/s)",
+				stats.droplets, stats.steps, stats.seconds, stats.dropletsPerSecond());
+		}
+		if (thermal_enabled)
+		{
+			const thermal_erosion_stats& stats = heightfield->thermal_stats;
+			printf("\nThermal erosion: %d iterations in %.3f s, last change %g",
+				stats.iterations, stats.seconds, stats.last_change);
+		}
+		const horizon_bake_stats& stats = heightfield->horizon_stats;
+		printf("\nLighting baked: %d directions in %.3f s (%.0f points/s)",
+			stats.directions, stats.seconds, stats.pointsPerSecond());
+		printf("\nBiomes classified in %.3f s (%.0f points/s)",
+			heightfield->splat_stats.seconds, heightfield->splat_stats.pointsPerSecond());
+		if (!heightfield->saveTerrain(TERRAIN_FILE))
+		{
+			std::cout << "Could not save terrain to " << TERRAIN_FILE << std::endl;
+		}
+	}
+	heightfield->createObject();
+	printf("\nTerrain arena: %.1f MB peak, %.1f MB reserved",
+		terrain_arena.getPeak() / (1024.0 * 1024.0), terrain_arena.getReserved() / (1024.0 * 1024.0));
 
+	printf("\n");
+	profiler::printSummary();
+	if (!profiler::writeChromeTrace(TRACE_FILE))
+	{
+		std::cout << "Could not write trace to " << TRACE_FILE << std::endl;
+	}
+}
 
 /* Called to update the display. Note that this function is called in the event loop in the wrapper
    class because we registered display as a callback function */
@@ -366,6 +403,11 @@ void display()
 	glBindBuffer(GL_ARRAY_BUFFER, normalsBufferObject);
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
+	/* The cube has no baked lighting or materials, so it is fully lit grass.
+	   Attribute indices 3 and 4 */
+	glVertexAttrib2f(3, 1.f, 1.f);
+	glVertexAttrib4f(4, 0.f, 1.f, 0.f, 0.f);
+
 	// Define the model transformations for the cube
 	glm::mat4 model = glm::mat4(1.0f);
 	model = glm::translate(model, glm::vec3(x+0.5, y, z));
@@ -389,6 +431,8 @@ void display()
 	glUniform1ui(colourmodeID, colourmode);
 	glUniformMatrix4fv(viewID, 1, GL_FALSE, &View[0][0]);
 	glUniformMatrix4fv(projectionID, 1, GL_FALSE, &Projection[0][0]);
+	glm::vec3 sun = glm::normalize(SUN_DIRECTION);
+	glUniform3fv(sunID, 1, &sun[0]);
 
 	/* Define the model transformations for our sphere */
 	model = glm::mat4(1.0f);
@@ -464,6 +508,40 @@ static void keyCallback(GLFWwindow* window, int key, int s, int action, int mods
 		printf("\nx=%f", x);
 	}
 
+	if (key == 'H' && action != GLFW_PRESS)
+	{
+		hydraulic_enabled = !hydraulic_enabled;
+		recreate_terrain = true;
+		printf("\nHydraulic erosion = %d", hydraulic_enabled);
+	}
+
+	if (key == 'G' && action != GLFW_PRESS)
+	{
+		thermal_enabled = !thermal_enabled;
+		recreate_terrain = true;
+		printf("\nThermal erosion = %d", thermal_enabled);
+	}
+
+	/* Switch to the next triangle order and show how well it uses the
+	   vertex cache */
+	if (key == 'I' && action != GLFW_PRESS)
+	{
+		terrain_topology = grid_topology((terrain_topology + 1) % GRID_TOPOLOGIES);
+		heightfield->setTopology(terrain_topology);
+		grid_cache_stats stats = grid_index_cache::simulateCache(*heightfield->elements);
+		printf("\nTopology = %s, ACMR %.3f, ATVR %.3f", grid_index_cache::topologyName(terrain_topology),
+			stats.acmr, stats.atvr);
+	}
+
+	/* Write previews of the noise maps and the flow maps each time the
+	   terrain is generated */
+	if (key == 'O' && action != GLFW_PRESS)
+	{
+		artifact_exporter& exporter = artifact_exporter::instance();
+		exporter.setEnabled(!exporter.isEnabled());
+		printf("\nDebug heightmap export = %d", exporter.isEnabled());
+	}
+
 	if (key == '[' && action != GLFW_PRESS)
 	{
 		if (octaves > 1) octaves--;
@@ -508,9 +586,7 @@ static void keyCallback(GLFWwindow* window, int key, int s, int action, int mods
 	if (recreate_terrain)
 	{
 		delete heightfield;
-		heightfield = new terrain_object(octaves, perlin_frequency, perlin_scale);
-		heightfield->createTerrain(256, 256, land_size, land_size);
-		heightfield->createObject();
+		createHeightfield();
 	}
 }
 
@@ -6,22 +6,30 @@
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec4 colour;
 layout(location = 2) in vec3 normal;
+layout(location = 3) in vec2 lighting;	// Baked (ambient, sun) visibility
+layout(location = 4) in vec4 splat;		// Weights of the water, grass, earth and snow materials
 
 out vec3 Normal;
 out vec3 Position;
-varying vec4 ShadowCoord;
 
 // Uniform variables are passed in from the application
 uniform mat4 model, view, projection;
 uniform uint colourmode;
 uniform mat3 normalmatrix;
-uniform mat4 shadow;
+uniform vec3 sun_dir;		// Direction towards the sun in model space
 
 // Output the vertex colour - to be rasterized into pixel fragments
 out vec4 fcolour;
 vec4 ambient = vec4(0.2, 0.2,0.2,1.0);
 vec3 light_dir = vec3(0.0, 0.0, 10.0);
 
+// Colours of the materials, one per column, in the order of the splat weights
+const mat4 material_colour = mat4(
+	vec4(0.2, 0.2, 1.0, 1.0),	// Water
+	vec4(0.0, 0.6, 0.2, 1.0),	// Grass
+	vec4(0.6, 0.4, 0.2, 1.0),	// Earth
+	vec4(0.9, 0.8, 0.9, 1.0));	// Snow
+
 void main()
 {
 	vec4 specular_colour = vec4(0.0,0.0,0.0,1.0);
@@ -35,36 +43,18 @@ void main()
 	}
 	else
 	{
-		if (position.y <= 0)
-		{
-			diffuse_colour = vec4(0.2, 0.2, 1.0, 1.0);
-		}
-		else if (position.y < 3)
-		{
-			diffuse_colour = vec4(0.0, 0.6, 0.2, 1.0);
-		}
-		else if (position.y < 6)
-		{
-			diffuse_colour = vec4(0.6, 0.4, 0.2, 1.0);
-		}
-		else
-		{
-			diffuse_colour = vec4(0.9, 0.8, 0.9, 1.0);
-		}
-			
-		// Define the colour based on the height of the vertex
-		//diffuse_colour = vec4(0.5, 0.3, 0.2, 1.0);
+		// Blend the material colours by the weights worked out on the CPU
+		diffuse_colour = material_colour * splat;
 	}
 	
 
-	ambient = diffuse_colour * 0.2;
+	ambient = diffuse_colour * 0.2 * lighting.x;
 
 	mat4 mv_matrix = view * model;
 	mat4 MVP = projection * view * model;
 
 	Position = (mv_matrix * vec4(position,1.0)).xyz;
 	Normal = normalize( normalmatrix * normal );
-	ShadowCoord = shadow * vec4(position,1.0);
 	gl_Position = MVP * vec4(position,1.0);
 
 	mat3 normalmatrix = mat3(mv_matrix);
@@ -72,7 +62,8 @@ void main()
 	N = normalize(N);
 	light_dir = normalize(light_dir);
 
-	vec3 diffuse = max(dot(N, light_dir), 0.0) * diffuse_colour.xyz;
+	// The sun lights the terrain in model space, so the baked shadows line up
+	vec3 diffuse = max(dot(normalize(normal), sun_dir), 0.0) * lighting.y * diffuse_colour.xyz;
 
 	vec4 P = position_h * mv_matrix;
 	vec3 half_vec = normalize(light_dir + P.xyz);
@@ -0,0 +1,844 @@
+/* terrain_mesh.cpp
+   CPU side of the terrain: noise, erosion, height post-processing, normals,
+   indices, lighting, drainage and biomes. Nothing here needs a GL context.
+*/
+
+#include <noise/noise.h>
+#include "terrain_mesh.h"
+#include <glm/gtc/noise.hpp>
+#include "noiseutils.h"
+#include "heightfield_file.h"
+#include "height_post.h"
+#include "profiler.h"
+#include "artifact_exporter.h"
+#include "job_system.h"
+#include "arena.h"
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <string>
+
+// Size of the procedurally generated texture
+const int TEXTURE_SIZE = 256;
+
+// Size of the tiles in saved terrain files
+const unsigned int TERRAIN_FILE_TILE_SIZE = 64;
+
+// Size of the tiles that createTerrain builds the terrain in
+const unsigned int TERRAIN_TILE_SIZE = 64;
+
+// Height of the sea, which flattens everything below it and takes the rivers
+const float TERRAIN_SEA_LEVEL = 0.f;
+
+// Number of points that must drain through a point for it to be a river
+const float RIVER_THRESHOLD = 200.f;
+
+// Seconds since start, for the stage timings
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Creates the color gradients for the texture.
+void CreateTextureColor(utils::RendererImage& renderer);
+
+// Given a noise module, this function renders a flat square texture map and
+// writes it to a Windows bitmap (*.bmp) file.  Because the texture map is
+// square, its width is equal to its height.  The texture map can be seamless
+// (tileable) or non-seamless. 
+void CreatePlanarTexture(const noise::module::Module& noiseModule, bool seamless,
+	int height, const char* filename);
+
+// Given a noise module, this function renders a spherical texture map and
+// writes it to a Windows bitmap (*.bmp) file.  The texture map's width is
+// double its height.
+void CreateSphericalTexture(const noise::module::Module& noiseModule, int height,
+	const char* filename);
+
+// Given a noise map, this function renders a texture map and writes it to a
+// Windows bitmap (*.bmp) file.
+void RenderTexture(const noise::utils::NoiseMap& noiseMap,
+	const char* filename);
+
+terrain_mesh::terrain_mesh(int octaves, float freq, float scale)
+{
+	xsize = 0;	// Set to zero because we haven't created the heightfield array yet
+	zsize = 0;	
+	perlin_octaves = octaves;
+	perlin_freq = freq;
+	perlin_scale = scale;
+	height_scale = 1.f;
+	vertices = NULL;
+	normals = NULL;
+	lighting = NULL;
+	allocator = noise::utils::GetBufferAllocator();
+	topology = GRID_STRIP_RESTART;
+	sun_direction = glm::vec3(0.f, 1.f, 0.f);
+	recipe = NULL;
+}
+
+
+terrain_mesh::~terrain_mesh()
+{
+	/* tidy up */
+	noise::utils::FreeBuffer(lighting, allocator);
+	noise::utils::FreeBuffer(normals, allocator);
+	noise::utils::FreeBuffer(vertices, allocator);
+}
+
+/* Allocate count vectors from the allocator the terrain was made with,
+   so that they can be given back to it whatever allocator is current */
+template <class T>
+static T* allocateVectors(unsigned int count, noise::utils::BufferAllocator* allocator)
+{
+	size_t size = (size_t)count * sizeof(T);
+	return (T*)(allocator ? allocator->Allocate(size) : ::operator new(size));
+}
+
+// Generates a texture using coherent noise
+void terrain_mesh::generateTexture()
+{
+	PROFILE_SCOPE("terrain_mesh::generateTexture");
+	noise::module::Billow groundTexture;
+	groundTexture.SetSeed(0);
+	groundTexture.SetFrequency(6.0);
+	groundTexture.SetPersistence(0.625);
+	groundTexture.SetLacunarity(2.18359375);
+	groundTexture.SetOctaveCount(6);
+	groundTexture.SetNoiseQuality(QUALITY_STD);
+
+	// Use Voronoi polygons to produce the small grains for the granite texture.
+	module::Voronoi baseGrains;
+	baseGrains.SetSeed(1);
+	baseGrains.SetFrequency(16.0);
+	baseGrains.EnableDistance(true);
+
+	// Scale the small grain values so that they may be added to the base
+	// granite texture.  Voronoi polygons normally generate pits, so apply a
+	// negative scaling factor to produce bumps instead.
+	module::ScaleBias scaledGrains;
+	scaledGrains.SetSourceModule(0, baseGrains);
+	scaledGrains.SetScale(-0.5);
+	scaledGrains.SetBias(0.0);
+
+	// Combine the primary granite texture with the small grain texture.
+	module::Add combinedGranite;
+	combinedGranite.SetSourceModule(0, groundTexture);
+	combinedGranite.SetSourceModule(1, scaledGrains);
+
+	// Finally, perturb the granite texture to add realism.
+	module::Turbulence finalGranite;
+	finalGranite.SetSourceModule(0, combinedGranite);
+	finalGranite.SetSeed(2);
+	finalGranite.SetFrequency(4.0);
+	finalGranite.SetPower(1.0 / 8.0);
+	finalGranite.SetRoughness(6);
+
+	// Given the granite noise module, create a non-seamless texture map, a
+	// seamless texture map, and a spherical texture map.
+	//CreatePlanarTexture(finalGranite, false, TEXTURE_SIZE,
+	//	"textureplane.bmp");
+	//CreatePlanarTexture(finalGranite, true, TEXTURE_SIZE,
+	//	"textureseamless.bmp");
+	//CreateSphericalTexture(finalGranite, TEXTURE_SIZE	,
+	//	"texturesphere.bmp");
+}
+
+void CreateTextureColor(utils::RendererImage& renderer)
+{
+	// Create a gray granite palette.  Black and pink appear at either ends of
+	// the palette; those colors provide the charactistic black and pink flecks
+	// in granite.
+	renderer.ClearGradient();
+	renderer.AddGradientPoint(-1.0000, utils::Color(0, 0, 0, 255));
+	renderer.AddGradientPoint(-0.9375, utils::Color(0, 0, 0, 255));
+	renderer.AddGradientPoint(-0.8750, utils::Color(216, 216, 242, 255));
+	renderer.AddGradientPoint(0.0000, utils::Color(191, 191, 191, 255));
+	renderer.AddGradientPoint(0.5000, utils::Color(210, 116, 125, 255));
+	renderer.AddGradientPoint(0.7500, utils::Color(210, 113, 98, 255));
+	renderer.AddGradientPoint(1.0000, utils::Color(255, 176, 192, 255));
+}
+
+void CreatePlanarTexture(const module::Module& noiseModule, bool seamless,
+	int height, const char* filename)
+{
+	// Map the output values from the noise module onto a plane.  This will
+	// create a two-dimensional noise map which can be rendered as a flat
+	// texture map.
+	utils::NoiseMapBuilderPlane plane;
+	utils::NoiseMap noiseMap;
+	plane.SetBounds(-1.0, 1.0, -1.0, 1.0);
+	plane.SetDestSize(height, height);
+	plane.SetSourceModule(noiseModule);
+	plane.SetDestNoiseMap(noiseMap);
+	plane.EnableSeamless(seamless);
+	plane.Build();
+
+	RenderTexture(noiseMap, filename);
+}
+
+void CreateSphericalTexture(const module::Module& noiseModule, int height,
+	const char* filename)
+{
+	// Map the output values from the noise module onto a sphere.  This will
+	// create a two-dimensional noise map which can be rendered as a spherical
+	// texture map.
+	utils::NoiseMapBuilderSphere sphere;
+	utils::NoiseMap noiseMap;
+	sphere.SetBounds(-90.0, 90.0, -180.0, 180.0); // degrees
+	sphere.SetDestSize(height * 2, height);
+	sphere.SetSourceModule(noiseModule);
+	sphere.SetDestNoiseMap(noiseMap);
+	sphere.Build();
+
+	RenderTexture(noiseMap, filename);
+}
+
+void RenderTexture(const utils::NoiseMap& noiseMap, const char* filename)
+{
+	// Create the color gradients for the texture.
+	utils::RendererImage textureRenderer;
+	CreateTextureColor(textureRenderer);
+
+	// Set up us the texture renderer and pass the noise map to it.
+	utils::Image destTexture;
+	textureRenderer.SetSourceNoiseMap(noiseMap);
+	textureRenderer.SetDestImage(destTexture);
+	textureRenderer.EnableLight(true);
+	textureRenderer.SetLightAzimuth(135.0);
+	textureRenderer.SetLightElev(60.0);
+	textureRenderer.SetLightContrast(2.0);
+	textureRenderer.SetLightColor(utils::Color(255, 255, 255, 0));
+
+	// Render the texture.
+	textureRenderer.Render();
+
+	// Write the texture as a Windows bitmap file (*.bmp).
+	utils::WriterBMP textureWriter;
+	textureWriter.SetSourceImage(destTexture);
+	textureWriter.SetDestFilename(filename);
+	textureWriter.WriteDestFile();
+}
+
+/* The noise maps are only for looking at, so they are built and written
+   in the background, and only when the exporter is enabled. The job keeps
+   its own copy of the recipe, which shares the modules. */
+void terrain_mesh::exportNoiseMaps()
+{
+	artifact_exporter& exporter = artifact_exporter::instance();
+	terrain_recipe graph = getRecipe();
+	exporter.post([&exporter, graph]()
+	{
+		std::vector<std::string> maps(graph.getPreviews());
+		maps.push_back(graph.getHeightsMap().name);
+		for (size_t i = 0; i < maps.size(); i++)
+		{
+			utils::NoiseMap map;
+			graph.buildMap(*graph.findMap(maps[i]), map);
+			exporter.writeHeightMap(map, maps[i]);
+		}
+	});
+}
+
+/* Define the terrian heights */
+/* Uses code adapted from OpenGL Shading Language Cookbook: Chapter 8 */
+/* Fill the heights of a tile from the heights map of the recipe and find
+   their range. The map's bounds are sampled with a point for each vertex,
+   whatever size the recipe gives the map, so a terrain of any size covers
+   the whole map. The recipe's modules were built when it was parsed, so
+   this only evaluates them. */
+void terrain_mesh::buildTileHeights(const terrain_tile& tile, float* heights, float& min, float& max)
+{
+	PROFILE_SCOPE_NAMED(scope, "terrain_mesh::buildTileHeights");
+	unsigned int tile_width = tile.x1 - tile.x0;
+	unsigned int tile_depth = tile.z1 - tile.z0;
+	scope.setCount((unsigned long long)tile_width * tile_depth, "samples");
+
+	const terrain_recipe& graph = getRecipe();
+	recipe_map heights_map = graph.getHeightsMap();
+	heights_map.width = xsize;
+	heights_map.height = zsize;
+
+	/* The map is built a row of x at a time, so read it across */
+	scratch_array<float> values(tile_width * tile_depth);
+	graph.buildMapRegion(heights_map, tile.x0, tile.z0, tile.x1, tile.z1,
+		&values[0], tile_width);
+
+	min = max = (values[0] * perlin_scale - 0.5f) * height_scale;
+	for (unsigned int x = tile.x0; x < tile.x1; x++)
+	{
+		const float* column = &values[x - tile.x0];
+		float* row = &heights[x*zsize];
+		for (unsigned int z = tile.z0; z < tile.z1; z++)
+		{
+			float h = (column[(z - tile.z0) * tile_width] * perlin_scale - 0.5f) * height_scale;
+			row[z] = h;
+			if (h < min) min = h;
+			if (h > max) max = h;
+		}
+	}
+}
+
+/* The recipe set on the terrain, or the standard one */
+const terrain_recipe& terrain_mesh::getRecipe() const
+{
+	return recipe ? *recipe : terrain_recipe::standard();
+}
+
+
+/* Define the vertex array that specifies the terrain
+   (x, y) specifies the pixel dimensions of the heightfield (x * y) vertices
+   (xs, ys) specifies the size of the heightfield region in world coords
+
+   The heights are built as tiles, and every stage of a tile is a task
+   that follows the stages whose results it reads:
+     noise     the heights of the tile and their range
+     range     once every tile has its noise, erosion if it is enabled and
+               the range of all the heights, which the stretch needs
+     stretch   the final heights and the vertex positions of the tile
+     normals   the normals of the tile, once it and the tiles after it along
+               x and z are stretched, since each normal reads the heights
+               of the next vertex along x and along z
+   Past the range the tiles flow through the stages independently, mostly
+   on the thread that stretched them, so each tile is still in cache from
+   one stage to the next. Each band of tiles along z is handed to
+   rows_ready as soon as it is finished, while later bands are still being
+   built.
+   */
+void terrain_mesh::createTerrain(unsigned int xp, unsigned int zp, float xs, float zs)
+{
+	xsize = xp;
+	zsize = zp;
+	width = xs;
+	height = zs;
+
+	/* Scale heights in relation to the terrain size */
+	height_scale = xs;
+
+	/* Create array of vertices */
+	unsigned int numvertices = xsize * zsize;
+	vertices = allocateVectors<glm::vec3>(numvertices, allocator);
+	normals  = allocateVectors<glm::vec3>(numvertices, allocator);
+	timings = terrain_mesh_timings();
+	std::chrono::steady_clock::time_point total_start = std::chrono::steady_clock::now();
+	PROFILE_SCOPE_NAMED(scope, "terrain_mesh::createTerrain");
+	scope.setCount(numvertices, "vertices");
+
+	exportNoiseMaps();
+
+	/* Define starting (x,z) positions and the step changes */
+	std::vector<float> xpos(xsize), zpos(zsize);
+	float xpos_step = width / float(xp);
+	float zpos_step = height / float(zp);
+	float pos = -width / 2.f;
+	for (unsigned int x = 0; x < xsize; x++, pos += xpos_step) xpos[x] = pos;
+	pos = -height / 2.f;
+	for (unsigned int z = 0; z < zsize; z++, pos += zpos_step) zpos[z] = pos;
+
+	/* Tiles are numbered along z first, so each band along z is a run of
+	   tiles and a contiguous run of vertices */
+	unsigned int tiles_x = (xsize + TERRAIN_TILE_SIZE - 1) / TERRAIN_TILE_SIZE;
+	unsigned int tiles_z = (zsize + TERRAIN_TILE_SIZE - 1) / TERRAIN_TILE_SIZE;
+	std::vector<terrain_tile> tiles(tiles_x * tiles_z);
+	for (unsigned int t = 0; t < tiles.size(); t++)
+	{
+		tiles[t].x0 = (t / tiles_z) * TERRAIN_TILE_SIZE;
+		tiles[t].z0 = (t % tiles_z) * TERRAIN_TILE_SIZE;
+		tiles[t].x1 = std::min(tiles[t].x0 + TERRAIN_TILE_SIZE, xsize);
+		tiles[t].z1 = std::min(tiles[t].z0 + TERRAIN_TILE_SIZE, zsize);
+	}
+
+	scratch_array<float> heights(numvertices);
+	std::vector<float> tile_min(tiles.size()), tile_max(tiles.size());
+	utils::NoiseMap heightMap;
+	heightMap.SetSize(zsize, xsize);
+	height_stretch stretch;
+	std::chrono::steady_clock::time_point range_start, range_end;
+
+	/* The indices only depend on the size, so fetch them alongside */
+	job_system& jobs = job_system::instance();
+	job_handle elements_task = jobs.submit([this]()
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		createElements();
+		timings.elements = secondsSince(start);
+	});
+
+	std::vector<job_handle> noise_tasks(tiles.size());
+	for (unsigned int t = 0; t < tiles.size(); t++)
+	{
+		noise_tasks[t] = jobs.submit([&, t]()
+		{
+			buildTileHeights(tiles[t], &heights[0], tile_min[t], tile_max[t]);
+		});
+	}
+
+	// Wear the terrain down with droplets of water and let steep slopes
+	// collapse, if enabled, which needs all the heights at once. Either
+	// way the stretch needs the range of all the heights.
+	job_handle range_task = jobs.submit([&]()
+	{
+		range_start = std::chrono::steady_clock::now();
+		float hmin = tile_min[0], hmax = tile_max[0];
+		erodeHeights(heights.get());
+		if (hydraulic.droplets > 0 || thermal.iterations > 0)
+		{
+			height_post::findRange(&heights[0], numvertices, hmin, hmax);
+		}
+		else
+		{
+			for (unsigned int t = 1; t < tiles.size(); t++)
+			{
+				hmin = std::min(hmin, tile_min[t]);
+				hmax = std::max(hmax, tile_max[t]);
+			}
+		}
+
+		// Stretch the height values to a defined height range, reshape
+		// them and define a sea level by flattening low regions
+		stretch = height_post::makeStretch(hmin, hmax, -(xs / 8.f), (xs / 8.f), TERRAIN_SEA_LEVEL);
+		range_end = std::chrono::steady_clock::now();
+	}, noise_tasks);
+
+	std::vector<job_handle> stretch_tasks(tiles.size());
+	for (unsigned int t = 0; t < tiles.size(); t++)
+	{
+		stretch_tasks[t] = jobs.submit([&, t]()
+		{
+			finishTile(tiles[t], &heights[0], stretch, &xpos[0], &zpos[0], heightMap);
+		}, std::vector<job_handle>(1, range_task));
+	}
+
+	std::vector<job_handle> normal_tasks(tiles.size());
+	for (unsigned int t = 0; t < tiles.size(); t++)
+	{
+		std::vector<job_handle> after(1, stretch_tasks[t]);
+		if (t % tiles_z + 1 < tiles_z) after.push_back(stretch_tasks[t + 1]);
+		if (t / tiles_z + 1 < tiles_x) after.push_back(stretch_tasks[t + tiles_z]);
+		normal_tasks[t] = jobs.submit([&, t]()
+		{
+			calculateTileNormals(tiles[t], heightMap);
+		}, after);
+	}
+
+	/* Hand over the bands in order. Every task uses this frame, so wait
+	   for all of them before passing on the first thing that went wrong. */
+	std::exception_ptr error;
+	std::function<void(const job_handle&)> finish = [&](const job_handle& task)
+	{
+		try
+		{
+			jobs.wait(task);
+		}
+		catch (...)
+		{
+			if (!error) error = std::current_exception();
+		}
+	};
+	finish(range_task);
+	for (unsigned int band = 0; band < tiles_x; band++)
+	{
+		for (unsigned int t = band * tiles_z; t < (band + 1) * tiles_z; t++)
+		{
+			finish(noise_tasks[t]);
+			finish(stretch_tasks[t]);
+			finish(normal_tasks[t]);
+		}
+		if (error || !rows_ready) continue;
+
+		try
+		{
+			rows_ready(tiles[band * tiles_z].x0, tiles[band * tiles_z].x1);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+	}
+	std::chrono::steady_clock::time_point tiles_end = std::chrono::steady_clock::now();
+	finish(elements_task);
+	if (error) std::rethrow_exception(error);
+	timings.noise = std::chrono::duration<double>(range_start - total_start).count();
+	timings.erosion = std::chrono::duration<double>(range_end - range_start).count();
+	timings.tiles = std::chrono::duration<double>(tiles_end - range_end).count();
+
+	// Bake the lighting and summarise the final heights for chunk bounds,
+	// previews and rivers, which only read the vertices, side by side
+	job_handle lighting_task = jobs.submit([this]()
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bakeLighting();
+		timings.lighting = secondsSince(start);
+	});
+	job_handle analysis_task = jobs.submit([this]()
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		analyseHeights();
+		timings.analysis = secondsSince(start);
+	});
+	finish(lighting_task);
+	finish(analysis_task);
+	if (error) std::rethrow_exception(error);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	classifyBiomes();
+	timings.biomes = secondsSince(start);
+	timings.total = secondsSince(total_start);
+}
+
+/* Stretch the heights of a tile with the range of the whole terrain, then
+   set the tile's vertices and its points of the height map that the
+   normals are rendered from */
+void terrain_mesh::finishTile(const terrain_tile& tile, float* heights, const height_stretch& stretch,
+	const float* xpos, const float* zpos, utils::NoiseMap& heightMap)
+{
+	PROFILE_SCOPE_NAMED(scope, "terrain_mesh::finishTile");
+	unsigned int tile_depth = tile.z1 - tile.z0;
+	scope.setCount((unsigned long long)(tile.x1 - tile.x0) * tile_depth, "points");
+	for (unsigned int x = tile.x0; x < tile.x1; x++)
+	{
+		float* row = &heights[x*zsize + tile.z0];
+		height_post::applyStretch(row, tile_depth, stretch, height_shape);
+		memcpy(heightMap.GetSlabPtr(tile.z0, x), row, tile_depth * sizeof(float));
+		for (unsigned int z = tile.z0; z < tile.z1; z++)
+		{
+			vertices[x*zsize + z] = glm::vec3(xpos[x], heights[x*zsize + z], zpos[z]);
+		}
+	}
+}
+
+/* Render the normals of a tile from the final heights, which must already
+   be in the height map for the tile and the vertices after it along x and
+   z. RendererNormalMap writes them straight into the normals array. */
+void terrain_mesh::calculateTileNormals(const terrain_tile& tile, const utils::NoiseMap& heightMap)
+{
+	PROFILE_SCOPE_NAMED(scope, "terrain_mesh::calculateTileNormals");
+	scope.setCount((unsigned long long)(tile.x1 - tile.x0) * (tile.z1 - tile.z0), "normals");
+
+	/* Rows of the height map run along x and columns along z. The bump
+	   heights turn height differences into slopes between neighbouring
+	   vertices, one grid step apart along z across a row of the map and
+	   along x from one row to the next. */
+	utils::RendererNormalMap normalRenderer;
+	normalRenderer.SetSourceNoiseMap(heightMap);
+	normalRenderer.SetDestNormalBuffer(&normals[0].x);
+	normalRenderer.SetBumpHeights(float(zsize) / height, float(xsize) / width);
+	normalRenderer.RenderRegion(tile.z0, tile.x0, tile.z1, tile.x1);
+
+	/* The renderer gives (along z, along x, up) so swap to (x, y, z) */
+	for (unsigned int x = tile.x0; x < tile.x1; x++)
+	{
+		for (unsigned int z = tile.z0; z < tile.z1; z++)
+		{
+			glm::vec3 n = normals[x*zsize + z];
+			normals[x*zsize + z] = glm::vec3(n.y, n.z, n.x);
+		}
+	}
+}
+
+/* Define the indices that draw the vertices in the chosen topology. They
+   only depend on the size, so they come from the shared cache. */
+void terrain_mesh::createElements()
+{
+	PROFILE_SCOPE("terrain_mesh::createElements");
+	elements = grid_index_cache::get(xsize, zsize, topology);
+}
+
+/* Run hydraulic and then thermal erosion on the heights before they are
+   stretched. The erosion parameters are tuned for heights from 0 to 1 one
+   grid step apart, so the heights are moved into that range first and
+   back afterwards. The stretch keeps where the heights lie, not only
+   their spread, so it must see them in the noise's own range. */
+void terrain_mesh::erodeHeights(float* heights)
+{
+	PROFILE_SCOPE("terrain_mesh::erodeHeights");
+	hydraulic_stats = hydraulic_erosion_stats();
+	thermal_stats = thermal_erosion_stats();
+	if (hydraulic.droplets == 0 && thermal.iterations <= 0) return;
+
+	size_t numvertices = (size_t)xsize * zsize;
+	float hmin, hmax;
+	height_post::findRange(heights, numvertices, hmin, hmax);
+	float scale = hmax - hmin;
+	if (scale > 0.f)
+	{
+		for (size_t v = 0; v < numvertices; v++) heights[v] = (heights[v] - hmin) / scale;
+	}
+
+	/* Rows run along x and columns along z, like the vertices */
+	hydraulic_erosion::run(heights, zsize, xsize, hydraulic, &hydraulic_stats);
+	thermal_erosion::run(heights, zsize, xsize, thermal, &thermal_stats);
+
+	if (scale > 0.f)
+	{
+		for (size_t v = 0; v < numvertices; v++) heights[v] = heights[v] * scale + hmin;
+	}
+}
+
+/* Hash everything that determines the terrain heights and normals */
+unsigned long long terrain_mesh::graphHash()
+{
+	unsigned long long recipe_hash = getRecipe().getHash();
+	unsigned long long hash = heightfield_hash(&recipe_hash, sizeof(recipe_hash));
+	float params[] = { float(perlin_octaves), perlin_freq, perlin_scale, width, height };
+	hash = heightfield_hash(params, sizeof(params), hash);
+	unsigned int sizes[] = { xsize, zsize };
+	hash = heightfield_hash(sizes, sizeof(sizes), hash);
+	const std::vector<float>& curve = height_shape.getTable();
+	if (!curve.empty()) hash = heightfield_hash(&curve[0], curve.size() * sizeof(float), hash);
+	if (hydraulic.droplets > 0) hash = heightfield_hash(&hydraulic, sizeof(hydraulic), hash);
+	if (thermal.iterations > 0) hash = heightfield_hash(&thermal, sizeof(thermal), hash);
+
+	/* Saved terrain also holds the lighting and materials, so it is only
+	   current for the same sun and biome settings */
+	float baked[] = { sun_direction.x, sun_direction.y, sun_direction.z,
+		float(horizon.directions), horizon.penumbra, biomes.earth_line, biomes.snow_line,
+		biomes.height_blend, biomes.rock_slope, biomes.slope_blend, biomes.moisture_frequency,
+		float(biomes.moisture_seed) };
+	hash = heightfield_hash(baked, sizeof(baked), hash);
+	return hash;
+}
+
+/* Save the finished heights, normals, lighting, flow accumulation and
+   materials so that later runs can load them instead of working them out
+   again */
+bool terrain_mesh::saveTerrain(const char* filename)
+{
+	PROFILE_SCOPE("terrain_mesh::saveTerrain");
+	unsigned int numvertices = xsize * zsize;
+	scratch_array<float> heights(numvertices);
+	for (unsigned int v = 0; v < numvertices; v++) heights[v] = vertices[v].y;
+
+	/* The rows of the accumulation map may be padded, so pack them */
+	const utils::NoiseMap& flow_map = flow.getAccumulation();
+	scratch_array<float> accumulation(numvertices);
+	for (unsigned int x = 0; x < xsize; x++)
+	{
+		memcpy(&accumulation[x*zsize], flow_map.GetConstSlabPtr(x), zsize * sizeof(float));
+	}
+
+	heightfield_desc desc;
+	const recipe_map& bounds = getRecipe().getHeightsMap();
+	desc.lower_x = bounds.lower_x;
+	desc.upper_x = bounds.upper_x;
+	desc.lower_z = bounds.lower_z;
+	desc.upper_z = bounds.upper_z;
+	desc.seed = getRecipe().getSeed();
+	desc.graph_hash = graphHash();
+
+	heightfield_layers layers;
+	layers.normals = &normals[0].x;
+	layers.lighting = &lighting[0].x;
+	layers.accumulation = &accumulation[0];
+	layers.splat = &splat[0];
+
+	/* Rows of the file run along x and columns along z, like the vertices */
+	return heightfield_file::write(filename, desc, zsize, xsize, TERRAIN_FILE_TILE_SIZE,
+		&heights[0], layers);
+}
+
+/* Load terrain saved by saveTerrain in place of createTerrain. Every
+   array is copied a tile row at a time straight out of the mapped file,
+   so loading is one pass over it. Only the vertex positions, the height
+   pyramid and the river mask are worked out, each in one pass over what
+   was loaded. Returns false, leaving the object empty, if the file is
+   missing or was made with a different module graph or parameters. */
+bool terrain_mesh::loadTerrain(const char* filename, unsigned int xp, unsigned int zp, float xs, float zs)
+{
+	PROFILE_SCOPE("terrain_mesh::loadTerrain");
+	xsize = xp;
+	zsize = zp;
+	width = xs;
+	height = zs;
+	height_scale = xs;
+
+	heightfield_file file;
+	if (!file.open(filename)) return false;
+	const heightfield_header& header = file.getHeader();
+	if (header.graph_hash != graphHash() || header.columns != zsize || header.rows != xsize
+		|| !file.hasLayers(HEIGHTFIELD_HAS_NORMALS | HEIGHTFIELD_HAS_LIGHTING
+			| HEIGHTFIELD_HAS_FLOW | HEIGHTFIELD_HAS_SPLAT))
+	{
+		return false;
+	}
+
+	unsigned int numvertices = xsize * zsize;
+	vertices = allocateVectors<glm::vec3>(numvertices, allocator);
+	normals = allocateVectors<glm::vec3>(numvertices, allocator);
+	noise::utils::FreeBuffer(lighting, allocator);
+	lighting = allocateVectors<glm::vec2>(numvertices, allocator);
+	splat.resize(numvertices * BIOME_MATERIALS);
+	utils::NoiseMap& accumulation = flow.restoreAccumulation(zsize, xsize);
+
+	/* Same positions as createTerrain */
+	float xpos = -width / 2.f;
+	float xpos_step = width / float(xp);
+	float zpos_step = height / float(zp);
+	float zpos_start = -height / 2.f;
+
+	unsigned int tile_size = header.tile_size;
+	for (unsigned int x = 0; x < xsize; x++)
+	{
+		unsigned int ty = x / tile_size;
+		unsigned int tile_row = x % tile_size;
+		float zpos = zpos_start;
+		for (unsigned int tx = 0; tx < header.tiles_x; tx++)
+		{
+			unsigned int z0 = tx * tile_size;
+			unsigned int count = (zsize - z0 < tile_size) ? zsize - z0 : tile_size;
+			size_t tile_offset = (size_t)tile_row * tile_size;
+			const float* tile_heights = file.getTileHeights(tx, ty) + tile_offset;
+			const float* tile_normals = file.getTileNormals(tx, ty) + tile_offset * 3;
+			const float* tile_lighting = file.getTileLighting(tx, ty) + tile_offset * 2;
+			const float* tile_accumulation = file.getTileAccumulation(tx, ty) + tile_offset;
+			const unsigned char* tile_splat = file.getTileSplat(tx, ty) + tile_offset * BIOME_MATERIALS;
+
+			for (unsigned int z = 0; z < count; z++)
+			{
+				vertices[x*zsize + z0 + z] = glm::vec3(xpos, tile_heights[z], zpos);
+				zpos += zpos_step;
+			}
+			/* The file stores each normal as three floats, laid out like the
+			   normals array that calculateTileNormals renders into */
+			memcpy(&normals[x*zsize + z0].x, tile_normals, count * 3 * sizeof(float));
+			memcpy(&lighting[x*zsize + z0].x, tile_lighting, count * 2 * sizeof(float));
+			memcpy(accumulation.GetSlabPtr(z0, x), tile_accumulation, count * sizeof(float));
+			memcpy(&splat[(x*zsize + z0) * BIOME_MATERIALS], tile_splat, count * BIOME_MATERIALS);
+		}
+		xpos += xpos_step;
+	}
+
+	createElements();
+	utils::NoiseMap heightMap;
+	fillHeightMap(heightMap);
+	height_pyramid.Build(heightMap);
+	flow.getRiverMask(RIVER_THRESHOLD, river_mask);
+	return true;
+}
+
+/* Copy the vertex heights into a noise map. Rows of the height map run
+   along x and columns along z, so the points are in the same order as the
+   vertices. */
+void terrain_mesh::fillHeightMap(utils::NoiseMap& heightMap)
+{
+	heightMap.SetSize(zsize, xsize);
+	for (unsigned int x = 0; x < xsize; x++)
+	{
+		float* row = heightMap.GetSlabPtr(x);
+		for (unsigned int z = 0; z < zsize; z++)
+		{
+			row[z] = vertices[x*zsize + z].y;
+		}
+	}
+}
+
+/* Build the min/max pyramid of the final heights, so that the bounds of
+   any part of the terrain can be found without rescanning the vertices,
+   and work out where water drains to. The sea is an outlet for rivers. */
+void terrain_mesh::analyseHeights()
+{
+	PROFILE_SCOPE_NAMED(scope, "terrain_mesh::analyseHeights");
+	scope.setCount((unsigned long long)xsize * zsize, "points");
+	utils::NoiseMap heightMap;
+	fillHeightMap(heightMap);
+	height_pyramid.Build(heightMap);
+	flow.build(heightMap, true, TERRAIN_SEA_LEVEL);
+	flow.getRiverMask(RIVER_THRESHOLD, river_mask);
+}
+
+/* Write the flow accumulation at full precision and the river mask as a
+   graymap, for tools that used to work them out from the bitmaps */
+static void writeFlowMapFiles(const utils::NoiseMap& accumulation, const utils::NoiseMap& rivers,
+	const std::string& prefix)
+{
+	PROFILE_SCOPE("terrain_mesh::writeFlowMaps");
+	utils::WriterRAWF32 accumulationWriter;
+	accumulationWriter.SetSourceNoiseMap(accumulation);
+	accumulationWriter.SetDestFilename(prefix + "flowaccumulation.raw");
+	accumulationWriter.WriteDestFile();
+
+	utils::WriterPGM riverWriter;
+	riverWriter.SetSourceNoiseMap(rivers);
+	riverWriter.SetNormalizeBounds(0.f, 1.f);
+	riverWriter.EnableNormalize(true);
+	riverWriter.SetDestFilename(prefix + "rivers.pgm");
+	riverWriter.WriteDestFile();
+}
+
+/* Write the flow maps on the calling thread. prefix is put in front of
+   the file names, so it can name a directory. */
+void terrain_mesh::writeFlowMaps(const char* prefix)
+{
+	writeFlowMapFiles(flow.getAccumulation(), river_mask, prefix);
+}
+
+/* Queue the flow maps to be written in the background with the other
+   debug artifacts, only when the exporter is enabled. The job keeps its
+   own copies of the maps, since the terrain may be gone when it runs. */
+void terrain_mesh::exportFlowMaps()
+{
+	artifact_exporter& exporter = artifact_exporter::instance();
+	if (!exporter.isEnabled()) return;
+
+	std::shared_ptr<utils::NoiseMap> accumulation(new utils::NoiseMap(flow.getAccumulation()));
+	std::shared_ptr<utils::NoiseMap> rivers(new utils::NoiseMap(river_mask));
+	exporter.post([&exporter, accumulation, rivers]()
+	{
+		writeFlowMapFiles(*accumulation, *rivers, exporter.getPrefix());
+	});
+}
+
+/* Bounding box of the vertices from (x0, z0) up to but not including
+   (x1, z1). The height range comes from the pyramid, so it may be a little
+   larger than the chunk's own range but always contains it. */
+void terrain_mesh::getChunkBounds(unsigned int x0, unsigned int z0, unsigned int x1, unsigned int z1,
+	glm::vec3& lower, glm::vec3& upper)
+{
+	float min_height, max_height;
+	height_pyramid.GetRegionMinMax(z0, x0, z1, x1, min_height, max_height);
+
+	const glm::vec3& first = vertices[x0*zsize + z0];
+	const glm::vec3& last = vertices[(x1 - 1)*zsize + z1 - 1];
+	lower = glm::vec3(first.x, min_height, first.z);
+	upper = glm::vec3(last.x, max_height, last.z);
+}
+
+/* Bake ambient occlusion and shadows from the sun into the lighting array.
+   The terrain does not change between regenerations, so the shader only
+   has to scale its ambient and diffuse terms by them. */
+void terrain_mesh::bakeLighting()
+{
+	PROFILE_SCOPE_NAMED(scope, "terrain_mesh::bakeLighting");
+	scope.setCount((unsigned long long)xsize * zsize, "points");
+	noise::utils::FreeBuffer(lighting, allocator);
+	lighting = allocateVectors<glm::vec2>(xsize * zsize, allocator);
+
+	/* Rows of the heights run along x and columns along z, like the vertices */
+	scratch_array<float> heights(xsize * zsize);
+	for (unsigned int v = 0; v < xsize * zsize; v++) heights[v] = vertices[v].y;
+
+	horizon.cell_size = width / float(xsize);
+	horizon.sun_column = sun_direction.z;
+	horizon.sun_row = sun_direction.x;
+	horizon.sun_up = sun_direction.y;
+	horizon_bake::run(&heights[0], zsize, xsize, horizon,
+		&lighting[0].x, &lighting[0].y, 2, &horizon_stats);
+}
+
+/* Work out the material weights of every vertex from its height, slope,
+   moisture and the flow through it, for the shader to blend */
+void terrain_mesh::classifyBiomes()
+{
+	PROFILE_SCOPE_NAMED(scope, "terrain_mesh::classifyBiomes");
+	scope.setCount((unsigned long long)xsize * zsize, "points");
+	scratch_array<float> heights(xsize * zsize);
+	for (unsigned int v = 0; v < xsize * zsize; v++) heights[v] = vertices[v].y;
+
+	splat.resize(xsize * zsize * BIOME_MATERIALS);
+	biomes.sea_level = TERRAIN_SEA_LEVEL;
+	biomes.river_flow = RIVER_THRESHOLD;
+	biome_splat::run(&heights[0], &normals[0].y, 3, &flow.getAccumulation(), zsize, xsize,
+		biomes, &splat[0], &splat_stats);
+}
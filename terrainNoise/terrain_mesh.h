@@ -0,0 +1,125 @@
+/* terrain_mesh.h
+   The CPU side of a terrain: everything from the noise to the finished
+   vertices, normals, indices, lighting and materials, with no GL calls,
+   so that terrain can be generated on machines with no display.
+   terrain_object adds the vertex buffers and drawing on top.
+*/
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include <noise/noise.h>
+#include "noiseutils.h"
+#include "height_post.h"
+#include "hydraulic_erosion.h"
+#include "thermal_erosion.h"
+#include "flow_network.h"
+#include "horizon_bake.h"
+#include "biome_splat.h"
+#include "terrain_recipe.h"
+#include "grid_indices.h"
+
+/* Seconds spent in each stage of the last createTerrain. The tile stages
+   overlap, so noise is the time until every tile has its noise and tiles
+   the time from then until every tile has its vertices and normals. The
+   indices are built alongside the tiles, and lighting alongside analysis. */
+struct terrain_mesh_timings
+{
+	terrain_mesh_timings() : noise(0.0), erosion(0.0), tiles(0.0), elements(0.0),
+		lighting(0.0), analysis(0.0), biomes(0.0), total(0.0) {}
+
+	double noise;
+	double erosion;
+	double tiles;
+	double elements;
+	double lighting;
+	double analysis;
+	double biomes;
+	double total;
+};
+
+/* The vertices from (x0, z0) up to but not including (x1, z1), which
+   createTerrain builds as a unit */
+struct terrain_tile
+{
+	unsigned int x0;
+	unsigned int z0;
+	unsigned int x1;
+	unsigned int z1;
+};
+
+class terrain_mesh
+{
+public:
+	terrain_mesh(int octaves, float freq, float scale);
+	~terrain_mesh();
+
+	void exportNoiseMaps();
+	const terrain_recipe& getRecipe() const;
+	void generateTexture();
+	void createTerrain(unsigned int xp, unsigned int yp, float xs, float ys);
+	bool saveTerrain(const char* filename);
+	bool loadTerrain(const char* filename, unsigned int xp, unsigned int zp, float xs, float zs);
+	unsigned long long graphHash();
+	void createElements();
+	void erodeHeights(float* heights);
+	void buildTileHeights(const terrain_tile& tile, float* heights, float& min, float& max);
+	void finishTile(const terrain_tile& tile, float* heights, const height_stretch& stretch,
+		const float* xpos, const float* zpos, noise::utils::NoiseMap& heightMap);
+	void calculateTileNormals(const terrain_tile& tile, const noise::utils::NoiseMap& heightMap);
+	void fillHeightMap(noise::utils::NoiseMap& heightMap);
+	void analyseHeights();
+	void writeFlowMaps(const char* prefix = "");
+	void exportFlowMaps();
+	void bakeLighting();
+	void classifyBiomes();
+	void getChunkBounds(unsigned int x0, unsigned int z0, unsigned int x1, unsigned int z1,
+		glm::vec3& lower, glm::vec3& upper);
+	noise::utils::NoiseMap generateHeightMap();
+
+	/* Allocated from the buffer allocator that was current when the
+	   terrain was made, which must outlive it */
+	glm::vec3 *vertices;
+	glm::vec3 *normals;
+	glm::vec2 *lighting;
+	noise::utils::BufferAllocator* allocator;
+	std::vector<unsigned char> splat;
+	/* Shared with every other terrain of the same size and topology */
+	std::shared_ptr<grid_indices> elements;
+	grid_topology topology;
+	noise::utils::NoiseMapPyramid height_pyramid;
+	flow_network flow;
+	noise::utils::NoiseMap river_mask;
+
+	unsigned int xsize;
+	unsigned int zsize;
+	float width;
+	float height;
+	unsigned int perlin_octaves;
+	float perlin_freq;
+	float perlin_scale;
+	float height_scale;
+
+	/* Module graph the heights come from, or NULL for the standard recipe.
+	   It is not owned, so a parsed recipe can be kept between terrains. */
+	const terrain_recipe* recipe;
+	height_curve height_shape;
+	hydraulic_erosion_params hydraulic;
+	hydraulic_erosion_stats hydraulic_stats;
+	thermal_erosion_params thermal;
+	thermal_erosion_stats thermal_stats;
+	glm::vec3 sun_direction;
+	horizon_bake_params horizon;
+	horizon_bake_stats horizon_stats;
+	biome_params biomes;
+	biome_stats splat_stats;
+	terrain_mesh_timings timings;
+
+	/* Called on the thread running createTerrain as each band of rows,
+	   from first_row up to but not including last_row along x, gets its
+	   final vertices and normals. The bands come in order, before the
+	   lighting, drainage and biomes, which need the whole terrain. */
+	std::function<void(unsigned int first_row, unsigned int last_row)> rows_ready;
+};
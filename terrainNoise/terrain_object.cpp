@@ -3,112 +3,40 @@ Example class to show how to render a height map
 Iain Martin November 2014
 */
 
-#include <noise/noise.h>
 #include "terrain_object.h"
-#include <glm/gtc/noise.hpp>
-#include "noiseutils.h"
 #include "SOIL.h"
-#include "mountainTerrain.h"
-#include "baseFlatTerrain.h"
-#include "flatTerrain.h"
-#include "typeTerrain.h"
+#include "profiler.h"
 
-// Size of the procedurally generated texture
-const int TEXTURE_SIZE = 256;
 GLuint texture[1];
 
-// Creates the color gradients for the texture.
-void CreateTextureColor(utils::RendererImage& renderer);
-
-// Given a noise module, this function renders a flat square texture map and
-// writes it to a Windows bitmap (*.bmp) file.  Because the texture map is
-// square, its width is equal to its height.  The texture map can be seamless
-// (tileable) or non-seamless. 
-void CreatePlanarTexture(const noise::module::Module& noiseModule, bool seamless,
-	int height, const char* filename);
-
-// Given a noise module, this function renders a spherical texture map and
-// writes it to a Windows bitmap (*.bmp) file.  The texture map's width is
-// double its height.
-void CreateSphericalTexture(const noise::module::Module& noiseModule, int height,
-	const char* filename);
-
-// Given a noise map, this function renders a texture map and writes it to a
-// Windows bitmap (*.bmp) file.
-void RenderTexture(const noise::utils::NoiseMap& noiseMap,
-	const char* filename);
-
-
 /* Define the vertex attributes for vertex positions and normals. 
    Make these match your application and vertex shader
    You might also want to add colours and texture coordinates */
 terrain_object::terrain_object(int octaves, GLfloat freq, GLfloat scale)
+	: terrain_mesh(octaves, freq, scale)
 {
 	attribute_v_coord = 0;
 	attribute_v_normal = 2;
-	xsize = 0;	// Set to zero because we haven't created the heightfield array yet
-	zsize = 0;	
-	perlin_octaves = octaves;
-	perlin_freq = freq;
-	perlin_scale = scale;
-	height_scale = 1.f;
-	
+	attribute_v_lighting = 3;
+	attribute_v_splat = 4;
+	vbo_mesh_vertices = 0;
+	vbo_mesh_normals = 0;
+	vbo_mesh_lighting = 0;
+	vbo_mesh_splat = 0;
+	ibo_mesh_elements = 0;
+	uploaded_rows = 0;
+	rows_ready = [this](unsigned int first_row, unsigned int last_row)
+	{
+		uploadRows(first_row, last_row);
+	};
 }
 
-
+/* Delete the buffers of this terrain, but not the index buffer, which
+   belongs to the cache and is shared with other terrains */
 terrain_object::~terrain_object()
 {
-	/* tidy up */
-	if (vertices) delete[] vertices;
-	if (normals) delete[] normals;
-}
-
-// Generates a texture using coherent noise
-void terrain_object::generateTexture()
-{
-	noise::module::Billow groundTexture;
-	groundTexture.SetSeed(0);
-	groundTexture.SetFrequency(6.0);
-	groundTexture.SetPersistence(0.625);
-	groundTexture.SetLacunarity(2.18359375);
-	groundTexture.SetOctaveCount(6);
-	groundTexture.SetNoiseQuality(QUALITY_STD);
-
-	// Use Voronoi polygons to produce the small grains for the granite texture.
-	module::Voronoi baseGrains;
-	baseGrains.SetSeed(1);
-	baseGrains.SetFrequency(16.0);
-	baseGrains.EnableDistance(true);
-
-	// Scale the small grain values so that they may be added to the base
-	// granite texture.  Voronoi polygons normally generate pits, so apply a
-	// negative scaling factor to produce bumps instead.
-	module::ScaleBias scaledGrains;
-	scaledGrains.SetSourceModule(0, baseGrains);
-	scaledGrains.SetScale(-0.5);
-	scaledGrains.SetBias(0.0);
-
-	// Combine the primary granite texture with the small grain texture.
-	module::Add combinedGranite;
-	combinedGranite.SetSourceModule(0, groundTexture);
-	combinedGranite.SetSourceModule(1, scaledGrains);
-
-	// Finally, perturb the granite texture to add realism.
-	module::Turbulence finalGranite;
-	finalGranite.SetSourceModule(0, combinedGranite);
-	finalGranite.SetSeed(2);
-	finalGranite.SetFrequency(4.0);
-	finalGranite.SetPower(1.0 / 8.0);
-	finalGranite.SetRoughness(6);
-
-	// Given the granite noise module, create a non-seamless texture map, a
-	// seamless texture map, and a spherical texture map.
-	//CreatePlanarTexture(finalGranite, false, TEXTURE_SIZE,
-	//	"textureplane.bmp");
-	//CreatePlanarTexture(finalGranite, true, TEXTURE_SIZE,
-	//	"textureseamless.bmp");
-	//CreateSphericalTexture(finalGranite, TEXTURE_SIZE	,
-	//	"texturesphere.bmp");
+	GLuint buffers[] = { vbo_mesh_vertices, vbo_mesh_normals, vbo_mesh_lighting, vbo_mesh_splat };
+	glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
 }
 
 GLint loadGLTexture( char *filename)
@@ -123,104 +51,94 @@ GLint loadGLTexture( char *filename)
 	return (SOIL_response);
 }
 
-void CreateTextureColor(utils::RendererImage& renderer)
-{
-	// Create a gray granite palette.  Black and pink appear at either ends of
-	// the palette; those colors provide the charactistic black and pink flecks
-	// in granite.
-	renderer.ClearGradient();
-	renderer.AddGradientPoint(-1.0000, utils::Color(0, 0, 0, 255));
-	renderer.AddGradientPoint(-0.9375, utils::Color(0, 0, 0, 255));
-	renderer.AddGradientPoint(-0.8750, utils::Color(216, 216, 242, 255));
-	renderer.AddGradientPoint(0.0000, utils::Color(191, 191, 191, 255));
-	renderer.AddGradientPoint(0.5000, utils::Color(210, 116, 125, 255));
-	renderer.AddGradientPoint(0.7500, utils::Color(210, 113, 98, 255));
-	renderer.AddGradientPoint(1.0000, utils::Color(255, 176, 192, 255));
-}
-
-void CreatePlanarTexture(const module::Module& noiseModule, bool seamless,
-	int height, const char* filename)
+/* The rows are contiguous in the vertex and normal arrays, so each band
+   is one copy into each buffer */
+void terrain_object::uploadRows(unsigned int first_row, unsigned int last_row)
 {
-	// Map the output values from the noise module onto a plane.  This will
-	// create a two-dimensional noise map which can be rendered as a flat
-	// texture map.
-	utils::NoiseMapBuilderPlane plane;
-	utils::NoiseMap noiseMap;
-	plane.SetBounds(-1.0, 1.0, -1.0, 1.0);
-	plane.SetDestSize(height, height);
-	plane.SetSourceModule(noiseModule);
-	plane.SetDestNoiseMap(noiseMap);
-	plane.EnableSeamless(seamless);
-	plane.Build();
+	PROFILE_SCOPE_NAMED(scope, "terrain_object::uploadRows");
+	scope.setCount((unsigned long long)(last_row - first_row) * zsize, "vertices");
+	GLsizeiptr buffer_size = xsize * zsize * sizeof(glm::vec3);
+	if (uploaded_rows == 0)
+	{
+		glGenBuffers(1, &vbo_mesh_vertices);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_vertices);
+		glBufferData(GL_ARRAY_BUFFER, buffer_size, NULL, GL_STATIC_DRAW);
+		glGenBuffers(1, &vbo_mesh_normals);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_normals);
+		glBufferData(GL_ARRAY_BUFFER, buffer_size, NULL, GL_STATIC_DRAW);
+	}
 
-	RenderTexture(noiseMap, filename);
+	GLintptr offset = first_row * zsize * sizeof(glm::vec3);
+	GLsizeiptr size = (last_row - first_row) * zsize * sizeof(glm::vec3);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_vertices);
+	glBufferSubData(GL_ARRAY_BUFFER, offset, size, &vertices[first_row * zsize]);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_normals);
+	glBufferSubData(GL_ARRAY_BUFFER, offset, size, &normals[first_row * zsize]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	uploaded_rows += last_row - first_row;
 }
 
-void CreateSphericalTexture(const module::Module& noiseModule, int height,
-	const char* filename)
+/* Copy the vertices, normals and element indices into vertex buffers */
+void terrain_object::createObject()
 {
-	// Map the output values from the noise module onto a sphere.  This will
-	// create a two-dimensional noise map which can be rendered as a spherical
-	// texture map.
-	utils::NoiseMapBuilderSphere sphere;
-	utils::NoiseMap noiseMap;
-	sphere.SetBounds(-90.0, 90.0, -180.0, 180.0); // degrees
-	sphere.SetDestSize(height * 2, height);
-	sphere.SetSourceModule(noiseModule);
-	sphere.SetDestNoiseMap(noiseMap);
-	sphere.Build();
-
-	RenderTexture(noiseMap, filename);
-}
+	PROFILE_SCOPE("terrain_object::createObject");
+	generateTexture();
 
-void RenderTexture(const utils::NoiseMap& noiseMap, const char* filename)
-{
-	// Create the color gradients for the texture.
-	utils::RendererImage textureRenderer;
-	CreateTextureColor(textureRenderer);
+	/* createTerrain has already uploaded the vertices and normals, but
+	   terrain loaded from a file has not */
+	if (uploaded_rows < xsize)
+	{
+		/* Generate the vertex buffer object */
+		glGenBuffers(1, &vbo_mesh_vertices);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_vertices);
+		glBufferData(GL_ARRAY_BUFFER, xsize * zsize  * sizeof(glm::vec3), &(vertices[0]), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		/* Store the normals in a buffer object */
+		glGenBuffers(1, &vbo_mesh_normals);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_normals);
+		glBufferData(GL_ARRAY_BUFFER, xsize * zsize * sizeof(glm::vec3), &(normals[0]), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 
-	// Set up us the texture renderer and pass the noise map to it.
-	utils::Image destTexture;
-	textureRenderer.SetSourceNoiseMap(noiseMap);
-	textureRenderer.SetDestImage(destTexture);
-	textureRenderer.EnableLight(true);
-	textureRenderer.SetLightAzimuth(135.0);
-	textureRenderer.SetLightElev(60.0);
-	textureRenderer.SetLightContrast(2.0);
-	textureRenderer.SetLightColor(utils::Color(255, 255, 255, 0));
+	/* Store the baked ambient and sun visibility in a buffer object */
+	glGenBuffers(1, &vbo_mesh_lighting);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_lighting);
+	glBufferData(GL_ARRAY_BUFFER, xsize * zsize * sizeof(glm::vec2), &(lighting[0]), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	// Render the texture.
-	textureRenderer.Render();
+	/* Store the material weights in a buffer object, four bytes a vertex */
+	glGenBuffers(1, &vbo_mesh_splat);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_splat);
+	glBufferData(GL_ARRAY_BUFFER, splat.size(), &(splat[0]), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	// Write the texture as a Windows bitmap file (*.bmp).
-	utils::WriterBMP textureWriter;
-	textureWriter.SetSourceImage(destTexture);
-	textureWriter.SetDestFilename(filename);
-	textureWriter.WriteDestFile();
+	uploadElements();
 }
 
-/* Copy the vertices, normals and element indices into vertex buffers */
-void terrain_object::createObject()
+/* The indices are shared by every terrain of this size and topology, so
+   only the first one uploads them. A grid one point wide has no triangles
+   and so no indices to upload. */
+void terrain_object::uploadElements()
 {
-	generateTexture();
-	/* Generate the vertex buffer object */
-	glGenBuffers(1, &vbo_mesh_vertices);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_vertices);
-	glBufferData(GL_ARRAY_BUFFER, xsize * zsize  * sizeof(glm::vec3), &(vertices[0]), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	/* Store the normals in a buffer object */
-	glGenBuffers(1, &vbo_mesh_normals);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_normals);
-	glBufferData(GL_ARRAY_BUFFER, xsize * zsize * sizeof(glm::vec3), &(normals[0]), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (!elements->buffer && !elements->indices.empty())
+	{
+		glGenBuffers(1, &elements->buffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elements->buffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements->indices.size() * sizeof(GLuint),
+			elements->indices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+	ibo_mesh_elements = elements->buffer;
+}
 
-	// Generate a buffer for the indices
-	glGenBuffers(1, &ibo_mesh_elements);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_mesh_elements);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size()* sizeof(GLuint), &(elements[0]), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+void terrain_object::setTopology(grid_topology new_topology)
+{
+	topology = new_topology;
+	if (xsize == 0) return;
 
+	createElements();
+	uploadElements();
 }
 
 /* Enable vertex attributes and draw object
@@ -230,9 +148,9 @@ This code is almost untouched fomr the tutorial code except that I changed the
 number of elements per vertex from 4 to 3*/
 void terrain_object::drawObject(int drawmode)
 {
-	int size;	// Used to get the byte size of the element (vertex index) array
-
 	// Describe our vertices array to OpenGL (it can't guess its format automatically)
+	if (elements->indices.empty()) return;
+
 	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_vertices);
 	glVertexAttribPointer(
 		attribute_v_coord,  // attribute index
@@ -253,8 +171,29 @@ void terrain_object::drawObject(int drawmode)
 		0                   // offset of first element
 		);
 
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_lighting);
+	glEnableVertexAttribArray(attribute_v_lighting);
+	glVertexAttribPointer(
+		attribute_v_lighting, // attribute
+		2,                  // number of elements per vertex, here (ambient, sun)
+		GL_FLOAT,           // the type of each element
+		GL_FALSE,           // take our values as-is
+		0,                  // no extra data between each position
+		0                   // offset of first element
+		);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_splat);
+	glEnableVertexAttribArray(attribute_v_splat);
+	glVertexAttribPointer(
+		attribute_v_splat,  // attribute
+		BIOME_MATERIALS,    // number of elements per vertex, one weight per material
+		GL_UNSIGNED_BYTE,   // the type of each element
+		GL_TRUE,            // scale the bytes to 0..1
+		0,                  // no extra data between each position
+		0                   // offset of first element
+		);
+
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_mesh_elements); 
-	glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
 
 	// Enable this line to show model in wireframe
 	if (drawmode == 1)
@@ -262,256 +201,29 @@ void terrain_object::drawObject(int drawmode)
 	else
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-	/* Draw the triangle strips */
-	for (int i = 0; i < xsize - 1; i++)
+	GLsizei count = (GLsizei)elements->indices.size();
+	if (elements->key.topology == GRID_STRIPS)
 	{
-		GLuint location = sizeof(GLuint) * (i * zsize * 2);
-		glDrawElements(GL_TRIANGLE_STRIP, zsize * 2, GL_UNSIGNED_INT, (GLvoid*)(location));
-	}
-}
-
-/* Define the terrian heights */
-/* Uses code adapted from OpenGL Shading Language Cookbook: Chapter 8 */
-/*
-This function is as it is in the lab start, it is being commented out and a similar function is used instead to generate
-a heightmap from coherent noise
-*/
-void terrain_object::calculateNoise()
-{
-
-	baseFlatTerrain baseT;
-	flatTerrain flatT;
-	mountainTerrain mountainT;
-	typeTerrain typeT;
-
-	baseT.generateBaseFlatHeightMap();
-	flatT.generateFlatHeightMap();
-	mountainT.generateMountainHeightMap();
-	typeT.generateTypeTerrainMap();
-
-	module::RidgedMulti mountainTerr;
-	module::Billow baseFlatTerr;
-	baseFlatTerr.SetFrequency(2);
-	module::ScaleBias flatTerr;
-	flatTerr.SetSourceModule(0, baseFlatTerr);
-	flatTerr.SetScale(0.125);
-	flatTerr.SetBias(-1);
-
-	module::Perlin typeTerr;
-	typeTerr.SetFrequency(0.5);
-	typeTerr.SetPersistence(0.25);
-
-	module::Select finalTerr;
-	finalTerr.SetSourceModule(0, flatTerr);
-	finalTerr.SetSourceModule(1, mountainTerr);
-	finalTerr.SetControlModule(typeTerr);
-	finalTerr.SetBounds(0.0, 1000.0);
-	finalTerr.SetEdgeFalloff(1);
-
-	/* Create the array to store the noise values */
-	/* The size is the number of vertices * number of octaves */
-	noise = new GLfloat[xsize * zsize * perlin_octaves];
-	for (int i = 0; i < (xsize*zsize*perlin_octaves); i++) noise[i] = 0;
-
-	GLfloat xfactor = 1.f / (xsize - 1);
-	GLfloat zfactor = 1.f / (zsize - 1);
-	GLfloat freq = perlin_freq;
-	GLfloat scale = perlin_scale;
-
-	//double MaxValueFor;
-	//double currentValue;
-	//added now
-	module::Perlin myModule;
-	myModule.SetOctaveCount(6);
-	myModule.SetFrequency(1.0);
-	myModule.SetPersistence(0.5);
-	double value;
-	
-	//utils::NoiseMap heightMap = flatTerr.generateFlatHeightMap();
-	utils::NoiseMap heightMap;
-	utils::NoiseMapBuilderPlane heightMapBuilder;
-	heightMapBuilder.SetSourceModule(finalTerr);
-	heightMapBuilder.SetDestNoiseMap(heightMap);
-	heightMapBuilder.SetDestSize(256, 256);
-	heightMapBuilder.SetBounds(5.0, 9.0, 4.0, 8.0);
-	heightMapBuilder.Build();
-
-	for (int row = 0; row <zsize; row++)
-	{
-		for (int col = 0; col < xsize; col++)
-		{
-			GLfloat x = xfactor * col;
-			GLfloat z = zfactor * row;
-			GLfloat sum = 0;
-			GLfloat curent_scale = scale;
-			GLfloat current_freq = freq;
-
-			//this
-			//for (int oct = 0; oct < 4; oct++)
-			//{
-			value = heightMap.GetValue(row, col);
-
-			//value = myModule.GetValue(row / scaleForTerrain, col / scaleForTerrain, 0);
-
-			noise[(row * xsize + col) * perlin_octaves] = value*scale;
-
-
-
-			//	if (currentValue < value*scaleForTerrain){
-			//		MaxValueFor = currentValue;
-			//		std::cout << MaxValueFor;
-			//	}
-
-
-		}
-
-	}
-
-
-}
-
-
-/* Define the vertex array that specifies the terrain
-   (x, y) specifies the pixel dimensions of the heightfield (x * y) vertices
-   (xs, ys) specifies the size of the heightfield region in world coords
-   */
-void terrain_object::createTerrain(GLuint xp, GLuint zp, GLfloat xs, GLfloat zs)
-{
-	xsize = xp;
-	zsize = zp;
-	width = xs;
-	height = zs;
-
-	/* Scale heights in relation to the terrain size */
-	height_scale = xs;
-
-	/* Create array of vertices */
-	GLuint numvertices = xsize * zsize;
-	vertices = new glm::vec3[numvertices];
-	normals  = new glm::vec3[numvertices];
-
-	/* First calculate the noise array which we'll use for our vertex height values */
-	calculateNoise();
-
-	/* Define starting (x,z) positions and the step changes */
-	GLfloat xpos = -width / 2.f;
-	GLfloat xpos_step = width / GLfloat(xp);
-	GLfloat zpos_step = height / GLfloat(zp);
-	GLfloat zpos_start = -height / 2.f;
-
-	/* Define the vertex positions and the initial normals for a flat surface */
-	for (GLuint x = 0; x < xsize; x++)
-	{
-		GLfloat zpos = zpos_start;
-		for (GLuint z = 0; z < zsize; z++)
+		/* Draw the triangle strips */
+		for (unsigned int i = 0; i < elements->strip_count; i++)
 		{
-			GLfloat height = noise[(x*zsize + z) * perlin_octaves + perlin_octaves-1];
-			vertices[x*xsize + z] = glm::vec3(xpos, (height-0.5f)*height_scale, zpos);
-			normals[x*xsize + z]  = glm::vec3(0, 1.0f, 0);		// Normals for a flat surface
-			zpos += zpos_step;
+			GLuint location = sizeof(GLuint) * (i * elements->strip_length);
+			glDrawElements(GL_TRIANGLE_STRIP, elements->strip_length, GL_UNSIGNED_INT, (GLvoid*)(location));
 		}
-		xpos += xpos_step;
 	}
-
-	/* Define vertices for triangle strips */
-	for (GLuint x = 0; x < xsize - 1; x++)
+	else if (elements->key.topology == GRID_STRIP_RESTART)
 	{
-		GLuint top    = x * zsize;
-		GLuint bottom = top + zsize;
-		for (GLuint z = 0; z < zsize; z++)
-		{
-			elements.push_back(top++);
-			elements.push_back(bottom++);
-		}
+		/* Draw all the triangle strips at once, restarting between them */
+		glEnable(GL_PRIMITIVE_RESTART);
+		glPrimitiveRestartIndex(GRID_RESTART_INDEX);
+		glDrawElements(GL_TRIANGLE_STRIP, count, GL_UNSIGNED_INT, 0);
+		glDisable(GL_PRIMITIVE_RESTART);
 	}
-
-	// Stretch the height values to a defined height range 
-	stretchToRange(-(xs / 8.f), (xs / 8.f));
-
-	// Define a sea level by flattening low regions
-	defineSea(0);
-
-	// Calculate the normals by averaging cross products for all triangles 
-	calculateNormals();
-}
-
-/* Calculate normals by using cross products along the triangle strips
-   and averaging the normals for each vertex */
-void terrain_object::calculateNormals()
-{
-	GLuint element_pos = 0;
-	glm::vec3 AB, AC, cross_product;
-
-	// Loop through each triangle strip  
-	for (GLuint x = 0; x < xsize - 1; x++)
-	{
-		// Loop along the strip
-		for (GLuint tri = 0; tri < zsize * 2 - 2; tri++)
-		{
-			// Extract the vertex indices from the element array 
-			GLuint v1 = elements[element_pos];
-			GLuint v2 = elements[element_pos+1];
-			GLuint v3 = elements[element_pos+2];
-			
-			// Define the two vectors for the triangle
-			AB = vertices[v2] - vertices[v1];
-			AC = vertices[v3] - vertices[v1];
-
-			// Calculate the cross product
-			cross_product = glm::normalize(glm::cross(AC, AB));
-
-			// Add this normal to the vertex normal for all three vertices in the triangle
-			normals[v1] += cross_product;
-			normals[v2] += cross_product;
-			normals[v3] += cross_product;
-
-			// Move on to the next vertex along the strip
-			element_pos++;
-		}
-
-		// Jump past the lat two element positions to reach the start of the strip
-		element_pos += 2;	
-	}
-
-	// Normalise the normals
-	for (GLuint v = 0; v < xsize * zsize; v++)
-	{
-		normals[v] = glm::normalize(normals[v]);
-	}
-}
-
-/* Stretch the height values to the range min to max */
-void terrain_object::stretchToRange(GLfloat min, GLfloat max)
-{
-	/* Calculate min and max values */
-	GLfloat cmin, cmax;
-	cmin = cmax = vertices[0].y;
-	for (int v = 1; v < xsize*zsize; v++)
-	{
-		if (vertices[v].y < cmin) cmin = vertices[v].y;
-		if (vertices[v].y > cmax) cmax = vertices[v].y;
-	}
-
-	// Calculate stretch factor
-	GLfloat stretch_factor = (max - min) / (cmax - cmin);
-	GLfloat stretch_diff = cmin - min;
-
-	/* Rescale the vertices */
-	for (int v = 0; v < xsize*zsize; v++)
+	else
 	{
-		vertices[v].y = (vertices[v].y - stretch_diff) * stretch_factor;
+		glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, 0);
 	}
-}
 
-/* Define a sea level in the terrain */
-void terrain_object::defineSea(GLfloat sealevel)
-{
-	for (int v = 0; v < xsize*zsize; v++)
-	{
-		if (vertices[v].y < sealevel)
-		{
-			vertices[v].y = sealevel;
-		}
-	}
+	glDisableVertexAttribArray(attribute_v_lighting);
+	glDisableVertexAttribArray(attribute_v_splat);
 }
-
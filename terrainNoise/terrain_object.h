@@ -8,46 +8,36 @@
 #pragma comment(lib, "libnoise.lib")
 
 #include "wrapper_glfw.h"
-#include <vector>
-#include <glm/glm.hpp>
-#include <noise/noise.h>
-#include "noiseutils.h"
+#include "terrain_mesh.h"
 
-class terrain_object
+/* A terrain_mesh with vertex buffers, drawn as triangle strips or, with
+   setTopology, one of the cache-friendlier triangle lists */
+class terrain_object : public terrain_mesh
 {
 public:
 	terrain_object(int octaves, GLfloat freq, GLfloat scale);
 	~terrain_object();
 
-	void calculateNoise();
-	void generateTexture();
-	void createTerrain(GLuint xp, GLuint yp, GLfloat xs, GLfloat ys);
-	void calculateNormals();
-	noise::utils::NoiseMap generateHeightMap();
-	void stretchToRange(GLfloat min, GLfloat max);
-	void defineSea(GLfloat sealevel);
-
 	void createObject();
 	void drawObject(int drawmode);
 
-	glm::vec3 *vertices;
-	glm::vec3 *normals;
-	std::vector<GLuint> elements;
-	GLfloat* noise;
+	/* Copy rows of vertices and normals into their buffers as createTerrain
+	   finishes them, creating the buffers for the first rows */
+	void uploadRows(unsigned int first_row, unsigned int last_row);
+	unsigned int uploaded_rows;
+
+	/* Draw with other indices from now on. Only the indices change, so
+	   this is cheap enough to do between frames. */
+	void setTopology(grid_topology new_topology);
+	void uploadElements();
 
 	GLuint vbo_mesh_vertices;
 	GLuint vbo_mesh_normals;
+	GLuint vbo_mesh_lighting;
+	GLuint vbo_mesh_splat;
 	GLuint ibo_mesh_elements;
 	GLuint attribute_v_coord;
 	GLuint attribute_v_normal;
-
-	GLuint xsize;
-	GLuint zsize;
-	GLfloat width;
-	GLfloat height;
-	GLuint perlin_octaves;
-	GLfloat perlin_freq;
-	GLfloat perlin_scale;
-	GLfloat height_scale;
+	GLuint attribute_v_lighting;
+	GLuint attribute_v_splat;
 };
-
@@ -0,0 +1,799 @@
+/* terrain_recipe.cpp
+   Parses terrain recipes and builds their libnoise module graphs.
+*/
+
+#include "terrain_recipe.h"
+#include "heightfield_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+/* The standard terrain: flat lowlands and ridged mountains, chosen between
+   by a slow Perlin control. The previews show the parts of the graph. */
+const char* STANDARD_RECIPE =
+	"[terrain]\n"
+	"heights = finalheightmap\n"
+	"previews = baseflatheightmap flatheightmap mountainheightmap terraintypeheightmap\n"
+	"\n"
+	"[module base_flat]\n"
+	"type = billow\n"
+	"frequency = 2\n"
+	"\n"
+	"[module flat]\n"
+	"type = scalebias\n"
+	"source0 = base_flat\n"
+	"scale = 0.125\n"
+	"bias = -1\n"
+	"\n"
+	"[module mountain]\n"
+	"type = ridgedmulti\n"
+	"\n"
+	"[module terrain_type]\n"
+	"type = perlin\n"
+	"frequency = 0.5\n"
+	"persistence = 0.25\n"
+	"\n"
+	"[module final]\n"
+	"type = select\n"
+	"source0 = flat\n"
+	"source1 = mountain\n"
+	"control = terrain_type\n"
+	"bounds = 0 1000\n"
+	"edge_falloff = 1\n"
+	"\n"
+	"[map finalheightmap]\n"
+	"module = final\n"
+	"size = 256 256\n"
+	"bounds = 5 9 4 8\n"
+	"\n"
+	"[map baseflatheightmap]\n"
+	"module = base_flat\n"
+	"size = 256 256\n"
+	"bounds = 5 9 4 8\n"
+	"\n"
+	"[map flatheightmap]\n"
+	"module = flat\n"
+	"size = 256 256\n"
+	"bounds = 5 9 4 8\n"
+	"\n"
+	"[map mountainheightmap]\n"
+	"module = mountain\n"
+	"size = 256 256\n"
+	"bounds = 5 9 4 8\n"
+	"\n"
+	"[map terraintypeheightmap]\n"
+	"module = terrain_type\n"
+	"size = 256 256\n"
+	"bounds = 5 9 4 8\n";
+
+/* Largest width or height of a map */
+const int RECIPE_MAX_MAP_SIZE = 16384;
+
+struct terrain_recipe::compiled
+{
+	std::vector<std::unique_ptr<noise::module::Module> > modules;
+	std::map<std::string, noise::module::Module*> by_name;
+	std::vector<recipe_map> maps;
+	std::string heights;
+	std::vector<std::string> previews;
+	int seed;
+	unsigned long long hash;
+};
+
+template <typename T>
+static noise::module::Module* createModule()
+{
+	return new T;
+}
+
+struct recipe_module_type
+{
+	const char* name;
+	int sources;
+	/* Source set by control =, or -1 if the type has no control */
+	int control;
+	noise::module::Module* (*create)();
+};
+
+static const recipe_module_type MODULE_TYPES[] =
+{
+	{ "perlin", 0, -1, createModule<noise::module::Perlin> },
+	{ "billow", 0, -1, createModule<noise::module::Billow> },
+	{ "ridgedmulti", 0, -1, createModule<noise::module::RidgedMulti> },
+	{ "voronoi", 0, -1, createModule<noise::module::Voronoi> },
+	{ "const", 0, -1, createModule<noise::module::Const> },
+	{ "scalebias", 1, -1, createModule<noise::module::ScaleBias> },
+	{ "clamp", 1, -1, createModule<noise::module::Clamp> },
+	{ "exponent", 1, -1, createModule<noise::module::Exponent> },
+	{ "abs", 1, -1, createModule<noise::module::Abs> },
+	{ "invert", 1, -1, createModule<noise::module::Invert> },
+	{ "turbulence", 1, -1, createModule<noise::module::Turbulence> },
+	{ "add", 2, -1, createModule<noise::module::Add> },
+	{ "multiply", 2, -1, createModule<noise::module::Multiply> },
+	{ "max", 2, -1, createModule<noise::module::Max> },
+	{ "min", 2, -1, createModule<noise::module::Min> },
+	{ "select", 3, 2, createModule<noise::module::Select> },
+	{ "blend", 3, 2, createModule<noise::module::Blend> },
+};
+
+typedef void (*recipe_setter)(noise::module::Module& module, const double* v);
+
+struct recipe_param
+{
+	const char* type;
+	const char* key;
+	int values;
+	bool integer;
+	recipe_setter set;
+};
+
+#define RECIPE_PARAM(type, Class, key, values, integer, call) \
+	{ type, key, values, integer, [](noise::module::Module& m, const double* v) \
+		{ static_cast<noise::module::Class&>(m).call; } }
+
+/* Parameters are applied in this order, so select's bounds come before its
+   edge falloff, which is limited by them */
+static const recipe_param MODULE_PARAMS[] =
+{
+	RECIPE_PARAM("perlin", Perlin, "frequency", 1, false, SetFrequency(v[0])),
+	RECIPE_PARAM("perlin", Perlin, "lacunarity", 1, false, SetLacunarity(v[0])),
+	RECIPE_PARAM("perlin", Perlin, "persistence", 1, false, SetPersistence(v[0])),
+	RECIPE_PARAM("perlin", Perlin, "octaves", 1, true, SetOctaveCount(int(v[0]))),
+	RECIPE_PARAM("perlin", Perlin, "seed", 1, true, SetSeed(int(v[0]))),
+	RECIPE_PARAM("perlin", Perlin, "quality", 1, true, SetNoiseQuality(noise::NoiseQuality(int(v[0])))),
+	RECIPE_PARAM("billow", Billow, "frequency", 1, false, SetFrequency(v[0])),
+	RECIPE_PARAM("billow", Billow, "lacunarity", 1, false, SetLacunarity(v[0])),
+	RECIPE_PARAM("billow", Billow, "persistence", 1, false, SetPersistence(v[0])),
+	RECIPE_PARAM("billow", Billow, "octaves", 1, true, SetOctaveCount(int(v[0]))),
+	RECIPE_PARAM("billow", Billow, "seed", 1, true, SetSeed(int(v[0]))),
+	RECIPE_PARAM("billow", Billow, "quality", 1, true, SetNoiseQuality(noise::NoiseQuality(int(v[0])))),
+	RECIPE_PARAM("ridgedmulti", RidgedMulti, "frequency", 1, false, SetFrequency(v[0])),
+	RECIPE_PARAM("ridgedmulti", RidgedMulti, "lacunarity", 1, false, SetLacunarity(v[0])),
+	RECIPE_PARAM("ridgedmulti", RidgedMulti, "octaves", 1, true, SetOctaveCount(int(v[0]))),
+	RECIPE_PARAM("ridgedmulti", RidgedMulti, "seed", 1, true, SetSeed(int(v[0]))),
+	RECIPE_PARAM("ridgedmulti", RidgedMulti, "quality", 1, true, SetNoiseQuality(noise::NoiseQuality(int(v[0])))),
+	RECIPE_PARAM("voronoi", Voronoi, "frequency", 1, false, SetFrequency(v[0])),
+	RECIPE_PARAM("voronoi", Voronoi, "displacement", 1, false, SetDisplacement(v[0])),
+	RECIPE_PARAM("voronoi", Voronoi, "seed", 1, true, SetSeed(int(v[0]))),
+	RECIPE_PARAM("voronoi", Voronoi, "distance", 1, true, EnableDistance(v[0] != 0.0)),
+	RECIPE_PARAM("const", Const, "value", 1, false, SetConstValue(v[0])),
+	RECIPE_PARAM("scalebias", ScaleBias, "scale", 1, false, SetScale(v[0])),
+	RECIPE_PARAM("scalebias", ScaleBias, "bias", 1, false, SetBias(v[0])),
+	RECIPE_PARAM("clamp", Clamp, "bounds", 2, false, SetBounds(v[0], v[1])),
+	RECIPE_PARAM("exponent", Exponent, "exponent", 1, false, SetExponent(v[0])),
+	RECIPE_PARAM("select", Select, "bounds", 2, false, SetBounds(v[0], v[1])),
+	RECIPE_PARAM("select", Select, "edge_falloff", 1, false, SetEdgeFalloff(v[0])),
+	RECIPE_PARAM("turbulence", Turbulence, "frequency", 1, false, SetFrequency(v[0])),
+	RECIPE_PARAM("turbulence", Turbulence, "power", 1, false, SetPower(v[0])),
+	RECIPE_PARAM("turbulence", Turbulence, "roughness", 1, true, SetRoughness(int(v[0]))),
+	RECIPE_PARAM("turbulence", Turbulence, "seed", 1, true, SetSeed(int(v[0]))),
+};
+
+struct recipe_entry
+{
+	std::string value;
+	int line;
+};
+
+struct recipe_section
+{
+	std::string kind;
+	std::string name;
+	int line;
+	std::map<std::string, recipe_entry> entries;
+};
+
+static std::string trim(const std::string& s)
+{
+	size_t begin = s.find_first_not_of(" \t\r\n");
+	if (begin == std::string::npos) return std::string();
+	size_t end = s.find_last_not_of(" \t\r\n");
+	return s.substr(begin, end - begin + 1);
+}
+
+static std::vector<std::string> splitWords(const std::string& s)
+{
+	std::vector<std::string> words;
+	std::istringstream in(s);
+	std::string word;
+	while (in >> word) words.push_back(word);
+	return words;
+}
+
+static bool parseNumber(const std::string& word, double& value)
+{
+	const char* start = word.c_str();
+	char* end;
+	value = strtod(start, &end);
+	return end != start && *end == '\0' && value == value && fabs(value) <= 1e300;
+}
+
+/* Parse exactly count numbers */
+static bool parseNumbers(const std::string& text, int count, double* values)
+{
+	std::vector<std::string> words = splitWords(text);
+	if ((int)words.size() != count) return false;
+	for (int i = 0; i < count; i++)
+	{
+		if (!parseNumber(words[i], values[i])) return false;
+	}
+	return true;
+}
+
+static std::string lineError(int line, const std::string& message)
+{
+	char prefix[32];
+	sprintf(prefix, "line %d: ", line);
+	return prefix + message;
+}
+
+/* Words are rewritten so that 2, 2.0 and 2e0 hash the same */
+static std::string canonicalValue(const std::string& value)
+{
+	std::vector<std::string> words = splitWords(value);
+	std::string result;
+	for (size_t i = 0; i < words.size(); i++)
+	{
+		if (i) result += ' ';
+		double number;
+		if (parseNumber(words[i], number))
+		{
+			char buffer[32];
+			sprintf(buffer, "%.17g", number);
+			result += buffer;
+		}
+		else
+		{
+			result += words[i];
+		}
+	}
+	return result;
+}
+
+static const recipe_module_type* findModuleType(const std::string& name)
+{
+	for (size_t i = 0; i < sizeof(MODULE_TYPES) / sizeof(MODULE_TYPES[0]); i++)
+	{
+		if (name == MODULE_TYPES[i].name) return &MODULE_TYPES[i];
+	}
+	return NULL;
+}
+
+static const recipe_param* findParam(const std::string& type, const std::string& key)
+{
+	for (size_t i = 0; i < sizeof(MODULE_PARAMS) / sizeof(MODULE_PARAMS[0]); i++)
+	{
+		if (type == MODULE_PARAMS[i].type && key == MODULE_PARAMS[i].key) return &MODULE_PARAMS[i];
+	}
+	return NULL;
+}
+
+/* Index of a source key, or -1 */
+static int sourceIndex(const std::string& key, const recipe_module_type& type)
+{
+	if (key == "control") return type.control;
+	if (key.size() == 7 && key.compare(0, 6, "source") == 0 && key[6] >= '0' && key[6] <= '9')
+	{
+		return key[6] - '0';
+	}
+	return -1;
+}
+
+/* Split the text into sections, checking only the syntax */
+static bool readSections(const std::string& text, std::vector<recipe_section>& sections, std::string& error)
+{
+	std::istringstream in(text);
+	std::string raw;
+	int line = 0;
+	while (std::getline(in, raw))
+	{
+		line++;
+		std::string s = trim(raw);
+		if (s.empty() || s[0] == ';' || s[0] == '#') continue;
+
+		if (s[0] == '[')
+		{
+			if (s[s.size() - 1] != ']')
+			{
+				error = lineError(line, "section header has no closing ]");
+				return false;
+			}
+			std::vector<std::string> words = splitWords(s.substr(1, s.size() - 2));
+			recipe_section section;
+			section.line = line;
+			if (words.size() == 1 && words[0] == "terrain")
+			{
+				section.kind = words[0];
+			}
+			else if (words.size() == 2 && (words[0] == "module" || words[0] == "map"))
+			{
+				section.kind = words[0];
+				section.name = words[1];
+			}
+			else
+			{
+				error = lineError(line, "expected [terrain], [module <name>] or [map <name>]");
+				return false;
+			}
+			for (size_t i = 0; i < sections.size(); i++)
+			{
+				if (sections[i].kind == section.kind && sections[i].name == section.name)
+				{
+					error = lineError(line, "[" + trim(s.substr(1, s.size() - 2)) + "] is already defined");
+					return false;
+				}
+			}
+			sections.push_back(section);
+			continue;
+		}
+
+		size_t equals = s.find('=');
+		if (equals == std::string::npos)
+		{
+			error = lineError(line, "expected <key> = <value>");
+			return false;
+		}
+		if (sections.empty())
+		{
+			error = lineError(line, "value outside a section");
+			return false;
+		}
+		std::string key = trim(s.substr(0, equals));
+		recipe_entry entry;
+		entry.value = trim(s.substr(equals + 1));
+		entry.line = line;
+		if (key.empty() || entry.value.empty())
+		{
+			error = lineError(line, "expected <key> = <value>");
+			return false;
+		}
+		if (!sections.back().entries.insert(std::make_pair(key, entry)).second)
+		{
+			error = lineError(line, "'" + key + "' is already set");
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Visit the sources of a module before it, failing on a cycle. state is
+   0 before a module is visited, 1 while its sources are and 2 after. */
+static bool checkCycles(const std::string& name,
+	const std::map<std::string, std::vector<std::string> >& sources,
+	std::map<std::string, int>& state, std::string& cycle)
+{
+	int& s = state[name];
+	if (s == 2) return true;
+	if (s == 1)
+	{
+		cycle = name;
+		return false;
+	}
+	s = 1;
+	const std::vector<std::string>& inputs = sources.find(name)->second;
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		if (!checkCycles(inputs[i], sources, state, cycle)) return false;
+	}
+	state[name] = 2;
+	return true;
+}
+
+/* The seed of the first module that sets one, looking at a module before
+   its sources and the sources in order, or false if none does */
+static bool findSeed(const std::string& name,
+	const std::map<std::string, const recipe_section*>& modules,
+	const std::map<std::string, std::vector<std::string> >& sources,
+	std::set<std::string>& visited, int& seed)
+{
+	if (!visited.insert(name).second) return false;
+	const recipe_section& section = *modules.find(name)->second;
+	std::map<std::string, recipe_entry>::const_iterator e = section.entries.find("seed");
+	double value;
+	if (e != section.entries.end() && parseNumber(e->second.value, value))
+	{
+		seed = int(value);
+		return true;
+	}
+	const std::vector<std::string>& inputs = sources.find(name)->second;
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		if (findSeed(inputs[i], modules, sources, visited, seed)) return true;
+	}
+	return false;
+}
+
+terrain_recipe::terrain_recipe()
+{
+}
+
+bool terrain_recipe::load(const char* filename, std::string& error)
+{
+	std::ifstream in(filename, std::ios::in | std::ios::binary);
+	if (!in)
+	{
+		error = std::string("cannot open ") + filename;
+		return false;
+	}
+	std::ostringstream text;
+	text << in.rdbuf();
+	return parse(text.str(), error);
+}
+
+bool terrain_recipe::parse(const std::string& text, std::string& error)
+{
+	std::vector<recipe_section> sections;
+	if (!readSections(text, sections, error)) return false;
+
+	std::shared_ptr<compiled> result(new compiled);
+	const recipe_section* terrain = NULL;
+	std::map<std::string, const recipe_section*> modules;
+	std::map<std::string, const recipe_module_type*> types;
+	std::map<std::string, std::vector<std::string> > sources;
+
+	/* Check the modules and their types, parameters and source names */
+	for (size_t i = 0; i < sections.size(); i++)
+	{
+		const recipe_section& section = sections[i];
+		if (section.kind == "terrain") terrain = &section;
+		if (section.kind != "module") continue;
+		modules[section.name] = &section;
+
+		std::map<std::string, recipe_entry>::const_iterator type_entry = section.entries.find("type");
+		if (type_entry == section.entries.end())
+		{
+			error = lineError(section.line, "module '" + section.name + "' has no type");
+			return false;
+		}
+		const recipe_module_type* type = findModuleType(type_entry->second.value);
+		if (!type)
+		{
+			error = lineError(type_entry->second.line, "unknown module type '" + type_entry->second.value + "'");
+			return false;
+		}
+		types[section.name] = type;
+
+		std::vector<std::string>& inputs = sources[section.name];
+		inputs.resize(type->sources);
+		for (std::map<std::string, recipe_entry>::const_iterator e = section.entries.begin();
+			e != section.entries.end(); ++e)
+		{
+			if (e->first == "type") continue;
+			int index = sourceIndex(e->first, *type);
+			if (index >= 0 && index < type->sources)
+			{
+				if (!inputs[index].empty())
+				{
+					error = lineError(e->second.line, "source " + e->first + " is set twice");
+					return false;
+				}
+				inputs[index] = e->second.value;
+				continue;
+			}
+
+			const recipe_param* param = findParam(type->name, e->first);
+			if (!param)
+			{
+				error = lineError(e->second.line, "'" + e->first + "' is not a parameter of " + type->name);
+				return false;
+			}
+			double values[2];
+			if (!parseNumbers(e->second.value, param->values, values))
+			{
+				error = lineError(e->second.line, e->first + " needs " + (param->values == 1 ? "a number" : "two numbers"));
+				return false;
+			}
+			if (param->integer && values[0] != floor(values[0]))
+			{
+				error = lineError(e->second.line, e->first + " must be a whole number");
+				return false;
+			}
+			if (e->first == "quality" && (values[0] < noise::QUALITY_FAST || values[0] > noise::QUALITY_BEST))
+			{
+				error = lineError(e->second.line, "quality must be 0, 1 or 2");
+				return false;
+			}
+			if (param->values == 2 && !(values[0] < values[1]))
+			{
+				error = lineError(e->second.line, e->first + " needs the lower bound below the upper");
+				return false;
+			}
+		}
+		for (int s = 0; s < type->sources; s++)
+		{
+			if (inputs[s].empty())
+			{
+				char key[16];
+				sprintf(key, "source%d", s);
+				error = lineError(section.line, "module '" + section.name + "' needs "
+					+ (s == type->control ? std::string("control") : std::string(key)));
+				return false;
+			}
+		}
+	}
+
+	for (std::map<std::string, std::vector<std::string> >::const_iterator m = sources.begin();
+		m != sources.end(); ++m)
+	{
+		for (size_t s = 0; s < m->second.size(); s++)
+		{
+			if (!modules.count(m->second[s]))
+			{
+				error = lineError(modules[m->first]->line, "module '" + m->first
+					+ "' uses unknown module '" + m->second[s] + "'");
+				return false;
+			}
+		}
+	}
+	std::map<std::string, int> state;
+	for (std::map<std::string, std::vector<std::string> >::const_iterator m = sources.begin();
+		m != sources.end(); ++m)
+	{
+		std::string cycle;
+		if (!checkCycles(m->first, sources, state, cycle))
+		{
+			error = lineError(modules[cycle]->line, "module '" + cycle + "' depends on itself");
+			return false;
+		}
+	}
+
+	/* Check the maps */
+	for (size_t i = 0; i < sections.size(); i++)
+	{
+		const recipe_section& section = sections[i];
+		if (section.kind != "map") continue;
+
+		recipe_map map;
+		map.name = section.name;
+		for (std::map<std::string, recipe_entry>::const_iterator e = section.entries.begin();
+			e != section.entries.end(); ++e)
+		{
+			double values[4];
+			if (e->first == "module")
+			{
+				if (!modules.count(e->second.value))
+				{
+					error = lineError(e->second.line, "unknown module '" + e->second.value + "'");
+					return false;
+				}
+				map.module = e->second.value;
+			}
+			else if (e->first == "size")
+			{
+				if (!parseNumbers(e->second.value, 2, values) || values[0] != floor(values[0])
+					|| values[1] != floor(values[1]) || values[0] < 1 || values[1] < 1
+					|| values[0] > RECIPE_MAX_MAP_SIZE || values[1] > RECIPE_MAX_MAP_SIZE)
+				{
+					error = lineError(e->second.line, "size needs a width and height from 1 to 16384");
+					return false;
+				}
+				map.width = int(values[0]);
+				map.height = int(values[1]);
+			}
+			else if (e->first == "bounds")
+			{
+				if (!parseNumbers(e->second.value, 4, values) || !(values[0] < values[1]) || !(values[2] < values[3]))
+				{
+					error = lineError(e->second.line, "bounds needs lower x < upper x and lower z < upper z");
+					return false;
+				}
+				map.lower_x = values[0];
+				map.upper_x = values[1];
+				map.lower_z = values[2];
+				map.upper_z = values[3];
+			}
+			else
+			{
+				error = lineError(e->second.line, "'" + e->first + "' is not a map setting");
+				return false;
+			}
+		}
+		const char* required[] = { "module", "size", "bounds" };
+		for (int r = 0; r < 3; r++)
+		{
+			if (!section.entries.count(required[r]))
+			{
+				error = lineError(section.line, "map '" + section.name + "' has no " + required[r]);
+				return false;
+			}
+		}
+		result->maps.push_back(map);
+	}
+
+	/* Check the terrain */
+	if (!terrain)
+	{
+		error = "the recipe has no [terrain] section";
+		return false;
+	}
+	for (std::map<std::string, recipe_entry>::const_iterator e = terrain->entries.begin();
+		e != terrain->entries.end(); ++e)
+	{
+		std::vector<std::string> names = splitWords(e->second.value);
+		if (e->first == "heights")
+		{
+			if (names.size() != 1)
+			{
+				error = lineError(e->second.line, "heights needs one map");
+				return false;
+			}
+			result->heights = names[0];
+		}
+		else if (e->first == "previews")
+		{
+			result->previews = names;
+		}
+		else
+		{
+			error = lineError(e->second.line, "'" + e->first + "' is not a terrain setting");
+			return false;
+		}
+		for (size_t n = 0; n < names.size(); n++)
+		{
+			bool found = false;
+			for (size_t m = 0; m < result->maps.size(); m++) found = found || result->maps[m].name == names[n];
+			if (!found)
+			{
+				error = lineError(e->second.line, "unknown map '" + names[n] + "'");
+				return false;
+			}
+		}
+	}
+	if (result->heights.empty())
+	{
+		error = lineError(terrain->line, "the terrain has no heights");
+		return false;
+	}
+
+	/* Modules that set no seed use libnoise's default of 0 */
+	result->seed = 0;
+	std::set<std::string> visited;
+	for (size_t m = 0; m < result->maps.size(); m++)
+	{
+		if (result->maps[m].name != result->heights) continue;
+		findSeed(result->maps[m].module, modules, sources, visited, result->seed);
+	}
+
+	/* Everything is known to exist, so build the modules, connect them and
+	   set their parameters. libnoise still rejects some values, such as
+	   too many octaves. */
+	for (std::map<std::string, const recipe_section*>::const_iterator m = modules.begin(); m != modules.end(); ++m)
+	{
+		result->modules.push_back(std::unique_ptr<noise::module::Module>(types[m->first]->create()));
+		result->by_name[m->first] = result->modules.back().get();
+	}
+	for (std::map<std::string, const recipe_section*>::const_iterator m = modules.begin(); m != modules.end(); ++m)
+	{
+		noise::module::Module& module = *result->by_name[m->first];
+		const std::vector<std::string>& inputs = sources[m->first];
+		for (size_t s = 0; s < inputs.size(); s++)
+		{
+			/* libnoise takes the control of select and blend as source 2 */
+			module.SetSourceModule((int)s, *result->by_name[inputs[s]]);
+		}
+
+		for (size_t p = 0; p < sizeof(MODULE_PARAMS) / sizeof(MODULE_PARAMS[0]); p++)
+		{
+			const recipe_param& param = MODULE_PARAMS[p];
+			std::map<std::string, recipe_entry>::const_iterator e = m->second->entries.find(param.key);
+			if (types[m->first]->name != std::string(param.type) || e == m->second->entries.end()) continue;
+
+			double values[2];
+			parseNumbers(e->second.value, param.values, values);
+			try
+			{
+				param.set(module, values);
+			}
+			catch (noise::Exception&)
+			{
+				error = lineError(e->second.line, e->second.value + " is out of range for " + param.key);
+				return false;
+			}
+		}
+	}
+
+	/* Hash the sections in a fixed order, so that reordering them or their
+	   keys, or editing comments, keeps the hash */
+	std::vector<std::string> canonical;
+	for (size_t i = 0; i < sections.size(); i++)
+	{
+		std::string s = "[" + sections[i].kind + " " + sections[i].name + "]\n";
+		for (std::map<std::string, recipe_entry>::const_iterator e = sections[i].entries.begin();
+			e != sections[i].entries.end(); ++e)
+		{
+			s += e->first + "=" + canonicalValue(e->second.value) + "\n";
+		}
+		canonical.push_back(s);
+	}
+	std::sort(canonical.begin(), canonical.end());
+	std::string all;
+	for (size_t i = 0; i < canonical.size(); i++) all += canonical[i];
+	result->hash = heightfield_hash(all.data(), all.size());
+
+	graph = result;
+	return true;
+}
+
+bool terrain_recipe::isValid() const
+{
+	return graph != NULL;
+}
+
+unsigned long long terrain_recipe::getHash() const
+{
+	return graph ? graph->hash : 0;
+}
+
+const recipe_map* terrain_recipe::findMap(const std::string& name) const
+{
+	if (!graph) return NULL;
+	for (size_t i = 0; i < graph->maps.size(); i++)
+	{
+		if (graph->maps[i].name == name) return &graph->maps[i];
+	}
+	return NULL;
+}
+
+int terrain_recipe::getSeed() const
+{
+	return graph ? graph->seed : 0;
+}
+
+const recipe_map& terrain_recipe::getHeightsMap() const
+{
+	return *findMap(graph->heights);
+}
+
+const std::vector<std::string>& terrain_recipe::getPreviews() const
+{
+	return graph->previews;
+}
+
+void terrain_recipe::buildMap(const recipe_map& map, noise::utils::NoiseMap& dest) const
+{
+	noise::utils::NoiseMapBuilderPlane builder;
+	builder.SetSourceModule(*graph->by_name.find(map.module)->second);
+	builder.SetDestNoiseMap(dest);
+	builder.SetDestSize(map.width, map.height);
+	builder.SetBounds(map.lower_x, map.upper_x, map.lower_z, map.upper_z);
+	builder.Build();
+}
+
+void terrain_recipe::buildMapRegion(const recipe_map& map, int x0, int z0, int x1, int z1,
+	float* dest, int stride) const
+{
+	for (int z = z0; z < z1; z++)
+	{
+		for (int x = x0; x < x1; x++) dest[(z - z0) * stride + x - x0] = 0.f;
+	}
+
+	/* Only the part that lies within the map has noise */
+	int inner_x1 = std::min(x1, map.width);
+	int inner_z1 = std::min(z1, map.height);
+	if (inner_x1 <= x0 || inner_z1 <= z0) return;
+
+	noise::utils::NoiseMapBuilderPlane builder;
+	builder.SetSourceModule(*graph->by_name.find(map.module)->second);
+	builder.SetDestSize(map.width, map.height);
+	builder.SetBounds(map.lower_x, map.upper_x, map.lower_z, map.upper_z);
+	builder.BuildRegion(x0, z0, inner_x1, inner_z1, dest, stride);
+}
+
+static terrain_recipe parseStandard()
+{
+	terrain_recipe recipe;
+	std::string error;
+	if (!recipe.parse(STANDARD_RECIPE, error)) fprintf(stderr, "Standard recipe: %s\n", error.c_str());
+	return recipe;
+}
+
+const terrain_recipe& terrain_recipe::standard()
+{
+	static terrain_recipe recipe = parseStandard();
+	return recipe;
+}
@@ -0,0 +1,108 @@
+/* terrain_recipe.h
+   A terrain recipe describes, as text, the libnoise module graph that
+   makes the terrain heights and the noise maps built from it, so that the
+   graph can be changed without writing a class for each part of it.
+
+   Recipes are INI files. Blank lines and lines starting with ; or # are
+   ignored. There are three kinds of section:
+
+     [module <name>]   one libnoise module
+       type = perlin, billow, ridgedmulti, voronoi, const, scalebias,
+              clamp, exponent, abs, invert, turbulence, add, multiply,
+              max, min, select or blend
+       source0 ... source2 = <module>   the module's sources, in order
+       control = <module>               the control of select and blend
+       and the module's own parameters:
+         perlin, billow   frequency, lacunarity, persistence, octaves,
+                          seed, quality (0 fast, 1 standard, 2 best)
+         ridgedmulti      frequency, lacunarity, octaves, seed, quality
+         voronoi          frequency, displacement, seed, distance (0 or 1)
+         const            value
+         scalebias        scale, bias
+         clamp            bounds = <lower> <upper>
+         exponent         exponent
+         select           bounds = <lower> <upper>, edge_falloff
+         turbulence       frequency, power, roughness, seed
+
+     [map <name>]      a noise map built from a module on a plane
+       module = <module>
+       size = <width> <height>
+       bounds = <lower x> <upper x> <lower z> <upper z>
+
+     [terrain]         which maps the terrain uses
+       heights = <map>              the map the terrain heights come from.
+                                    The terrain samples its bounds with a
+                                    point per vertex, so its size is only
+                                    that of its preview.
+       previews = <map> <map> ...   maps written as debug previews
+
+   parse checks every name, parameter, value and source, and that the
+   modules form no cycle, and only then builds the modules. A recipe can be
+   copied cheaply: the copies share the built modules, which are never
+   changed again, so a copy can build maps on another thread.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <noise/noise.h>
+#include "noiseutils.h"
+
+/* A [map] section */
+struct recipe_map
+{
+	std::string name;
+	std::string module;
+	int width;
+	int height;
+	double lower_x;
+	double upper_x;
+	double lower_z;
+	double upper_z;
+};
+
+class terrain_recipe
+{
+public:
+	terrain_recipe();
+
+	/* Read and parse a recipe file. On failure the recipe is left as it
+	   was and error says what is wrong and on which line. */
+	bool load(const char* filename, std::string& error);
+	bool parse(const std::string& text, std::string& error);
+
+	/* True once a recipe has been parsed */
+	bool isValid() const;
+
+	/* Hash of the recipe's sections, keys and values, independent of
+	   their order, spacing and comments */
+	unsigned long long getHash() const;
+
+	/* Seed of the heights: that of the first module found from the heights
+	   map's module, sources in order, that sets one, or 0 if none does */
+	int getSeed() const;
+
+	const recipe_map* findMap(const std::string& name) const;
+	const recipe_map& getHeightsMap() const;
+	const std::vector<std::string>& getPreviews() const;
+
+	/* Build a map of this recipe into dest */
+	void buildMap(const recipe_map& map, noise::utils::NoiseMap& dest) const;
+
+	/* Build the points of a map from (x0, z0) up to but not including
+	   (x1, z1) into dest, a row of x at a time with stride floats from one
+	   row to the next. The points get the same values as buildMap gives
+	   them, and points outside the map are 0, as they are when read from
+	   a built map. Safe to call from several threads at once. */
+	void buildMapRegion(const recipe_map& map, int x0, int z0, int x1, int z1,
+		float* dest, int stride) const;
+
+	/* The recipe of the standard terrain, parsed once on first use */
+	static const terrain_recipe& standard();
+
+private:
+	struct compiled;
+	std::shared_ptr<const compiled> graph;
+};
@@ -0,0 +1,159 @@
+/* thermal_erosion.cpp
+   Thermal (talus) erosion of a height array.
+*/
+
+#include "thermal_erosion.h"
+#include "job_system.h"
+#include <math.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+/* Rows handled by one job on the worker pool in each iteration */
+const int THERMAL_BAND_ROWS = 16;
+
+thermal_erosion_params::thermal_erosion_params()
+{
+	iterations = 0;
+	talus = 0.01f;
+	rate = 0.0625f;
+	tolerance = 1e-6f;
+}
+
+/* Flow into a point across one edge, per unit rate, given the height of
+   the neighbour minus the height of the point. Positive if the neighbour
+   is higher by more than the talus, negative if it is lower by more. */
+static inline float edgeFlow(float delta, float talus)
+{
+	float in = delta - talus;
+	float out = -delta - talus;
+	return (in > 0.f ? in : 0.f) - (out > 0.f ? out : 0.f);
+}
+
+/* Flow into point x of a row from all eight neighbours, for points that
+   are not on an edge of the grid */
+static inline float pointFlow(const float* up, const float* row, const float* down,
+	int x, float talus, float talus_diagonal)
+{
+	float h = row[x];
+	return edgeFlow(row[x - 1] - h, talus) + edgeFlow(row[x + 1] - h, talus)
+		+ edgeFlow(up[x] - h, talus) + edgeFlow(down[x] - h, talus)
+		+ edgeFlow(up[x - 1] - h, talus_diagonal) + edgeFlow(up[x + 1] - h, talus_diagonal)
+		+ edgeFlow(down[x - 1] - h, talus_diagonal) + edgeFlow(down[x + 1] - h, talus_diagonal);
+}
+
+/* The same for a point on an edge of the grid, skipping the neighbours
+   that do not exist */
+static float borderFlow(const float* src, int columns, int rows, int x, int y,
+	float talus, float talus_diagonal)
+{
+	float h = src[(size_t)y * columns + x];
+	float flow = 0.f;
+	for (int dy = -1; dy <= 1; dy++)
+	{
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			int nx = x + dx;
+			int ny = y + dy;
+			if ((dx == 0 && dy == 0) || nx < 0 || nx >= columns || ny < 0 || ny >= rows) continue;
+			flow += edgeFlow(src[(size_t)ny * columns + nx] - h,
+				(dx != 0 && dy != 0) ? talus_diagonal : talus);
+		}
+	}
+	return flow;
+}
+
+/* One iteration over rows [y0, y1). Returns the largest change. */
+static float erodeRows(const float* src, float* dest, int columns, int rows, int y0, int y1,
+	float talus, float talus_diagonal, float rate)
+{
+	float max_change = 0.f;
+	for (int y = y0; y < y1; y++)
+	{
+		const float* row = src + (size_t)y * columns;
+		float* out = dest + (size_t)y * columns;
+
+		if (y == 0 || y == rows - 1 || columns < 3)
+		{
+			for (int x = 0; x < columns; x++)
+			{
+				out[x] = row[x] + rate * borderFlow(src, columns, rows, x, y, talus, talus_diagonal);
+			}
+		}
+		else
+		{
+			const float* up = row - columns;
+			const float* down = row + columns;
+			int last = columns - 1;
+			out[0] = row[0] + rate * borderFlow(src, columns, rows, 0, y, talus, talus_diagonal);
+			out[last] = row[last] + rate * borderFlow(src, columns, rows, last, y, talus, talus_diagonal);
+			for (int x = 1; x < last; x++)
+			{
+				out[x] = row[x] + rate * pointFlow(up, row, down, x, talus, talus_diagonal);
+			}
+		}
+
+		for (int x = 0; x < columns; x++)
+		{
+			float change = fabsf(out[x] - row[x]);
+			max_change = change > max_change ? change : max_change;
+		}
+	}
+	return max_change;
+}
+
+void thermal_erosion::run(float* heights, int columns, int rows,
+	const thermal_erosion_params& params, thermal_erosion_stats* stats)
+{
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	thermal_erosion_stats totals = {};
+
+	if (params.iterations <= 0 || columns <= 0 || rows <= 0)
+	{
+		if (stats) *stats = totals;
+		return;
+	}
+
+	/* Above 1/8 a point with eight lower neighbours could lose more than
+	   its excess and the iteration would oscillate */
+	float rate = params.rate < 0.125f ? params.rate : 0.125f;
+	float talus = params.talus;
+	float talus_diagonal = params.talus * 1.41421356f;
+
+	std::vector<float> scratch((size_t)columns * rows);
+	float* src = heights;
+	float* dest = &scratch[0];
+
+	int bands = (rows + THERMAL_BAND_ROWS - 1) / THERMAL_BAND_ROWS;
+	std::vector<float> band_change(bands);
+	for (int i = 0; i < params.iterations; i++)
+	{
+		job_system::instance().parallel_for(0, bands, 1, [&](int begin, int end)
+		{
+			for (int b = begin; b < end; b++)
+			{
+				int y0 = b * THERMAL_BAND_ROWS;
+				int y1 = y0 + THERMAL_BAND_ROWS < rows ? y0 + THERMAL_BAND_ROWS : rows;
+				band_change[b] = erodeRows(src, dest, columns, rows, y0, y1, talus, talus_diagonal, rate);
+			}
+		});
+
+		float* swap = src;
+		src = dest;
+		dest = swap;
+
+		totals.iterations++;
+		totals.last_change = 0.f;
+		for (int b = 0; b < bands; b++)
+		{
+			if (band_change[b] > totals.last_change) totals.last_change = band_change[b];
+		}
+		if (totals.last_change <= params.tolerance) break;
+	}
+
+	/* The latest heights are in src */
+	if (src != heights) memcpy(heights, src, (size_t)columns * rows * sizeof(float));
+
+	totals.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	if (stats) *stats = totals;
+}
@@ -0,0 +1,44 @@
+/* thermal_erosion.h
+   Thermal (talus) erosion of a height array.
+
+   Wherever the slope between a point and one of its eight neighbours is
+   steeper than the talus slope, material slides from the higher point to
+   the lower one. Each iteration reads one buffer and writes the other, and
+   every point only gathers the flows across its own eight edges, so the
+   rows can be split into bands that run in parallel. A flow is worked out
+   the same way from both ends of its edge, so no material is lost.
+
+   The inner loop over a row has no branches and no dependencies between
+   points, so the compiler can vectorize it. Iteration stops early once no
+   height changes by more than the tolerance.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+struct thermal_erosion_params
+{
+	thermal_erosion_params();
+
+	int iterations;		/* Most iterations to run; zero disables erosion */
+	float talus;		/* Steepest stable slope, in height per grid step */
+	float rate;			/* Fraction of the excess slope moved per iteration, at most 0.125 */
+	float tolerance;	/* Stop once no height changes by more than this */
+};
+
+struct thermal_erosion_stats
+{
+	int iterations;
+	float last_change;	/* Largest change in any height in the last iteration */
+	double seconds;
+};
+
+class thermal_erosion
+{
+public:
+	/* Erode a grid of rows * columns heights stored row by row. Fills in
+	   stats, if given, with the iterations run and how long they took. */
+	static void run(float* heights, int columns, int rows,
+		const thermal_erosion_params& params, thermal_erosion_stats* stats = NULL);
+};